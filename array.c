@@ -9,19 +9,64 @@
         1. 获取和更新数据平均都是O(1)，使用下标
         3. 删除和插入平均都是O(n)，因为需要定位和迁移元素
 */
+/*
+    扩容：
+        1. 容量不够时按growfactor倍扩容（默认2倍），至少加1，均摊O(1)
+        2. 小数组用realloc扩容，堆上后面有空闲时原地变大，不需要复制
+        3. 超过MAPBYTES的数组直接用mmap分配，扩容用mremap，内核只是移动
+           页表，不复制数据；新增的页在第一次写的时候才分配物理内存，
+           也不需要清零（mmap出来的页本来就是0，而且len之后的元素不会被读到）
+        4. reserve预先分配容量，shrinkToFit把多余的容量还回去
+
+    间隙模式（gap buffer）
+        空闲的容量不放在末尾，而是放在光标的位置：
+
+        arr--->+---+---+---+-----------+---+---+
+               | 0 | 1 | 2 |    gap    | 3 | 4 |
+               +---+---+---+-----------+---+---+
+                           ^cursor     ^cursor+(cap-len)
+
+        在光标处插入、删除只改间隙的边界，不移动其他元素；
+        在别的位置编辑时先把间隙挪过去，只复制光标移动距离内的元素。
+        第i个元素在 i < cursor ? arr[i] : arr[i + cap - len]，随机读还是O(1)，
+        间隙模式下要用get/set访问元素，不能直接用arr下标
+*/
 /*注意：如果失败退出不是终止程序，那么就需要释放掉新分配的内存，避免内存泄漏*/
 
+#define _GNU_SOURCE  // mremap
+#include <limits.h>
 #include <memory.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define GROWFACTOR 2.0           // 默认的扩容倍数
+#define MAPBYTES (64UL << 20)    // 超过这么多字节的数组用mmap分配
 
 typedef struct array {
-    int cap;   // 当前容量
-    int len;   // 当前元素长度
-    int last;  // 最后一个元素下标
-    int* arr;  // 数组
+    size_t cap;         // 当前容量
+    size_t len;         // 当前元素长度
+    ptrdiff_t last;     // 最后一个元素下标
+    int* arr;           // 数组
+    double growfactor;  // 扩容倍数，必须大于1
+    int mapped;         // 为1时arr是mmap分配的，容量变化用mremap
+    int copygrow;       // 为1时按以前的方式扩容：malloc新数组、清零、
+                        // 复制、释放旧数组，只用来对比测试
+    int gapbuf;         // 为1时是间隙模式
+    size_t cursor;      // 间隙模式下间隙的起点，前面有cursor个元素
+    int sorted;         // 为1时是有序模式，元素从小到大排列
 } Array, *ArrayPtr;
 
+int trace = 1;  // 为0时erase不输出，测试性能时用
+
 // 输出错误并终止程序
 void exitErr(const char* errMsg) {
     fprintf(stderr, "%s\n", errMsg);
@@ -42,40 +87,169 @@ void checkPtr(ArrayPtr ptr) {
     }
 }
 
+// mmap分配的字节数，按页对齐
+size_t mapBytes(size_t cap) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (cap * sizeof(int) + page - 1) / page * page;
+}
+
+// 把容量改成newcap，保留所有元素，newcap不能小于len
+// 大小跨过MAPBYTES的时候在malloc和mmap之间搬一次，之后都是realloc或者mremap
+// 间隙模式下光标后面的元素始终放在数组末尾，容量变化时跟着挪
+void resizeArray(ArrayPtr ptr, size_t newcap) {
+    if (newcap == 0) {
+        newcap = 1;
+    }
+    if (newcap > SIZE_MAX / sizeof(int)) {
+        exitErr("array is too large");
+    }
+    size_t bytes = newcap * sizeof(int);
+    size_t oldcap = ptr->cap;
+    size_t tail = ptr->gapbuf ? ptr->len - ptr->cursor : 0;
+    size_t keep = ptr->len;  // 要保留的前缀元素个数
+    if (tail > 0 && newcap < oldcap) {
+        // 缩小：先把光标后面的元素挪到新的末尾
+        memmove(ptr->arr + newcap - tail, ptr->arr + oldcap - tail,
+                sizeof(int) * tail);
+        keep = newcap;
+    } else if (tail > 0) {
+        keep = oldcap;
+    }
+    if (ptr->copygrow) {
+        int* newArr = malloc(bytes);
+        isOutOfMemmory(newArr);
+        memset(newArr, 0, bytes);
+        memcpy(newArr, ptr->arr, sizeof(int) * keep);
+        free(ptr->arr);
+        ptr->arr = newArr;
+    } else if (bytes >= MAPBYTES) {
+        void* p;
+        if (ptr->mapped) {
+            p = mremap(ptr->arr, mapBytes(ptr->cap), mapBytes(newcap),
+                       MREMAP_MAYMOVE);
+        } else {
+            p = mmap(NULL, mapBytes(newcap), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p != MAP_FAILED) {
+                memcpy(p, ptr->arr, sizeof(int) * keep);
+                free(ptr->arr);
+            }
+        }
+        if (p == MAP_FAILED) {
+            exitErr("out of memory");
+        }
+        ptr->arr = p;
+        ptr->mapped = 1;
+    } else if (ptr->mapped) {
+        // 缩小到MAPBYTES以下，搬回堆上
+        int* newArr = malloc(bytes);
+        isOutOfMemmory(newArr);
+        memcpy(newArr, ptr->arr, sizeof(int) * keep);
+        munmap(ptr->arr, mapBytes(ptr->cap));
+        ptr->arr = newArr;
+        ptr->mapped = 0;
+    } else {
+        int* newArr = realloc(ptr->arr, bytes);
+        isOutOfMemmory(newArr);
+        ptr->arr = newArr;
+    }
+    if (tail > 0 && newcap > oldcap) {
+        memmove(ptr->arr + newcap - tail, ptr->arr + oldcap - tail,
+                sizeof(int) * tail);
+    }
+    ptr->cap = newcap;
+}
+
+// 保证容量至少是n，不会缩小
+void reserve(ArrayPtr ptr, size_t n) {
+    checkPtr(ptr);
+    if (n > ptr->cap) {
+        resizeArray(ptr, n);
+    }
+}
+
+// 容量缩小到元素个数
+void shrinkToFit(ArrayPtr ptr) {
+    checkPtr(ptr);
+    if (ptr->cap > ptr->len) {
+        resizeArray(ptr, ptr->len);
+    }
+}
+
+// 设置扩容倍数
+void setGrowFactor(ArrayPtr ptr, double growfactor) {
+    checkPtr(ptr);
+    if (!(growfactor > 1.0)) {
+        exitErr("grow factor must be greater than 1");
+    }
+    ptr->growfactor = growfactor;
+}
+
+// 容量放不下need个元素的时候扩容，只扩一次
+// 按倍数算出的新容量不够就直接扩到need
+void growArray(ArrayPtr ptr, size_t need) {
+    if (need <= ptr->cap) {
+        return;
+    }
+    size_t newcap = (size_t)(ptr->cap * ptr->growfactor);
+    if (newcap < need) {
+        newcap = need;
+    }
+    resizeArray(ptr, newcap);
+}
+
+// 间隙模式下把间隙挪到pos，只移动pos和光标之间的元素
+void moveGap(ArrayPtr ptr, size_t pos) {
+    size_t gaplen = ptr->cap - ptr->len;
+    if (pos < ptr->cursor) {
+        memmove(ptr->arr + pos + gaplen, ptr->arr + pos,
+                sizeof(int) * (ptr->cursor - pos));
+    } else if (pos > ptr->cursor) {
+        memmove(ptr->arr + ptr->cursor, ptr->arr + ptr->cursor + gaplen,
+                sizeof(int) * (pos - ptr->cursor));
+    }
+    ptr->cursor = pos;
+}
+
+// 打开或者关闭间隙模式
+// 关闭时把间隙挪到末尾，arr又是连续的了
+void setGapMode(ArrayPtr ptr, int on) {
+    checkPtr(ptr);
+    if (ptr->gapbuf && !on) {
+        moveGap(ptr, ptr->len);
+    } else if (!ptr->gapbuf && on) {
+        ptr->cursor = ptr->len;
+    }
+    ptr->gapbuf = on != 0;
+}
+
 // 增加元素，元素可能会移动
-// 如果pos小于0则添加到头部，如果超过数据长度，则会添加失败
+// 如果pos小于1则添加到头部，如果超过数据长度，则会添加失败
 // 插入第一个位置下标为0，插入第n个位置，下标为n-1
-void insert(ArrayPtr ptr, int pos, int el) {
+void insert(ArrayPtr ptr, ptrdiff_t pos, int el) {
     checkPtr(ptr);
+    ptr->sorted = 0;
 
-    if (pos > ptr->len + 1) {
+    if (pos > (ptrdiff_t)ptr->len + 1) {
         exitErr("pos error");
     }
     // 如果数组容量已经满了就扩容
-    if (ptr->cap == ptr->len) {
-        // 分配基于当前容量的两倍内存
-        int* newArr = malloc(sizeof(int) * (ptr->cap * 2));
-        isOutOfMemmory(newArr);
-        memset(newArr, 0, sizeof(int) * (ptr->cap * 2));
-        // 迁移数据
-        // void* memcpy(void *dst, const void *src, size_t size);
-        // memcpy将src的前size个字节拷贝到dst中
-        newArr = memcpy(newArr, ptr->arr, sizeof(int) * ptr->len);
-        isOutOfMemmory(newArr);
-        // 释放掉原来的内存
-        free(ptr->arr);
-        ptr->arr = NULL;
-        // 指向新分配的数组
-        ptr->arr = newArr;
-        ptr->cap *= 2;
-    }
+    growArray(ptr, ptr->len + 1);
 
-    // 如果位置小于0就默认插入第一个位置s
-    if (pos < 0) {
+    // 如果位置小于1就默认插入第一个位置
+    if (pos < 1) {
         pos = 1;
     }
+    if (ptr->gapbuf) {
+        // 间隙挪到插入位置，放在间隙开头
+        moveGap(ptr, (size_t)pos - 1);
+        ptr->arr[ptr->cursor++] = el;
+        ++ptr->last;
+        ++ptr->len;
+        return;
+    }
     // 迁移元素
-    for (int i = ptr->len; i > pos - 1; i--) {
+    for (ptrdiff_t i = ptr->len; i > pos - 1; i--) {
         ptr->arr[i] = ptr->arr[i - 1];
     }
     // 赋值
@@ -85,23 +259,55 @@ void insert(ArrayPtr ptr, int pos, int el) {
 }
 
 // 获取元素
+int get(ArrayPtr ptr, ptrdiff_t i) {
+    checkPtr(ptr);
+    if (i >= (ptrdiff_t)ptr->len || i < 0) {
+        exitErr("out of range");
+    }
+    if (ptr->gapbuf && (size_t)i >= ptr->cursor) {
+        i += ptr->cap - ptr->len;
+    }
+    return ptr->arr[i];
+}
 
 // 更新元素
+void set(ArrayPtr ptr, ptrdiff_t i, int el) {
+    checkPtr(ptr);
+    ptr->sorted = 0;
+    if (i >= (ptrdiff_t)ptr->len || i < 0) {
+        exitErr("out of range");
+    }
+    if (ptr->gapbuf && (size_t)i >= ptr->cursor) {
+        i += ptr->cap - ptr->len;
+    }
+    ptr->arr[i] = el;
+}
 
 // 删除元素，元素会移动
 // i 是要删除的元素索引
-void erase(ArrayPtr ptr, int i) {
+void erase(ArrayPtr ptr, ptrdiff_t i) {
     checkPtr(ptr);
     // 不存在元素就直接结束，不做任何操作
     if (ptr->len == 0) {
         return;
     }
-    if (i >= ptr->len || i < 0) {
+    if (i >= (ptrdiff_t)ptr->len || i < 0) {
         exitErr("out of range");
     }
+    if (ptr->gapbuf) {
+        // 间隙挪到i，第i个元素紧跟在间隙后面，间隙变长一格就删掉了
+        moveGap(ptr, (size_t)i);
+        int el = ptr->arr[i + ptr->cap - ptr->len];
+        --ptr->last;
+        --ptr->len;
+        if (trace) {
+            printf("remove el: %d\n", el);
+        }
+        return;
+    }
     int el = ptr->arr[i];
     if (i < ptr->last) {
-        while (i <= ptr->last) {
+        while (i < ptr->last) {
             ptr->arr[i] = ptr->arr[i + 1];
             ++i;
         }
@@ -110,7 +316,887 @@ void erase(ArrayPtr ptr, int i) {
     --ptr->last;
     // 减少元素个数
     --ptr->len;
-    printf("remove el: %d\n", el);
+    if (trace) {
+        printf("remove el: %d\n", el);
+    }
+}
+
+// 在第pos个位置插入src的n个元素，pos的含义和insert一样
+// 最多扩容一次，后面的元素用一次memmove整体后移
+// src不能指向数组自己，扩容以后原来的地址就失效了
+void insertRange(ArrayPtr ptr, ptrdiff_t pos, const int* src, size_t n) {
+    checkPtr(ptr);
+    ptr->sorted = 0;
+
+    if (pos > (ptrdiff_t)ptr->len + 1) {
+        exitErr("pos error");
+    }
+    if (n == 0) {
+        return;
+    }
+    if (n > SIZE_MAX / sizeof(int) - ptr->len) {
+        exitErr("array is too large");
+    }
+    growArray(ptr, ptr->len + n);
+
+    if (pos < 1) {
+        pos = 1;
+    }
+    size_t at = (size_t)pos - 1;
+    if (ptr->gapbuf) {
+        moveGap(ptr, at);
+        memcpy(ptr->arr + at, src, sizeof(int) * n);
+        ptr->cursor += n;
+        ptr->len += n;
+        ptr->last = (ptrdiff_t)ptr->len - 1;
+        return;
+    }
+    // void* memmove(void *dst, const void *src, size_t size);
+    // 和memcpy一样，但是dst和src可以重叠
+    memmove(ptr->arr + at + n, ptr->arr + at, sizeof(int) * (ptr->len - at));
+    memcpy(ptr->arr + at, src, sizeof(int) * n);
+    ptr->len += n;
+    ptr->last = (ptrdiff_t)ptr->len - 1;
+}
+
+// 追加到末尾
+void append(ArrayPtr ptr, const int* src, size_t n) {
+    checkPtr(ptr);
+    insertRange(ptr, (ptrdiff_t)ptr->len + 1, src, n);
+}
+
+// 删除下标从i开始的n个元素，超过末尾的部分忽略
+// 后面的元素用一次memmove整体前移
+void eraseRange(ArrayPtr ptr, ptrdiff_t i, size_t n) {
+    checkPtr(ptr);
+    if (ptr->len == 0 || n == 0) {
+        return;
+    }
+    if (i >= (ptrdiff_t)ptr->len || i < 0) {
+        exitErr("out of range");
+    }
+    size_t at = (size_t)i;
+    if (n > ptr->len - at) {
+        n = ptr->len - at;
+    }
+    if (ptr->gapbuf) {
+        moveGap(ptr, at);
+        ptr->len -= n;
+        ptr->last = (ptrdiff_t)ptr->len - 1;
+        return;
+    }
+    memmove(ptr->arr + at, ptr->arr + at + n,
+            sizeof(int) * (ptr->len - at - n));
+    ptr->len -= n;
+    ptr->last = (ptrdiff_t)ptr->len - 1;
+}
+
+// 向量化的查找、计数、求和、最值和过滤
+// 每个操作有三个版本：逐个元素的普通循环、SSE2（128位，x86-64都支持）和
+// AVX2（256位）。第一次调用时按CPU支持的指令选版本，simdLevel可以强制指定。
+// 核心函数只处理一段连续的内存，间隙模式下对间隙前后两段分别调用
+
+// 过滤条件：元素 op value
+// 条件写成数据而不是函数指针，向量版本才能一次比较一整个向量
+typedef enum predOp {
+    PRED_EQ,
+    PRED_NE,
+    PRED_LT,
+    PRED_LE,
+    PRED_GT,
+    PRED_GE
+} PredOp;
+
+typedef struct pred {
+    PredOp op;
+    int value;
+} Pred;
+
+typedef struct kernels {
+    const char* name;
+    ptrdiff_t (*find)(const int* p, size_t n, int value);  // 找不到返回-1
+    size_t (*count)(const int* p, size_t n, int value);
+    long long (*sum)(const int* p, size_t n);
+    int (*min)(const int* p, size_t n);  // n必须大于0
+    int (*max)(const int* p, size_t n);
+    // 满足条件的元素依次写到out，返回个数
+    // 向量版本会多写最多8个元素，out后面要留出空间
+    size_t (*filter)(const int* p, size_t n, Pred pred, int* out);
+} Kernels;
+
+enum { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2, SIMD_LEVELS };
+
+#define FILTERSLACK 8  // 向量过滤多写的元素个数
+
+int simdLevel = -1;  // -1表示按CPU自动选择
+
+int predTest(int x, Pred pred) {
+    switch (pred.op) {
+        case PRED_EQ:
+            return x == pred.value;
+        case PRED_NE:
+            return x != pred.value;
+        case PRED_LT:
+            return x < pred.value;
+        case PRED_LE:
+            return x <= pred.value;
+        case PRED_GT:
+            return x > pred.value;
+        default:
+            return x >= pred.value;
+    }
+}
+
+// 普通循环关掉自动向量化，作为测试的基准和交叉检查的标准答案
+#define SCALAR __attribute__((optimize("no-tree-vectorize")))
+
+SCALAR ptrdiff_t findScalar(const int* p, size_t n, int value) {
+    for (size_t i = 0; i < n; i++) {
+        if (p[i] == value) {
+            return (ptrdiff_t)i;
+        }
+    }
+    return -1;
+}
+
+SCALAR size_t countScalar(const int* p, size_t n, int value) {
+    size_t c = 0;
+    for (size_t i = 0; i < n; i++) {
+        c += p[i] == value;
+    }
+    return c;
+}
+
+SCALAR long long sumScalar(const int* p, size_t n) {
+    long long s = 0;
+    for (size_t i = 0; i < n; i++) {
+        s += p[i];
+    }
+    return s;
+}
+
+SCALAR int minScalar(const int* p, size_t n) {
+    int m = p[0];
+    for (size_t i = 1; i < n; i++) {
+        if (p[i] < m) {
+            m = p[i];
+        }
+    }
+    return m;
+}
+
+SCALAR int maxScalar(const int* p, size_t n) {
+    int m = p[0];
+    for (size_t i = 1; i < n; i++) {
+        if (p[i] > m) {
+            m = p[i];
+        }
+    }
+    return m;
+}
+
+SCALAR size_t filterScalar(const int* p, size_t n, Pred pred, int* out) {
+    size_t k = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (predTest(p[i], pred)) {
+            out[k++] = p[i];
+        }
+    }
+    return k;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#define AVX2 __attribute__((target("avx2")))
+
+// 计数用32位的计数器，每处理这么多个元素累加到总数一次，避免溢出
+#define COUNTBLOCK (1UL << 28)
+
+/*---------- SSE2 ----------*/
+
+static inline __m128i load4(const int* p) {
+    return _mm_loadu_si128((const __m128i*)p);
+}
+
+// 4个元素和value比较，满足条件的位置全1
+static inline __m128i predMask4(__m128i x, __m128i v, PredOp op) {
+    __m128i ones = _mm_set1_epi32(-1);
+    switch (op) {
+        case PRED_EQ:
+            return _mm_cmpeq_epi32(x, v);
+        case PRED_NE:
+            return _mm_xor_si128(_mm_cmpeq_epi32(x, v), ones);
+        case PRED_LT:
+            return _mm_cmplt_epi32(x, v);
+        case PRED_LE:
+            return _mm_xor_si128(_mm_cmpgt_epi32(x, v), ones);
+        case PRED_GT:
+            return _mm_cmpgt_epi32(x, v);
+        default:
+            return _mm_xor_si128(_mm_cmplt_epi32(x, v), ones);
+    }
+}
+
+// SSE2没有pminsd/pmaxsd，用比较和位运算选
+static inline __m128i min4(__m128i a, __m128i b) {
+    __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, a));
+}
+
+static inline __m128i max4(__m128i a, __m128i b) {
+    __m128i gt = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+
+ptrdiff_t findSse2(const int* p, size_t n, int value) {
+    __m128i v = _mm_set1_epi32(value);
+    size_t i = 0;
+    // 一次比较16个，有相等的再逐个找位置
+    for (; i + 16 <= n; i += 16) {
+        __m128i e0 = _mm_cmpeq_epi32(load4(p + i), v);
+        __m128i e1 = _mm_cmpeq_epi32(load4(p + i + 4), v);
+        __m128i e2 = _mm_cmpeq_epi32(load4(p + i + 8), v);
+        __m128i e3 = _mm_cmpeq_epi32(load4(p + i + 12), v);
+        __m128i e = _mm_or_si128(_mm_or_si128(e0, e1), _mm_or_si128(e2, e3));
+        if (_mm_movemask_epi8(e)) {
+            break;
+        }
+    }
+    ptrdiff_t j = findScalar(p + i, n - i, value);
+    return j < 0 ? -1 : (ptrdiff_t)i + j;
+}
+
+size_t countSse2(const int* p, size_t n, int value) {
+    __m128i v = _mm_set1_epi32(value);
+    size_t c = 0;
+    size_t i = 0;
+    while (i + 4 <= n) {
+        size_t end = n - i > COUNTBLOCK ? i + COUNTBLOCK : n;
+        // 相等时比较结果是-1，减去它就是加1
+        __m128i acc = _mm_setzero_si128();
+        for (; i + 4 <= end; i += 4) {
+            acc = _mm_sub_epi32(acc, _mm_cmpeq_epi32(load4(p + i), v));
+        }
+        unsigned lanes[4];
+        _mm_storeu_si128((__m128i*)lanes, acc);
+        c += (size_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+    return c + countScalar(p + i, n - i, value);
+}
+
+long long sumSse2(const int* p, size_t n) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc0 = zero, acc1 = zero;
+    size_t i = 0;
+    // 符号扩展成64位再加：高32位是比较出来的符号
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = load4(p + i);
+        __m128i sign = _mm_cmpgt_epi32(zero, x);
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(x, sign));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(x, sign));
+    }
+    long long lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, _mm_add_epi64(acc0, acc1));
+    return lanes[0] + lanes[1] + sumScalar(p + i, n - i);
+}
+
+int minSse2(const int* p, size_t n) {
+    if (n < 8) {
+        return minScalar(p, n);
+    }
+    __m128i m0 = load4(p), m1 = load4(p + 4);
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8) {
+        m0 = min4(m0, load4(p + i));
+        m1 = min4(m1, load4(p + i + 4));
+    }
+    int lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, min4(m0, m1));
+    int m = minScalar(lanes, 4);
+    if (i < n) {
+        int t = minScalar(p + i, n - i);
+        m = t < m ? t : m;
+    }
+    return m;
+}
+
+int maxSse2(const int* p, size_t n) {
+    if (n < 8) {
+        return maxScalar(p, n);
+    }
+    __m128i m0 = load4(p), m1 = load4(p + 4);
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8) {
+        m0 = max4(m0, load4(p + i));
+        m1 = max4(m1, load4(p + i + 4));
+    }
+    int lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, max4(m0, m1));
+    int m = maxScalar(lanes, 4);
+    if (i < n) {
+        int t = maxScalar(p + i, n - i);
+        m = t > m ? t : m;
+    }
+    return m;
+}
+
+// SSE2没有按掩码重排的指令（pshufb是SSSE3），比较用向量做，
+// 写出用不带分支的方式：每个元素都写，满足条件才往后移
+size_t filterSse2(const int* p, size_t n, Pred pred, int* out) {
+    __m128i v = _mm_set1_epi32(pred.value);
+    size_t k = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        int bits = _mm_movemask_ps(
+            _mm_castsi128_ps(predMask4(load4(p + i), v, pred.op)));
+        out[k] = p[i];
+        k += bits & 1;
+        out[k] = p[i + 1];
+        k += (bits >> 1) & 1;
+        out[k] = p[i + 2];
+        k += (bits >> 2) & 1;
+        out[k] = p[i + 3];
+        k += (bits >> 3) & 1;
+    }
+    return k + filterScalar(p + i, n - i, pred, out + k);
+}
+
+/*---------- AVX2 ----------*/
+
+AVX2 static inline __m256i load8(const int* p) {
+    return _mm256_loadu_si256((const __m256i*)p);
+}
+
+AVX2 static inline __m256i predMask8(__m256i x, __m256i v, PredOp op) {
+    __m256i ones = _mm256_set1_epi32(-1);
+    switch (op) {
+        case PRED_EQ:
+            return _mm256_cmpeq_epi32(x, v);
+        case PRED_NE:
+            return _mm256_xor_si256(_mm256_cmpeq_epi32(x, v), ones);
+        case PRED_LT:
+            return _mm256_cmpgt_epi32(v, x);
+        case PRED_LE:
+            return _mm256_xor_si256(_mm256_cmpgt_epi32(x, v), ones);
+        case PRED_GT:
+            return _mm256_cmpgt_epi32(x, v);
+        default:
+            return _mm256_xor_si256(_mm256_cmpgt_epi32(v, x), ones);
+    }
+}
+
+AVX2 ptrdiff_t findAvx2(const int* p, size_t n, int value) {
+    __m256i v = _mm256_set1_epi32(value);
+    size_t i = 0;
+    // 一次比较32个，有相等的用掩码算出第一个的位置
+    for (; i + 32 <= n; i += 32) {
+        __m256i e0 = _mm256_cmpeq_epi32(load8(p + i), v);
+        __m256i e1 = _mm256_cmpeq_epi32(load8(p + i + 8), v);
+        __m256i e2 = _mm256_cmpeq_epi32(load8(p + i + 16), v);
+        __m256i e3 = _mm256_cmpeq_epi32(load8(p + i + 24), v);
+        __m256i e = _mm256_or_si256(_mm256_or_si256(e0, e1),
+                                    _mm256_or_si256(e2, e3));
+        if (!_mm256_testz_si256(e, e)) {
+            uint64_t lo = (uint32_t)_mm256_movemask_epi8(e0) |
+                          (uint64_t)(uint32_t)_mm256_movemask_epi8(e1) << 32;
+            uint64_t hi = (uint32_t)_mm256_movemask_epi8(e2) |
+                          (uint64_t)(uint32_t)_mm256_movemask_epi8(e3) << 32;
+            // movemask_epi8每个int占4位
+            return (ptrdiff_t)i + (lo ? __builtin_ctzll(lo) / 4
+                                      : 16 + __builtin_ctzll(hi) / 4);
+        }
+    }
+    ptrdiff_t j = findScalar(p + i, n - i, value);
+    return j < 0 ? -1 : (ptrdiff_t)i + j;
+}
+
+AVX2 size_t countAvx2(const int* p, size_t n, int value) {
+    __m256i v = _mm256_set1_epi32(value);
+    size_t c = 0;
+    size_t i = 0;
+    while (i + 16 <= n) {
+        size_t end = n - i > COUNTBLOCK ? i + COUNTBLOCK : n;
+        __m256i acc0 = _mm256_setzero_si256();
+        __m256i acc1 = _mm256_setzero_si256();
+        for (; i + 16 <= end; i += 16) {
+            acc0 = _mm256_sub_epi32(acc0,
+                                    _mm256_cmpeq_epi32(load8(p + i), v));
+            acc1 = _mm256_sub_epi32(acc1,
+                                    _mm256_cmpeq_epi32(load8(p + i + 8), v));
+        }
+        unsigned lanes[8];
+        _mm256_storeu_si256((__m256i*)lanes, _mm256_add_epi32(acc0, acc1));
+        for (int j = 0; j < 8; j++) {
+            c += lanes[j];
+        }
+    }
+    return c + countScalar(p + i, n - i, value);
+}
+
+AVX2 long long sumAvx2(const int* p, size_t n) {
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    size_t i = 0;
+    // 每次8个，两半各自符号扩展成4个64位再加
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = load8(p + i);
+        acc0 = _mm256_add_epi64(
+            acc0, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(x)));
+        acc1 = _mm256_add_epi64(
+            acc1, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(x, 1)));
+    }
+    long long lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, _mm256_add_epi64(acc0, acc1));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+           sumScalar(p + i, n - i);
+}
+
+AVX2 int minAvx2(const int* p, size_t n) {
+    if (n < 16) {
+        return minScalar(p, n);
+    }
+    __m256i m0 = load8(p), m1 = load8(p + 8);
+    size_t i = 16;
+    for (; i + 16 <= n; i += 16) {
+        m0 = _mm256_min_epi32(m0, load8(p + i));
+        m1 = _mm256_min_epi32(m1, load8(p + i + 8));
+    }
+    int lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, _mm256_min_epi32(m0, m1));
+    int m = minScalar(lanes, 8);
+    if (i < n) {
+        int t = minScalar(p + i, n - i);
+        m = t < m ? t : m;
+    }
+    return m;
+}
+
+AVX2 int maxAvx2(const int* p, size_t n) {
+    if (n < 16) {
+        return maxScalar(p, n);
+    }
+    __m256i m0 = load8(p), m1 = load8(p + 8);
+    size_t i = 16;
+    for (; i + 16 <= n; i += 16) {
+        m0 = _mm256_max_epi32(m0, load8(p + i));
+        m1 = _mm256_max_epi32(m1, load8(p + i + 8));
+    }
+    int lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, _mm256_max_epi32(m0, m1));
+    int m = maxScalar(lanes, 8);
+    if (i < n) {
+        int t = maxScalar(p + i, n - i);
+        m = t > m ? t : m;
+    }
+    return m;
+}
+
+// 8位掩码对应的重排下标：满足条件的元素挪到前面
+uint32_t compactIdx[256][8];
+
+void initCompactIdx(void) {
+    for (int m = 0; m < 256; m++) {
+        int k = 0;
+        for (int j = 0; j < 8; j++) {
+            if (m & (1 << j)) {
+                compactIdx[m][k++] = (uint32_t)j;
+            }
+        }
+        while (k < 8) {
+            compactIdx[m][k++] = 0;
+        }
+    }
+}
+
+// 流压缩：比较得到8位掩码，查表得到重排下标，vpermd把满足条件的
+// 元素挪到前面，整个向量写出去，再按掩码里1的个数往后移
+AVX2 size_t filterAvx2(const int* p, size_t n, Pred pred, int* out) {
+    __m256i v = _mm256_set1_epi32(pred.value);
+    size_t k = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = load8(p + i);
+        int bits = _mm256_movemask_ps(
+            _mm256_castsi256_ps(predMask8(x, v, pred.op)));
+        __m256i idx = load8((const int*)compactIdx[bits]);
+        _mm256_storeu_si256((__m256i*)(out + k),
+                            _mm256_permutevar8x32_epi32(x, idx));
+        k += (size_t)__builtin_popcount((unsigned)bits);
+    }
+    return k + filterScalar(p + i, n - i, pred, out + k);
+}
+#endif
+
+Kernels kernelTable[SIMD_LEVELS] = {
+    {"scalar", findScalar, countScalar, sumScalar, minScalar, maxScalar,
+     filterScalar},
+#if defined(__x86_64__) || defined(__i386__)
+    {"sse2", findSse2, countSse2, sumSse2, minSse2, maxSse2, filterSse2},
+    {"avx2", findAvx2, countAvx2, sumAvx2, minAvx2, maxAvx2, filterAvx2},
+#endif
+};
+
+// CPU支持的最高级别
+int simdSupported(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SIMD_SSE2;
+    }
+#endif
+    return SIMD_SCALAR;
+}
+
+// 当前使用的版本，第一次调用时选择
+const Kernels* kernels(void) {
+    static int supported = -1;
+    if (supported < 0) {
+        supported = simdSupported();
+#if defined(__x86_64__) || defined(__i386__)
+        initCompactIdx();
+#endif
+    }
+    if (simdLevel < 0 || simdLevel > supported) {
+        return &kernelTable[supported];
+    }
+    return &kernelTable[simdLevel];
+}
+
+// 数组的两段连续元素，普通模式下第二段是空的
+void segments(ArrayPtr ptr, const int** p, size_t* n) {
+    size_t head = ptr->gapbuf ? ptr->cursor : ptr->len;
+    p[0] = ptr->arr;
+    n[0] = head;
+    p[1] = ptr->arr + head + (ptr->cap - ptr->len);
+    n[1] = ptr->len - head;
+}
+
+// 第一个等于value的元素下标，没有返回-1
+ptrdiff_t find(ArrayPtr ptr, int value) {
+    checkPtr(ptr);
+    const Kernels* k = kernels();
+    const int* p[2];
+    size_t n[2];
+    segments(ptr, p, n);
+    ptrdiff_t i = k->find(p[0], n[0], value);
+    if (i >= 0 || n[1] == 0) {
+        return i;
+    }
+    i = k->find(p[1], n[1], value);
+    return i < 0 ? -1 : (ptrdiff_t)n[0] + i;
+}
+
+// 等于value的元素个数
+size_t count(ArrayPtr ptr, int value) {
+    checkPtr(ptr);
+    const Kernels* k = kernels();
+    const int* p[2];
+    size_t n[2];
+    segments(ptr, p, n);
+    return k->count(p[0], n[0], value) + k->count(p[1], n[1], value);
+}
+
+// 所有元素的和，用64位累加
+long long sum(ArrayPtr ptr) {
+    checkPtr(ptr);
+    const Kernels* k = kernels();
+    const int* p[2];
+    size_t n[2];
+    segments(ptr, p, n);
+    return k->sum(p[0], n[0]) + k->sum(p[1], n[1]);
+}
+
+// 最小值，空数组报错
+int min(ArrayPtr ptr) {
+    checkPtr(ptr);
+    if (ptr->len == 0) {
+        exitErr("empty array");
+    }
+    const Kernels* k = kernels();
+    const int* p[2];
+    size_t n[2];
+    segments(ptr, p, n);
+    if (n[0] == 0 || n[1] == 0) {
+        return n[0] ? k->min(p[0], n[0]) : k->min(p[1], n[1]);
+    }
+    int a = k->min(p[0], n[0]), b = k->min(p[1], n[1]);
+    return a < b ? a : b;
+}
+
+// 最大值，空数组报错
+int max(ArrayPtr ptr) {
+    checkPtr(ptr);
+    if (ptr->len == 0) {
+        exitErr("empty array");
+    }
+    const Kernels* k = kernels();
+    const int* p[2];
+    size_t n[2];
+    segments(ptr, p, n);
+    if (n[0] == 0 || n[1] == 0) {
+        return n[0] ? k->max(p[0], n[0]) : k->max(p[1], n[1]);
+    }
+    int a = k->max(p[0], n[0]), b = k->max(p[1], n[1]);
+    return a > b ? a : b;
+}
+
+// 把src里满足条件的元素按顺序追加到dst末尾，返回追加的个数
+// dst最多扩容一次；dst是间隙模式的话先把间隙挪到末尾
+size_t filterInto(ArrayPtr src, ArrayPtr dst, Pred pred) {
+    checkPtr(src);
+    checkPtr(dst);
+    if (src == dst) {
+        exitErr("filter into itself");
+    }
+    dst->sorted = 0;
+    if (dst->gapbuf) {
+        moveGap(dst, dst->len);
+    }
+    growArray(dst, dst->len + src->len + FILTERSLACK);
+    const Kernels* k = kernels();
+    const int* p[2];
+    size_t n[2];
+    segments(src, p, n);
+    size_t added = k->filter(p[0], n[0], pred, dst->arr + dst->len);
+    added += k->filter(p[1], n[1], pred, dst->arr + dst->len + added);
+    dst->len += added;
+    dst->last = (ptrdiff_t)dst->len - 1;
+    if (dst->gapbuf) {
+        dst->cursor = dst->len;
+    }
+    return added;
+}
+
+// 多线程LSD基数排序
+// 每轮按一个字节（8位）分桶，从低字节到高字节一共4轮，最高字节的符号位
+// 取反，负数就排在前面了。每一轮：
+//     1. 每个线程统计自己那一段里每个桶的个数
+//     2. 算出每个线程每个桶的写入位置：桶按顺序排，同一个桶里线程按顺序排
+//     3. 每个线程把自己那一段按顺序写到目标数组，所以排序是稳定的
+// 所有元素这一字节都一样的话这一轮直接跳过。目标数组和原数组轮流交换
+#define RADIXBITS 8
+#define RADIXBUCKETS (1 << RADIXBITS)
+#define RADIXPASSES (32 / RADIXBITS)
+#define RADIXMINCHUNK (1UL << 16)  // 每个线程至少分到这么多个元素
+
+typedef struct radixCtx {
+    int* a;                   // 要排序的数组
+    int* aux;                 // 同样大小的辅助数组
+    size_t n;
+    int nthreads;
+    size_t (*counts)[RADIXBUCKETS];  // 每个线程每个桶的个数，之后变成写入位置
+    int skip;                 // 这一轮所有元素在同一个桶里，不用移动
+    pthread_barrier_t barrier;
+} RadixCtx;
+
+typedef struct radixWorker {
+    RadixCtx* ctx;
+    int id;
+} RadixWorker;
+
+static inline unsigned radixDigit(int x, int pass) {
+    return (((uint32_t)x ^ 0x80000000U) >> (pass * RADIXBITS)) &
+           (RADIXBUCKETS - 1);
+}
+
+void* radixWork(void* arg) {
+    RadixWorker* w = arg;
+    RadixCtx* ctx = w->ctx;
+    size_t lo = ctx->n * w->id / ctx->nthreads;
+    size_t hi = ctx->n * (w->id + 1) / ctx->nthreads;
+    int* src = ctx->a;
+    int* dst = ctx->aux;
+    for (int pass = 0; pass < RADIXPASSES; pass++) {
+        size_t* cnt = ctx->counts[w->id];
+        memset(cnt, 0, sizeof(size_t) * RADIXBUCKETS);
+        for (size_t i = lo; i < hi; i++) {
+            ++cnt[radixDigit(src[i], pass)];
+        }
+        pthread_barrier_wait(&ctx->barrier);
+        if (w->id == 0) {
+            // 按桶优先、线程其次的顺序做前缀和
+            size_t off = 0;
+            ctx->skip = 0;
+            for (int d = 0; d < RADIXBUCKETS; d++) {
+                size_t total = 0;
+                for (int t = 0; t < ctx->nthreads; t++) {
+                    size_t c = ctx->counts[t][d];
+                    ctx->counts[t][d] = off;
+                    off += c;
+                    total += c;
+                }
+                if (total == ctx->n) {
+                    ctx->skip = 1;
+                }
+            }
+        }
+        pthread_barrier_wait(&ctx->barrier);
+        if (ctx->skip) {
+            // 等所有线程都读到skip，下一轮才能改它
+            pthread_barrier_wait(&ctx->barrier);
+            continue;
+        }
+        for (size_t i = lo; i < hi; i++) {
+            int x = src[i];
+            dst[cnt[radixDigit(x, pass)]++] = x;
+        }
+        pthread_barrier_wait(&ctx->barrier);
+        int* t = src;
+        src = dst;
+        dst = t;
+    }
+    // 交换了奇数次的话结果在辅助数组里，各自把自己那一段拷回去
+    if (src != ctx->a) {
+        memcpy(ctx->a + lo, src + lo, sizeof(int) * (hi - lo));
+    }
+    return NULL;
+}
+
+// 在线程数小于等于0的时候用所有CPU，元素少的时候减少线程
+void radixSortInts(int* a, size_t n, int threads) {
+    if (n < 2) {
+        return;
+    }
+    if (threads <= 0) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if ((size_t)threads > n / RADIXMINCHUNK) {
+        threads = n / RADIXMINCHUNK > 0 ? (int)(n / RADIXMINCHUNK) : 1;
+    }
+    RadixCtx ctx;
+    ctx.a = a;
+    ctx.aux = malloc(sizeof(int) * n);
+    ctx.counts = malloc(sizeof(*ctx.counts) * threads);
+    RadixWorker* workers = malloc(sizeof(RadixWorker) * threads);
+    pthread_t* tids = malloc(sizeof(pthread_t) * threads);
+    isOutOfMemmory(ctx.aux);
+    isOutOfMemmory(ctx.counts);
+    isOutOfMemmory(workers);
+    isOutOfMemmory(tids);
+    ctx.n = n;
+    ctx.nthreads = threads;
+    ctx.skip = 0;
+    pthread_barrier_init(&ctx.barrier, NULL, (unsigned)threads);
+    // 调用的线程自己做0号
+    for (int t = 0; t < threads; t++) {
+        workers[t].ctx = &ctx;
+        workers[t].id = t;
+        if (t > 0 && pthread_create(&tids[t], NULL, radixWork, &workers[t])) {
+            exitErr("pthread_create failed");
+        }
+    }
+    radixWork(&workers[0]);
+    for (int t = 1; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    pthread_barrier_destroy(&ctx.barrier);
+    free(ctx.aux);
+    free(ctx.counts);
+    free(workers);
+    free(tids);
+}
+
+// 排序，之后数组处于有序模式，可以二分查找和批量有序插入
+// 按位置插入、修改会破坏顺序，所以会退出有序模式；删除不影响顺序
+void sortArray(ArrayPtr ptr, int threads) {
+    checkPtr(ptr);
+    if (ptr->gapbuf) {
+        moveGap(ptr, ptr->len);
+    }
+    radixSortInts(ptr->arr, ptr->len, threads);
+    ptr->sorted = 1;
+}
+
+// 有序模式下取连续的元素，间隙模式下先把间隙挪到末尾
+const int* sortedData(ArrayPtr ptr) {
+    checkPtr(ptr);
+    if (!ptr->sorted) {
+        exitErr("array is not sorted");
+    }
+    if (ptr->gapbuf) {
+        moveGap(ptr, ptr->len);
+    }
+    return ptr->arr;
+}
+
+// 第一个不小于value的元素下标，都小于value时返回len
+// 不带分支的二分：每一步只决定base要不要前进half，编译成cmov，
+// 不会因为比较结果随机而分支预测失败；同时预取下一步可能访问的两个位置
+size_t lowerBound(ArrayPtr ptr, int value) {
+    const int* base = sortedData(ptr);
+    size_t n = ptr->len;
+    if (n == 0) {
+        return 0;
+    }
+    while (n > 1) {
+        size_t half = n / 2;
+        __builtin_prefetch(base + half / 2);
+        __builtin_prefetch(base + half + half / 2);
+        base += base[half] < value ? half : 0;
+        n -= half;
+    }
+    return (size_t)(base - ptr->arr) + (*base < value);
+}
+
+// 第一个大于value的元素下标，都不大于value时返回len
+size_t upperBound(ArrayPtr ptr, int value) {
+    const int* base = sortedData(ptr);
+    size_t n = ptr->len;
+    if (n == 0) {
+        return 0;
+    }
+    while (n > 1) {
+        size_t half = n / 2;
+        __builtin_prefetch(base + half / 2);
+        __builtin_prefetch(base + half + half / 2);
+        base += base[half] <= value ? half : 0;
+        n -= half;
+    }
+    return (size_t)(base - ptr->arr) + (*base <= value);
+}
+
+// 二分查找，返回第一个等于value的下标，没有返回-1
+ptrdiff_t binarySearch(ArrayPtr ptr, int value) {
+    size_t i = lowerBound(ptr, value);
+    return i < ptr->len && ptr->arr[i] == value ? (ptrdiff_t)i : -1;
+}
+
+// 有序模式下批量插入：先把这一批排好序，再从后往前和原数组归并，
+// 每个元素只移动一次。逐个插入的话每次都要移动后面所有的元素
+void insertSorted(ArrayPtr ptr, const int* src, size_t n) {
+    sortedData(ptr);
+    if (n == 0) {
+        return;
+    }
+    if (n > SIZE_MAX / sizeof(int) - ptr->len) {
+        exitErr("array is too large");
+    }
+    int* batch = malloc(sizeof(int) * n);
+    isOutOfMemmory(batch);
+    memcpy(batch, src, sizeof(int) * n);
+    radixSortInts(batch, n, 1);
+    growArray(ptr, ptr->len + n);
+    // 从后往前归并，新增的空间在末尾，不会覆盖还没归并的元素
+    ptrdiff_t i = (ptrdiff_t)ptr->len - 1;
+    ptrdiff_t j = (ptrdiff_t)n - 1;
+    ptrdiff_t k = (ptrdiff_t)(ptr->len + n) - 1;
+    while (j >= 0) {
+        if (i >= 0 && ptr->arr[i] > batch[j]) {
+            ptr->arr[k--] = ptr->arr[i--];
+        } else {
+            ptr->arr[k--] = batch[j--];
+        }
+    }
+    ptr->len += n;
+    ptr->last = (ptrdiff_t)ptr->len - 1;
+    if (ptr->gapbuf) {
+        ptr->cursor = ptr->len;
+    }
+    free(batch);
 }
 
 // 输出数组
@@ -118,33 +1204,510 @@ void printInfo(ArrayPtr ptr) {
     checkPtr(ptr);
     // printf("cap: %d\nlen: %d\nlast: %d\n", ptr->cap, ptr->len, ptr->last);
     // return;
-    for (int i = 0; i <= ptr->last; i++) {
-        printf("%d ", ptr->arr[i]);
+    for (ptrdiff_t i = 0; i <= ptr->last; i++) {
+        printf("%d ", get(ptr, i));
     }
     printf("\n");
 }
 
 // 创建
-ArrayPtr createArray(int length) {
+// len之后的元素不会被读到，不需要清零
+ArrayPtr createArray(size_t length) {
     // 创建指向结构体的指针
     ArrayPtr ptr = malloc(sizeof(Array));
     isOutOfMemmory(ptr);
-    // 创建指定长度的数组
-    ptr->arr = malloc(length * sizeof(int));
-    isOutOfMemmory(ptr);
     // 初始化结构体属性
-    memset(ptr->arr, 0, sizeof(int) * length);
-    ptr->cap = length;
+    ptr->arr = NULL;
+    ptr->cap = 0;
     ptr->len = 0;
     // last表示最后一个元素的索引
     // 因为所以从0开始，所以last初始化未-1
     ptr->last = -1;
+    ptr->growfactor = GROWFACTOR;
+    ptr->mapped = 0;
+    ptr->copygrow = 0;
+    ptr->gapbuf = 0;
+    ptr->cursor = 0;
+    ptr->sorted = 0;
+    // 创建指定长度的数组
+    resizeArray(ptr, length);
 
     return ptr;
 }
 
+// 释放数组
+void destroyArray(ArrayPtr ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    if (ptr->mapped) {
+        munmap(ptr->arr, mapBytes(ptr->cap));
+    } else {
+        free(ptr->arr);
+    }
+    free(ptr);
+}
+
+double nowSec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 进程到目前为止的常驻内存峰值（字节）
+size_t peakRss(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (size_t)ru.ru_maxrss * 1024;
+}
+
+// 追加n个int，对比以前的扩容方式和realloc/mremap，以及1.5倍扩容和预先reserve
+// 每种方式在单独的子进程里跑，峰值内存互不影响，内存不够被杀掉的也能看到
+void benchAppend(size_t n) {
+    const char* names[] = {"copy", "realloc", "factor1.5", "reserve"};
+    printf("appends: %zu (%.1f GB)\n", n, n * sizeof(int) / 1073741824.0);
+    printf("%-10s %10s %12s %10s\n", "mode", "seconds", "peak MB",
+           "checksum");
+    for (int mode = 0; mode < 4; mode++) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            exitErr("fork failed");
+        }
+        if (pid == 0) {
+            double t0 = nowSec();
+            ArrayPtr ptr = createArray(16);
+            ptr->copygrow = mode == 0;
+            if (mode == 2) {
+                setGrowFactor(ptr, 1.5);
+            } else if (mode == 3) {
+                reserve(ptr, n);
+            }
+            for (size_t i = 0; i < n; i++) {
+                insert(ptr, ptr->len + 1, (int)i);
+            }
+            double t1 = nowSec();
+            // 抽样读一遍，确认数据没有在扩容中丢失
+            long long sum = 0;
+            for (size_t i = 0; i < n; i += 4096) {
+                sum += ptr->arr[i] - (int)i;
+            }
+            printf("%-10s %10.3f %12.1f %10lld\n", names[mode], t1 - t0,
+                   peakRss() / 1048576.0, sum);
+            destroyArray(ptr);
+            exit(EXIT_SUCCESS);
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            printf("%-10s %10s\n", names[mode], "failed");
+        }
+    }
+}
+
+// 区间操作和逐个操作的对比，两种做法的结果必须一样
+// 头部插入、头部删除逐个做是O(n^2)次移动，区间做是O(n)
+void benchRange(size_t n) {
+    int* src = malloc(sizeof(int) * n);
+    isOutOfMemmory(src);
+    for (size_t i = 0; i < n; i++) {
+        src[i] = (int)i;
+    }
+    trace = 0;
+    printf("elements: %zu\n", n);
+    printf("%-14s %12s %12s %8s\n", "op", "single(s)", "range(s)",
+           "speedup");
+
+    // 在头部插入n个元素，已经有n个元素
+    ArrayPtr a = createArray(16);
+    ArrayPtr b = createArray(16);
+    append(a, src, n);
+    append(b, src, n);
+    double t0 = nowSec();
+    for (size_t i = n; i > 0; i--) {
+        insert(a, 1, src[i - 1]);
+    }
+    double t1 = nowSec();
+    insertRange(b, 1, src, n);
+    double t2 = nowSec();
+    if (a->len != b->len || memcmp(a->arr, b->arr, sizeof(int) * a->len)) {
+        exitErr("insertRange mismatch");
+    }
+    printf("%-14s %12.4f %12.4f %7.0fx\n", "insert front", t1 - t0, t2 - t1,
+           (t1 - t0) / (t2 - t1));
+
+    // 从头部删除n个元素
+    t0 = nowSec();
+    for (size_t i = 0; i < n; i++) {
+        erase(a, 0);
+    }
+    t1 = nowSec();
+    eraseRange(b, 0, n);
+    t2 = nowSec();
+    if (a->len != b->len || memcmp(a->arr, b->arr, sizeof(int) * a->len)) {
+        exitErr("eraseRange mismatch");
+    }
+    printf("%-14s %12.4f %12.4f %7.0fx\n", "erase front", t1 - t0, t2 - t1,
+           (t1 - t0) / (t2 - t1));
+
+    // 在末尾追加n个元素，逐个追加不需要移动，差别只在扩容次数
+    t0 = nowSec();
+    for (size_t i = 0; i < n; i++) {
+        insert(a, a->len + 1, src[i]);
+    }
+    t1 = nowSec();
+    append(b, src, n);
+    t2 = nowSec();
+    if (a->len != b->len || memcmp(a->arr, b->arr, sizeof(int) * a->len)) {
+        exitErr("append mismatch");
+    }
+    printf("%-14s %12.4f %12.4f %7.0fx\n", "append", t1 - t0, t2 - t1,
+           (t1 - t0) / (t2 - t1));
+
+    destroyArray(a);
+    destroyArray(b);
+    free(src);
+    trace = 1;
+}
+
+// 编辑轨迹：光标大多数时候在附近小步移动，偶尔跳到别处，
+// 在光标处插入或者删除光标前面的元素
+// 普通数组和间隙模式按同一条轨迹编辑，最后结果必须一样
+void benchGap(size_t n, size_t ops) {
+    if (n == 0) {
+        n = 1;
+    }
+    size_t* at = malloc(sizeof(size_t) * ops);
+    int* isInsert = malloc(sizeof(int) * ops);
+    isOutOfMemmory(at);
+    isOutOfMemmory(isInsert);
+    srand(1);
+    size_t len = n, cursor = n / 2;
+    for (size_t k = 0; k < ops; k++) {
+        if (rand() % 64 == 0) {
+            cursor = (size_t)rand() % (len + 1);
+        } else {
+            ptrdiff_t c = (ptrdiff_t)cursor + rand() % 17 - 8;
+            cursor = c < 0 ? 0 : (size_t)c > len ? len : (size_t)c;
+        }
+        isInsert[k] = cursor == 0 || rand() % 10 < 6;
+        if (isInsert[k]) {
+            at[k] = cursor++;
+            ++len;
+        } else {
+            at[k] = --cursor;
+            --len;
+        }
+    }
+
+    trace = 0;
+    printf("elements: %zu, edits: %zu\n", n, ops);
+    printf("%-8s %12s %12s %14s\n", "mode", "edits(s)", "reads(s)",
+           "checksum");
+    ArrayPtr arrs[2];
+    for (int mode = 0; mode < 2; mode++) {
+        ArrayPtr ptr = createArray(n);
+        for (size_t i = 0; i < n; i++) {
+            insert(ptr, (ptrdiff_t)i + 1, (int)i);
+        }
+        setGapMode(ptr, mode);
+        double t0 = nowSec();
+        for (size_t k = 0; k < ops; k++) {
+            if (isInsert[k]) {
+                insert(ptr, (ptrdiff_t)at[k] + 1, -(int)k);
+            } else {
+                erase(ptr, (ptrdiff_t)at[k]);
+            }
+        }
+        double t1 = nowSec();
+        // 随机读，确认间隙模式的下标访问还是O(1)
+        long long sum = 0;
+        size_t x = 1;
+        for (size_t k = 0; k < ops; k++) {
+            x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+            sum += get(ptr, (ptrdiff_t)((x >> 33) % ptr->len));
+        }
+        double t2 = nowSec();
+        printf("%-8s %12.4f %12.4f %14lld\n", mode ? "gap" : "plain", t1 - t0,
+               t2 - t1, sum);
+        arrs[mode] = ptr;
+    }
+    if (arrs[0]->len != arrs[1]->len) {
+        exitErr("gap buffer mismatch");
+    }
+    for (size_t i = 0; i < arrs[0]->len; i++) {
+        if (get(arrs[0], (ptrdiff_t)i) != get(arrs[1], (ptrdiff_t)i)) {
+            exitErr("gap buffer mismatch");
+        }
+    }
+    destroyArray(arrs[0]);
+    destroyArray(arrs[1]);
+    free(at);
+    free(isInsert);
+    trace = 1;
+}
+
+// 32位随机数，测试用
+uint32_t benchRand(uint64_t* x) {
+    *x = *x * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(*x >> 32);
+}
+
+// 各个版本和普通循环的结果对比，不一致就退出
+// 长度从0到100覆盖所有尾部情况，值的范围小一些，保证有相等的元素
+void checkSimd(void) {
+    const int extremes[] = {INT_MIN, INT_MAX, 0, -1, 1};
+    int supported = simdSupported();
+    uint64_t x = 42;
+    int buf[100], ref[100 + FILTERSLACK], out[100 + FILTERSLACK];
+    kernels();
+    for (int round = 0; round < 200; round++) {
+        for (size_t n = 0; n <= 100; n++) {
+            for (size_t i = 0; i < n; i++) {
+                buf[i] = round % 2 ? (int)(benchRand(&x) % 16) - 8
+                                   : (int)benchRand(&x);
+                if (benchRand(&x) % 8 == 0) {
+                    buf[i] = extremes[benchRand(&x) % 5];
+                }
+            }
+            int value = n ? buf[benchRand(&x) % n] : 0;
+            if (benchRand(&x) % 4 == 0) {
+                value = (int)benchRand(&x);
+            }
+            Pred pred = {(PredOp)(benchRand(&x) % 6), value};
+            const Kernels* s = &kernelTable[SIMD_SCALAR];
+            size_t nref = s->filter(buf, n, pred, ref);
+            for (int level = SIMD_SSE2; level <= supported; level++) {
+                const Kernels* k = &kernelTable[level];
+                if (k->find(buf, n, value) != s->find(buf, n, value) ||
+                    k->count(buf, n, value) != s->count(buf, n, value) ||
+                    k->sum(buf, n) != s->sum(buf, n) ||
+                    (n && k->min(buf, n) != s->min(buf, n)) ||
+                    (n && k->max(buf, n) != s->max(buf, n)) ||
+                    k->filter(buf, n, pred, out) != nref ||
+                    memcmp(out, ref, sizeof(int) * nref) != 0) {
+                    fprintf(stderr, "%s mismatch, n=%zu\n", k->name, n);
+                    exitErr("simd check failed");
+                }
+            }
+        }
+    }
+    printf("simd check passed (up to %s)\n", kernelTable[supported].name);
+}
+
+// 在n个元素上对比三个版本，n默认比L2大很多
+void benchSimd(size_t n) {
+    checkSimd();
+    ArrayPtr ptr = createArray(n);
+    ArrayPtr dst = createArray(n + FILTERSLACK);
+    uint64_t x = 1;
+    for (size_t i = 0; i < n; i++) {
+        insert(ptr, (ptrdiff_t)i + 1, (int)benchRand(&x));
+    }
+    int supported = simdSupported();
+    int reps = 10;
+    const char* ops[] = {"find", "count", "sum", "min", "max", "filter"};
+    printf("elements: %zu (%.0f MB)\n", n, n * sizeof(int) / 1048576.0);
+    printf("%-8s", "op");
+    for (int level = 0; level <= supported; level++) {
+        printf(" %12s", kernelTable[level].name);
+    }
+    printf(" %10s\n", "speedup");
+    for (int op = 0; op < 6; op++) {
+        double base = 0, t = 0;
+        long long result = 0;
+        printf("%-8s", ops[op]);
+        for (int level = 0; level <= supported; level++) {
+            simdLevel = level;
+            long long r = 0;
+            double t0 = nowSec();
+            for (int rep = 0; rep < reps; rep++) {
+                switch (op) {
+                    case 0:  // 不存在的值，要扫描整个数组
+                        r += find(ptr, INT_MIN + 1);
+                        break;
+                    case 1:
+                        r += (long long)count(ptr, ptr->arr[n / 2]);
+                        break;
+                    case 2:
+                        r += sum(ptr);
+                        break;
+                    case 3:
+                        r += min(ptr);
+                        break;
+                    case 4:
+                        r += max(ptr);
+                        break;
+                    default:  // 一半的元素满足条件，分支最难预测
+                        dst->len = 0;
+                        dst->last = -1;
+                        r += (long long)filterInto(ptr, dst,
+                                                   (Pred){PRED_GT, 0});
+                        break;
+                }
+            }
+            t = (nowSec() - t0) / reps;
+            if (level == 0) {
+                base = t;
+                result = r;
+            } else if (r != result) {
+                exitErr("simd result mismatch");
+            }
+            printf(" %10.2fms", t * 1000);
+        }
+        printf(" %9.1fx\n", base / t);
+    }
+    simdLevel = -1;
+    destroyArray(ptr);
+    destroyArray(dst);
+}
+
+int cmpInt(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// 普通的带分支的二分，和lowerBound对比
+size_t lowerBoundBranchy(const int* a, size_t n, int value) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (a[mid] < value) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// n个随机数：qsort和1、2、4...maxThreads个线程的基数排序对比，结果必须一样
+// 然后在有序数组上对比二分查找，以及批量有序插入和逐个插入
+void benchSort(size_t n, int maxThreads) {
+    int* data = malloc(sizeof(int) * n);
+    int* ref = malloc(sizeof(int) * n);
+    isOutOfMemmory(data);
+    isOutOfMemmory(ref);
+    uint64_t x = 3;
+    for (size_t i = 0; i < n; i++) {
+        data[i] = (int)benchRand(&x);
+    }
+    printf("elements: %zu, cpus: %ld\n", n, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-10s %10s %10s\n", "sort", "seconds", "speedup");
+    memcpy(ref, data, sizeof(int) * n);
+    double t0 = nowSec();
+    qsort(ref, n, sizeof(int), cmpInt);
+    double base = nowSec() - t0;
+    printf("%-10s %10.3f %9.1fx\n", "qsort", base, 1.0);
+
+    ArrayPtr ptr = createArray(n);
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        ptr->len = 0;
+        append(ptr, data, n);
+        t0 = nowSec();
+        sortArray(ptr, threads);
+        double t = nowSec() - t0;
+        if (memcmp(ptr->arr, ref, sizeof(int) * n) != 0) {
+            exitErr("radix sort mismatch");
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "radix x%d", threads);
+        printf("%-10s %10.3f %9.1fx\n", name, t, base / t);
+    }
+
+    // 随机查找10^6次
+    size_t queries = 1000000;
+    size_t hits = 0, hitsBranchy = 0;
+    t0 = nowSec();
+    for (size_t q = 0; q < queries; q++) {
+        hits += lowerBound(ptr, (int)benchRand(&x));
+    }
+    double t1 = nowSec();
+    for (size_t q = 0; q < queries; q++) {
+        hitsBranchy += lowerBoundBranchy(ptr->arr, ptr->len,
+                                         (int)benchRand(&x));
+    }
+    double t2 = nowSec();
+    printf("%-10s %10s %10s\n", "search", "ns/query", "");
+    printf("%-10s %10.1f\n%-10s %10.1f\n", "branchless",
+           (t1 - t0) * 1e9 / queries, "branchy", (t2 - t1) * 1e9 / queries);
+    if (hits == 0 || hitsBranchy == 0) {
+        exitErr("lower bound failed");
+    }
+
+    // 有序插入：在10^6个元素上插入10^4个，批量归并和逐个按位置插入对比
+    size_t m = n < 1000000 ? n : 1000000;
+    size_t batch = m / 100 > 0 ? m / 100 : 1;
+    // 插入的值和数组里的值分布一样，插入位置分散在整个数组
+    int* ins = malloc(sizeof(int) * batch);
+    isOutOfMemmory(ins);
+    for (size_t i = 0; i < batch; i++) {
+        ins[i] = (int)benchRand(&x);
+    }
+    ArrayPtr a = createArray(m);
+    ArrayPtr b = createArray(m);
+    append(a, data, m);
+    append(b, data, m);
+    sortArray(a, 1);
+    sortArray(b, 1);
+    t0 = nowSec();
+    insertSorted(a, ins, batch);
+    t1 = nowSec();
+    for (size_t i = 0; i < batch; i++) {
+        size_t at = lowerBound(b, ins[i]);
+        insert(b, (ptrdiff_t)at + 1, ins[i]);
+        b->sorted = 1;  // 插在lowerBound的位置，顺序没有被破坏
+    }
+    t2 = nowSec();
+    if (a->len != b->len || memcmp(a->arr, b->arr, sizeof(int) * a->len)) {
+        exitErr("insertSorted mismatch");
+    }
+    printf("insert %zu into %zu: merge %.4fs, one by one %.4fs\n", batch, m,
+           t1 - t0, t2 - t1);
+
+    destroyArray(a);
+    destroyArray(b);
+    destroyArray(ptr);
+    free(ins);
+    free(data);
+    free(ref);
+}
+
 // 不能获取数组元素的地址，如果发生扩容，原来的元素地址就失效了
-int main(void) {
+// 用法：不带参数运行演示
+//      `bench [n]` 追加n个int，对比几种扩容方式的时间和峰值内存，默认10^9个
+//      `range [n]` 对比n个元素的区间插入、删除和逐个插入、删除，默认10^5个
+//      `simd [n]` 交叉检查向量化的查找、计数、求和、最值、过滤，
+//                 再在n个元素上和普通循环对比，默认2^22个（16MB，比L2大）
+//      `sort [n] [threads]` n个随机数上对比qsort和1、2、4...threads个线程的
+//                           基数排序，再测试二分查找和有序插入，
+//                           默认10^8个、8个线程
+//      `gap [n] [ops]` n个元素上按光标附近的编辑轨迹做ops次插入、删除，
+//                      对比普通数组和间隙模式，默认各10^5
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        benchAppend(argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000000);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "simd") == 0) {
+        benchSimd(argc > 2 ? strtoull(argv[2], NULL, 10) : 1UL << 22);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "sort") == 0) {
+        benchSort(argc > 2 ? strtoull(argv[2], NULL, 10) : 100000000,
+                  argc > 3 ? atoi(argv[3]) : 8);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "gap") == 0) {
+        benchGap(argc > 2 ? strtoull(argv[2], NULL, 10) : 100000,
+                 argc > 3 ? strtoull(argv[3], NULL, 10) : 100000);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "range") == 0) {
+        benchRange(argc > 2 ? strtoull(argv[2], NULL, 10) : 100000);
+        return 0;
+    }
+
     ArrayPtr arrPtr = createArray(2);
     // 测试从头部插入元素
     for (int i = 0; i < 10; i++) {
@@ -176,5 +1739,11 @@ int main(void) {
     // printInfo(arrPtr);
     // erase(arrPtr, 6);
     // printInfo(arrPtr);
+    // 测试预留容量和收缩
+    reserve(arrPtr, 100);
+    printf("cap after reserve: %zu\n", arrPtr->cap);
+    shrinkToFit(arrPtr);
+    printf("cap after shrink: %zu\n", arrPtr->cap);
+    destroyArray(arrPtr);
     return 0;
 }
\ No newline at end of file
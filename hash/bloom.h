@@ -0,0 +1,269 @@
+// 分块布隆过滤器，放在哈希表前面过滤不存在的键
+/*
+    模型
+        位数组按缓存行切成512位的块，每块是8个64位的字。
+        一个键只落在一个块里，在每个字里各置一位，一共8位：
+
+        blocks--->+--------+--------+-----+--------+
+                  | word 0 | word 1 | ... | word 7 |  块0（64字节）
+                  +--------+--------+-----+--------+
+                  | word 0 | word 1 | ... | word 7 |  块1
+                  +--------+--------+-----+--------+
+                     ...
+
+        哈希值的低32位选块（乘法取高位，块数不需要是2的幂），
+        高32位分别乘8个奇数盐再取最高6位，得到8个字里各自的位号
+
+    查找
+        只访问一个缓存行。bloomInit时按CPU选一次实现，不需要-mavx2编译：
+            AVX2：8个位号用两条256位指令一起算出掩码，再用vptest一次判断
+                  8个字是不是都包含各自的那一位
+            SSE2：x86-64都支持，乘法和移位每次算两个字，4个128位的掩码
+                  和块比较一次得出结果
+            其他平台逐个字判断
+
+    误判率
+        每块8个字是相互独立的，一个不存在的键被误判的概率是它所在块的
+        每个字里被置位的比例之积。bloomFpr按当前每个块的实际位数算这个
+        概率的平均值，键分布不均匀造成的损失也算进去了。
+        每个键10位的时候大约是1%，比同样大小的普通布隆过滤器略高
+
+    删除
+        布隆过滤器不能删除，删掉的键的位一直留着，只会让误判率变高，
+        不会漏掉存在的键。哈希表在扩容或者放进去的键超过预计个数时重建
+*/
+
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLOOM_X86
+#endif
+
+#define BLOOM_BITS_PER_KEY 10  // 默认每个键占的位数
+
+typedef struct bloom {
+    uint64_t* blocks;  // 位数组，按64字节对齐，每块8个字
+    size_t nblocks;    // 块数，0表示没有分配
+    size_t capacity;   // 预计放进去的键的个数
+    size_t added;      // 已经放进去的键的个数，包括后来删掉的
+    int simd;          // 使用的实现，bloomInit时按CPU选
+} Bloom;
+
+enum { BLOOM_SCALAR, BLOOM_SSE2, BLOOM_AVX2 };
+
+// 8个奇数盐，和Parquet的split block布隆过滤器用的一样
+static const uint32_t bloomSalts[8] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU,
+                                       0xa2b7289dU, 0x705495c7U, 0x2df1424bU,
+                                       0x9efc4947U, 0x5c6bfb31U};
+
+// CPU支持的最好的实现
+static inline int bloomSimd(void) {
+#ifdef BLOOM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return BLOOM_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return BLOOM_SSE2;
+    }
+#endif
+    return BLOOM_SCALAR;
+}
+
+// 为n个键、每个键bitsPerKey位分配过滤器，失败返回-1
+static inline int bloomInit(Bloom* b, size_t n, size_t bitsPerKey) {
+    size_t nblocks = (n * bitsPerKey + 511) / 512;
+    if (nblocks == 0) {
+        nblocks = 1;
+    }
+    uint64_t* blocks = aligned_alloc(64, nblocks * 64);
+    if (blocks == NULL) {
+        return -1;
+    }
+    memset(blocks, 0, nblocks * 64);
+    b->blocks = blocks;
+    b->nblocks = nblocks;
+    b->capacity = n;
+    b->added = 0;
+    b->simd = bloomSimd();
+    return 0;
+}
+
+static inline void bloomDestroy(Bloom* b) {
+    free(b->blocks);
+    b->blocks = NULL;
+    b->nblocks = 0;
+    b->capacity = 0;
+    b->added = 0;
+}
+
+static inline size_t bloomBytes(const Bloom* b) {
+    return b->nblocks * 64;
+}
+
+// hash所在的块
+static inline uint64_t* bloomBlock(const Bloom* b, uint64_t hash) {
+    size_t i = (size_t)(((hash & 0xFFFFFFFFULL) * b->nblocks) >> 32);
+    return b->blocks + i * 8;
+}
+
+// 第i个字里要置的位
+static inline uint64_t bloomBit(uint64_t hash, int i) {
+    return 1ULL << (((uint32_t)(hash >> 32) * bloomSalts[i]) >> 26);
+}
+
+static inline void bloomAddScalar(Bloom* b, uint64_t hash) {
+    uint64_t* block = bloomBlock(b, hash);
+    for (int i = 0; i < 8; i++) {
+        block[i] |= bloomBit(hash, i);
+    }
+}
+
+static inline int bloomMayContainScalar(const Bloom* b, uint64_t hash) {
+    const uint64_t* block = bloomBlock(b, hash);
+    for (int i = 0; i < 8; i++) {
+        if ((block[i] & bloomBit(hash, i)) == 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+#ifdef BLOOM_X86
+// SSE2没有32位的mullo，用两次32x32->64的乘法分别算偶数和奇数位置
+static inline __m128i bloomMullo(__m128i a, __m128i b) {
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// SSE2也没有按元素变化的移位，每个字用各自的位号移一次，两个字拼成一个向量
+static inline __m128i bloomMask2(__m128i one, __m128i pos64) {
+    return _mm_unpacklo_epi64(_mm_sll_epi64(one, pos64),
+                              _mm_sll_epi64(one, _mm_srli_si128(pos64, 8)));
+}
+
+// 8个字里各自要置的位，分成4个128位的掩码
+static inline void bloomMaskSse2(uint64_t hash, __m128i m[4]) {
+    __m128i h = _mm_set1_epi32((int)(uint32_t)(hash >> 32));
+    __m128i zero = _mm_setzero_si128();
+    __m128i one = _mm_set1_epi64x(1);
+    for (int k = 0; k < 2; k++) {
+        __m128i salts = _mm_loadu_si128((const __m128i*)(bloomSalts + 4 * k));
+        __m128i pos = _mm_srli_epi32(bloomMullo(h, salts), 26);
+        // 位号零扩展成64位，移位只看低64位
+        m[2 * k] = bloomMask2(one, _mm_unpacklo_epi32(pos, zero));
+        m[2 * k + 1] = bloomMask2(one, _mm_unpackhi_epi32(pos, zero));
+    }
+}
+
+static inline void bloomAddSse2(Bloom* b, uint64_t hash) {
+    __m128i* block = (__m128i*)bloomBlock(b, hash);
+    __m128i m[4];
+    bloomMaskSse2(hash, m);
+    for (int k = 0; k < 4; k++) {
+        __m128i w = _mm_load_si128(block + k);
+        _mm_store_si128(block + k, _mm_or_si128(w, m[k]));
+    }
+}
+
+static inline int bloomMayContainSse2(const Bloom* b, uint64_t hash) {
+    const __m128i* block = (const __m128i*)bloomBlock(b, hash);
+    __m128i m[4];
+    bloomMaskSse2(hash, m);
+    // 块和掩码相与还等于掩码，说明掩码里的位全都是1
+    __m128i eq = _mm_set1_epi32(-1);
+    for (int k = 0; k < 4; k++) {
+        __m128i t = _mm_and_si128(_mm_load_si128(block + k), m[k]);
+        eq = _mm_and_si128(eq, _mm_cmpeq_epi32(t, m[k]));
+    }
+    return _mm_movemask_epi8(eq) == 0xFFFF;
+}
+
+#define BLOOM_TARGET_AVX2 __attribute__((target("avx2")))
+
+// 8个字里各自要置的位，分成两个256位的掩码
+BLOOM_TARGET_AVX2 static inline void bloomMaskAvx2(uint64_t hash,
+                                                   __m256i* lo, __m256i* hi) {
+    __m256i salts = _mm256_loadu_si256((const __m256i*)bloomSalts);
+    __m256i h = _mm256_set1_epi32((int)(uint32_t)(hash >> 32));
+    __m256i pos = _mm256_srli_epi32(_mm256_mullo_epi32(h, salts), 26);
+    __m256i one = _mm256_set1_epi64x(1);
+    *lo = _mm256_sllv_epi64(
+        one, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(pos)));
+    *hi = _mm256_sllv_epi64(
+        one, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(pos, 1)));
+}
+
+BLOOM_TARGET_AVX2 static inline void bloomAddAvx2(Bloom* b, uint64_t hash) {
+    __m256i* block = (__m256i*)bloomBlock(b, hash);
+    __m256i lo, hi;
+    bloomMaskAvx2(hash, &lo, &hi);
+    _mm256_store_si256(block, _mm256_or_si256(_mm256_load_si256(block), lo));
+    _mm256_store_si256(block + 1,
+                       _mm256_or_si256(_mm256_load_si256(block + 1), hi));
+}
+
+BLOOM_TARGET_AVX2 static inline int bloomMayContainAvx2(const Bloom* b,
+                                                        uint64_t hash) {
+    const __m256i* block = (const __m256i*)bloomBlock(b, hash);
+    __m256i lo, hi;
+    bloomMaskAvx2(hash, &lo, &hi);
+    // testc：掩码里的位在块里全都是1
+    return _mm256_testc_si256(_mm256_load_si256(block), lo) &
+           _mm256_testc_si256(_mm256_load_si256(block + 1), hi);
+}
+#endif
+
+static inline void bloomAdd(Bloom* b, uint64_t hash) {
+    switch (b->simd) {
+#ifdef BLOOM_X86
+        case BLOOM_AVX2:
+            bloomAddAvx2(b, hash);
+            break;
+        case BLOOM_SSE2:
+            bloomAddSse2(b, hash);
+            break;
+#endif
+        default:
+            bloomAddScalar(b, hash);
+            break;
+    }
+    ++b->added;
+}
+
+// 可能存在返回1，一定不存在返回0
+static inline int bloomMayContain(const Bloom* b, uint64_t hash) {
+    switch (b->simd) {
+#ifdef BLOOM_X86
+        case BLOOM_AVX2:
+            return bloomMayContainAvx2(b, hash);
+        case BLOOM_SSE2:
+            return bloomMayContainSse2(b, hash);
+#endif
+        default:
+            return bloomMayContainScalar(b, hash);
+    }
+}
+
+// 按每个块实际置位的比例估算一个不存在的键被误判的概率
+static inline double bloomFpr(const Bloom* b) {
+    double sum = 0.0;
+    for (size_t i = 0; i < b->nblocks; i++) {
+        double p = 1.0;
+        for (int j = 0; j < 8; j++) {
+            p *= __builtin_popcountll(b->blocks[i * 8 + j]) / 64.0;
+        }
+        sum += p;
+    }
+    return b->nblocks ? sum / b->nblocks : 0.0;
+}
+
+#endif
@@ -0,0 +1,923 @@
+// 分离链接法哈希表，hash_separate_chaining.c和hash_sharded.c共用
+/*
+    模型
+        每个桶是一个表项，存着链表的第一个结点和链表长度，结点从slab里分配。
+        短键直接存在结点里，长键存指针，结点里还存着完整的哈希值和键长，
+        查找时先比较它们再memcmp：
+
+        array--->+---+-----+     +------+     +------+
+                 | h | len |---->| node |---->| node |--->NULL
+                 +---+-----+     +------+     +------+
+                 | 0 |  0  |  空桶
+                 +---+-----+
+                    ...
+
+        空桶全是0，新表用calloc分配，不需要逐个初始化。
+        负载因子超过policy.maxload时扩容，低于policy.minload时缩容。
+        扩容和缩容都是渐进式的：新表分配好以后，之后的每次操作顺带把旧表里
+        rehashstep个桶迁移过去，迁移完之前查找和删除两张表都要看。
+        迁移期间又要扩容或者缩容的时候，先加快迁移，迁移完了再开始
+
+    可选
+        initOwnedHashTable   键值复制到表自己的字符串区
+        setBloom             查找前先问布隆过滤器，不存在的键不用走链表
+        trace                为1时插入和删除的时候打印出来
+
+    表不做同步，多线程使用时由调用者保证同一时间只有一个线程访问
+*/
+
+#ifndef CHAINMAP_H
+#define CHAINMAP_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// __GLIBC__在上面的标准头文件里定义，malloc_trim只有glibc有
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "bloom.h"
+#include "hashstats.h"
+#include "slab.h"
+#include "strarena.h"
+#include "wyhash.h"
+
+#define LOADFACTOR 0.75  // 出发扩容的最大负载因子
+#define GROWFACTOR 2.0   // 扩容倍数
+#define SHRINKLOAD 0.1   // 触发缩容的负载因子，至多是LOADFACTOR的一半
+#define REHASHSTEP 1     // 渐进式扩容时每次操作迁移的桶数量
+#define INLINEKEY 15     // 不超过这个长度的键直接存在结点里
+#define RELEASEBYTES (1UL << 20)  // 旧表每迁移完这么多字节就把这部分页还给系统
+
+// 链表结点
+// 短键直接复制到结点里，查找时不需要再多访问一次内存；
+// 长键指向调用者的内存，或者表自己的字符串区（owning模式）
+typedef struct node {
+    struct node* next;
+    uint64_t hash;  // 键的完整哈希值，查找时先比较它，扩容时直接复用
+    union {
+        const char* ptr;          // 长键
+        char buf[INLINEKEY + 1];  // 短键，带'\0'
+    } key;                        // hash元素的键
+    const char* value;            // hash元素的值
+    uint32_t klen;                // 键的长度，比较时先比较长度再memcmp
+} Node, *Nodeptr;
+
+// 哈希表数据单元，全是0就是一个空桶
+typedef struct hashEl {
+    Nodeptr h;   // 链表的第一个结点，NULL表示空链表
+    size_t len;  // 当前链表的结点长度，hashStats用它统计链长的分布
+} HashEl, *HashElptr;
+
+// 扩容策略
+// maxload是触发扩容的负载因子，growstep不为0时每次扩容增加固定的桶数量，
+// 为0时按growfactor倍数扩容。负载因子低于minload时缩容，但不会小于mincap
+typedef struct growPolicy {
+    float maxload;     // 触发扩容的最大负载因子
+    float growfactor;  // 扩容倍数，必须大于1
+    size_t growstep;   // 每次扩容增加的桶数量，0表示按倍数扩容
+    float minload;     // 触发缩容的最小负载因子，0表示不缩容
+    size_t mincap;     // 缩容的下限，默认是初始容量
+} GrowPolicy;
+
+// 哈希表结构
+// len直接统计键值对的个数（新旧两个表加起来），负载因子 = len / cap
+typedef struct hash {
+    HashElptr array;    // 哈希表数组
+    HashElptr old;      // 渐进式扩容期间的旧哈希表数组，不在扩容时为NULL
+    float lfactor;      // 负载因子
+    size_t cap;         // 当前哈希表容量
+    size_t oldcap;      // 旧哈希表容量
+    size_t len;         // 当前键值对的个数
+    int64_t rehashidx;  // 旧表中下一个要迁移的桶下标，-1表示不在扩容
+    size_t oldfreed;    // 旧表开头已经还给系统的字节数
+    int rehashstep;     // 每次操作迁移的桶数量，0表示一次性迁移完
+    GrowPolicy policy;  // 扩容策略
+    Slab nodes;         // 链表结点的分配器
+    Slab oldnodes;      // 缩容迁移期间旧表结点所在的slab，迁移完以后逐个释放
+    int movenodes;      // 为1时迁移把结点复制到nodes里，迁移完释放oldnodes
+    size_t allocs;      // 哈希表数组调用malloc的次数
+    int owning;         // 为1时把键值复制到strs里，调用者不需要保留原来的字符串
+    StrArena strs;      // 键值的字符串区，只在owning模式下使用
+    size_t bloombits;   // 布隆过滤器每个键的位数，0表示不用过滤器
+    Bloom bloom;        // 新表上所有键的布隆过滤器
+    Bloom oldbloom;     // 渐进式扩容期间旧表的布隆过滤器
+    int trace;          // 为1时打印插入和删除的过程，演示用
+#ifdef HASHSTATS
+    HashCounters counters;  // 扩容次数和用时
+#endif
+} Hash, *Hashptr;
+
+static inline void errExit(const char* errMsg) {
+    fprintf(stderr, "%s\n", errMsg);
+    exit(EXIT_FAILURE);
+}
+
+static inline void isNull(Hashptr hptr, const char* key) {
+    // 判断hash结构是否已经初始化
+    if (hptr == NULL) {
+        errExit("hptr is NULL");
+    }
+
+    // 判断键是否为空
+    if (key == NULL) {
+        errExit("key if NULL");
+    }
+}
+
+// 结点的键
+static inline const char* nodeKey(Nodeptr node) {
+    return node->klen <= INLINEKEY ? node->key.buf : node->key.ptr;
+}
+
+static inline void printInfo(Hashptr hptr) {
+    if (hptr == NULL) {
+        errExit("hptr is NULL");
+    }
+
+    printf(
+        "----------------------------------------------------------------------"
+        "----------------------------\n");
+    printf("cap: %zu | len: %zu load-factor: %f\n", hptr->cap, hptr->len,
+           hptr->lfactor);
+    printf("table item: \n");
+    for (size_t i = 0; i < hptr->cap; i++) {
+        printf("%-10zu\t", i);
+    }
+    printf("\n");
+    printf("next: \n");
+    for (size_t i = 0; i < hptr->cap; i++) {
+        printf("0x%p\t", (void*)hptr->array[i].h);
+    }
+    printf("\n");
+    if (hptr->rehashidx >= 0) {
+        printf("rehashing: %lld / %zu\n", (long long)hptr->rehashidx,
+               hptr->oldcap);
+    }
+}
+
+static inline void printKeyValue(Hashptr hptr) {
+    if (hptr == NULL) {
+        errExit("hptr is NULL");
+    }
+
+    for (size_t i = 0; i < hptr->cap; i++) {
+        HashElptr item = &hptr->array[i];
+        printf("index: %zu len: %zu  ", i, item->len);
+        for (Nodeptr tmp = item->h; tmp != NULL; tmp = tmp->next) {
+            printf("`%s|%s` ", nodeKey(tmp), tmp->value);
+        }
+        printf("\n");
+    }
+    // 扩容期间还没迁移的旧桶
+    for (int64_t i = hptr->rehashidx; i >= 0 && (size_t)i < hptr->oldcap;
+         i++) {
+        HashElptr item = &hptr->old[i];
+        printf("old index: %lld len: %zu  ", (long long)i, item->len);
+        for (Nodeptr tmp = item->h; tmp != NULL; tmp = tmp->next) {
+            printf("`%s|%s` ", nodeKey(tmp), tmp->value);
+        }
+        printf("\n");
+    }
+}
+
+// 计算长度为len的key的64位哈希值，和表的容量无关
+static inline uint64_t hashBytes(const char* key, size_t len) {
+    return wyhash(key, len, WYHASH_SEED);
+}
+
+static inline uint64_t hashKey(const char* key) {
+    return hashBytes(key, strlen(key));
+}
+
+// 键的长度，超过uint32_t的键不支持
+static inline uint32_t keyLen(const char* key) {
+    size_t len = strlen(key);
+    if (len > UINT32_MAX) {
+        errExit("key is too long");
+    }
+    return (uint32_t)len;
+}
+
+// 哈希函数
+static inline size_t hashFunc(const char* key, Hashptr hptr) {
+    isNull(hptr, key);
+
+    // 得到的返回值最大不超过hptr->cap - 1
+    return hashKey(key) % hptr->cap;
+}
+
+// 创建cap个空的哈希表项
+// 空桶全是0，不需要逐个初始化。大块的calloc直接从mmap拿已经清零的页，
+// 页在第一次访问的时候才分配，扩容的那一次插入不用把整个新表写一遍，
+// 清零的代价分摊到之后往新表里挂结点的操作上
+static inline HashElptr newTableItems(size_t cap) {
+    HashElptr array = calloc(cap, sizeof(HashEl));
+    if (array == NULL) {
+        errExit("out of memory");
+    }
+    return array;
+}
+
+// 创建新的哈希表数组，键值对个数不变，只重新计算负载因子
+static inline void initTableItem(Hashptr hptr, size_t initcap) {
+    // 创建哈希表
+    hptr->array = newTableItems(initcap);
+    ++hptr->allocs;
+
+    // 初始化各项参数
+    hptr->cap = initcap;
+    hptr->lfactor = (float)hptr->len / (float)hptr->cap;
+}
+
+// 初始化哈希表
+static inline Hashptr initHashTable(size_t initcap) {
+    if (initcap == 0) {
+        errExit("initcap is 0");
+    }
+    // 创建哈希结构
+    Hashptr hptr = malloc(sizeof(Hash));
+    if (hptr == NULL) {
+        errExit("out of memory");
+    }
+    // 初始化各项参数
+    hptr->len = 0;
+    hptr->allocs = 0;
+    hptr->owning = 0;
+    hptr->trace = 0;
+    strArenaInit(&hptr->strs);
+    slabInit(&hptr->nodes, sizeof(Node), 1);
+    slabInit(&hptr->oldnodes, sizeof(Node), 1);
+    hptr->movenodes = 0;
+    hptr->bloombits = 0;
+    memset(&hptr->bloom, 0, sizeof(Bloom));
+    memset(&hptr->oldbloom, 0, sizeof(Bloom));
+    initTableItem(hptr, initcap);
+    hptr->old = NULL;
+    hptr->oldcap = 0;
+    hptr->rehashidx = -1;
+    hptr->oldfreed = 0;
+    hptr->rehashstep = REHASHSTEP;
+    hptr->policy.maxload = LOADFACTOR;
+    hptr->policy.growfactor = GROWFACTOR;
+    hptr->policy.growstep = 0;
+    hptr->policy.minload = SHRINKLOAD;
+    hptr->policy.mincap = initcap;
+#ifdef HASHSTATS
+    hptr->counters = (HashCounters){0, 0.0};
+#endif
+
+    return hptr;
+}
+
+// 初始化一个自己保存键值的哈希表
+// 插入的键值都会复制到表的字符串区，调用者的字符串可以马上释放或者复用
+static inline Hashptr initOwnedHashTable(size_t initcap) {
+    Hashptr hptr = initHashTable(initcap);
+    hptr->owning = 1;
+    return hptr;
+}
+
+// 把字符串复制到表的字符串区
+static inline const char* copyString(Hashptr hptr, const char* s,
+                                      uint32_t len) {
+    const char* p = strArenaCopy(&hptr->strs, s, len);
+    if (p == NULL) {
+        errExit("out of memory");
+    }
+    return p;
+}
+
+// 设置扩容策略
+static inline void setGrowPolicy(Hashptr hptr, float maxload,
+                                 float growfactor, size_t growstep) {
+    if (hptr == NULL) {
+        errExit("hptr is NULL");
+    }
+    if (maxload <= 0.0 || (growstep == 0 && growfactor <= 1.0)) {
+        errExit("invalid grow policy");
+    }
+    hptr->policy.maxload = maxload;
+    hptr->policy.growfactor = growfactor;
+    hptr->policy.growstep = growstep;
+}
+
+// 设置缩容策略，minload为0时不缩容
+// minload不能超过maxload的一半，缩容之后的负载因子离两个阈值都有距离，
+// 在阈值附近反复插入删除不会来回扩容缩容
+static inline void setShrinkPolicy(Hashptr hptr, float minload, size_t mincap) {
+    if (hptr == NULL) {
+        errExit("hptr is NULL");
+    }
+    if (minload < 0.0 || minload * 2 > hptr->policy.maxload || mincap == 0) {
+        errExit("invalid shrink policy");
+    }
+    hptr->policy.minload = minload;
+    hptr->policy.mincap = mincap;
+}
+
+// 为新表分配空的布隆过滤器，按扩容之前最多能放的键数估算大小
+static inline void newBloom(Hashptr hptr) {
+    size_t n = (size_t)(hptr->cap * hptr->policy.maxload) + 1;
+    if (n < hptr->len) {
+        n = hptr->len;
+    }
+    if (bloomInit(&hptr->bloom, n, hptr->bloombits) != 0) {
+        errExit("out of memory");
+    }
+}
+
+// key可能在表中返回1，过滤器确定不在返回0，没有过滤器时总是1
+// 扩容期间没迁移的键只在旧表的过滤器里
+static inline int bloomCheck(Hashptr hptr, uint64_t hash) {
+    return hptr->bloombits == 0 || bloomMayContain(&hptr->bloom, hash) ||
+           (hptr->oldbloom.nblocks != 0 &&
+            bloomMayContain(&hptr->oldbloom, hash));
+}
+
+// 把空闲的堆内存还给系统
+// 大块内存free的时候glibc会直接munmap，堆顶以下的空闲页要malloc_trim才会释放
+static inline void trimMemory(void) {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}
+
+// 把已有的结点挂到新表对应的链表头部，不重新分配结点
+// 直接用结点保存的哈希值，不需要重新读取key
+static inline void linkNodeToList(Hashptr hptr, Nodeptr node) {
+    HashElptr item = &hptr->array[node->hash % hptr->cap];
+
+    // 插入链表头部
+    node->next = item->h;
+    item->h = node;
+    // 更新链表长度
+    ++item->len;
+    // 新插入和迁移过来的结点都放进新表的过滤器
+    if (hptr->bloombits != 0) {
+        bloomAdd(&hptr->bloom, node->hash);
+    }
+}
+
+// 将元素结点添加到对应的链表头部当中，klen是key的长度，hash是key的哈希值
+static inline void addNodeToList(Hashptr hptr, const char* key, uint32_t klen,
+                                 const char* value, uint64_t hash) {
+    // 构建新节点，从slab中分配
+    Nodeptr newNode = slabAlloc(&hptr->nodes);
+    if (newNode == NULL) {
+        errExit("out of memory");
+    }
+    newNode->hash = hash;
+    newNode->klen = klen;
+    if (klen <= INLINEKEY) {
+        memcpy(newNode->key.buf, key, klen + 1);
+    } else {
+        newNode->key.ptr = hptr->owning ? copyString(hptr, key, klen) : key;
+    }
+    newNode->value =
+        hptr->owning ? copyString(hptr, value, strlen(value)) : value;
+    linkNodeToList(hptr, newNode);
+    // 更新键值对个数和负载因子
+    // 强制转成浮点类型，否则无法计算出浮点数
+    ++hptr->len;
+    hptr->lfactor = (float)hptr->len / (float)hptr->cap;
+}
+
+// 开始迁移的时候原来的过滤器跟着旧表，新表换一个按新容量分配的空过滤器，
+// 迁移过来的结点再放进去，删掉的键也就不在新的过滤器里了
+static inline void startBloomRehash(Hashptr hptr) {
+    if (hptr->bloombits != 0) {
+        hptr->oldbloom = hptr->bloom;
+        newBloom(hptr);
+    }
+}
+
+// 旧表里下标小于rehashidx的桶已经迁移完，不会再访问，整页还给系统
+// 几百MB的旧表迁移完再一次释放的话，解除映射的时间都落在最后一次操作上
+static inline void releaseRehashed(Hashptr hptr) {
+#ifdef __linux__
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t base = (uintptr_t)hptr->old;
+    uintptr_t from = (base + hptr->oldfreed + page - 1) & ~(page - 1);
+    uintptr_t to = (base + (size_t)hptr->rehashidx * sizeof(HashEl)) &
+                   ~(page - 1);
+    if (to > from) {
+        madvise((void*)from, to - from, MADV_DONTNEED);
+        hptr->oldfreed = to - base;
+    }
+#else
+    (void)hptr;
+#endif
+}
+
+// 迁移旧表的最多n个非空桶到新表，顺路最多跳过16*n个空桶
+// 缩容之后旧表绝大部分是空桶，只按桶数算的话迁移会远远落后于删除
+// 结点直接摘下来挂到新表，旧的表项在迁移完之后随旧表一起释放；
+// movenodes时结点复制到新的slab里，迁移完之后每次调用释放一个旧slab，
+// 几百MB的旧slab一次还给系统的话，这一次操作就要停顿几十毫秒
+static inline void rehashStep(Hashptr hptr, int n) {
+    if (!hptr->movenodes && hptr->oldnodes.head != NULL) {
+        slabReleaseOne(&hptr->oldnodes);
+    }
+    size_t empty = (size_t)n * 16;
+    while (n > 0 && hptr->rehashidx >= 0) {
+        HashElptr item = &hptr->old[hptr->rehashidx];
+        if (item->len == 0) {
+            if (empty-- == 0) {
+                break;
+            }
+        } else {
+            --n;
+        }
+        Nodeptr tmp = item->h;
+        while (tmp != NULL) {
+            // 先保存下一个结点，挂到新表之后next就变了
+            Nodeptr next = tmp->next;
+            if (hptr->movenodes) {
+                Nodeptr node = slabAlloc(&hptr->nodes);
+                if (node == NULL) {
+                    errExit("out of memory");
+                }
+                *node = *tmp;
+                tmp = node;
+            }
+            linkNodeToList(hptr, tmp);
+            tmp = next;
+        }
+        item->h = NULL;
+        item->len = 0;
+
+        // 旧表全部迁移完毕，释放旧表
+        if ((size_t)++hptr->rehashidx >= hptr->oldcap) {
+            int shrunk = hptr->oldcap > hptr->cap;
+            free(hptr->old);
+            hptr->old = NULL;
+            hptr->oldcap = 0;
+            hptr->rehashidx = -1;
+            if (hptr->movenodes && hptr->rehashstep <= 0) {
+                slabDestroy(&hptr->oldnodes);
+            }
+            hptr->movenodes = 0;
+            bloomDestroy(&hptr->oldbloom);
+            if (shrunk) {
+                trimMemory();
+            }
+        } else if ((size_t)hptr->rehashidx * sizeof(HashEl) >=
+                   hptr->oldfreed + RELEASEBYTES) {
+            releaseRehashed(hptr);
+        }
+    }
+}
+
+// 把一个表数组上所有结点的哈希值放进布隆过滤器
+static inline void addTableToBloom(Bloom* b, HashElptr array, size_t from,
+                                   size_t cap) {
+    for (size_t i = from; i < cap; i++) {
+        for (Nodeptr tmp = array[i].h; tmp != NULL; tmp = tmp->next) {
+            bloomAdd(b, tmp->hash);
+        }
+    }
+}
+
+// 按当前的键重建布隆过滤器，删掉的键的位也就清掉了
+// 重建本来就要遍历所有结点，扩容期间先把剩下的迁移完
+static inline void rebuildBloom(Hashptr hptr) {
+    if (hptr->rehashidx >= 0) {
+        rehashStep(hptr, hptr->oldcap);
+    }
+    bloomDestroy(&hptr->bloom);
+    newBloom(hptr);
+    addTableToBloom(&hptr->bloom, hptr->array, 0, hptr->cap);
+}
+
+// 打开或者关闭查找前面的布隆过滤器，bitsPerKey为0表示关闭
+// 大部分查找的键都不存在的时候，过滤器挡掉的查找不需要访问桶和链表，
+// 代价是每个键多bitsPerKey位，插入的时候多写一个缓存行
+static inline void setBloom(Hashptr hptr, size_t bitsPerKey) {
+    if (hptr == NULL) {
+        errExit("hptr is NULL");
+    }
+    bloomDestroy(&hptr->bloom);
+    bloomDestroy(&hptr->oldbloom);
+    hptr->bloombits = bitsPerKey;
+    if (bitsPerKey != 0) {
+        rebuildBloom(hptr);
+    }
+}
+
+// 上一次扩容或者缩容还没迁移完，或者旧slab还没释放完的时候不开始新的，
+// 这次操作多迁移rehashstep个桶，都完成了返回1。一次把剩下的都迁移完的话，
+// 这一次操作就要走一遍旧表里剩下的桶，又回到了一次性迁移
+static inline int finishRehash(Hashptr hptr) {
+    if (hptr->rehashidx >= 0 || hptr->oldnodes.head != NULL) {
+        rehashStep(hptr, hptr->rehashstep);
+    }
+    return hptr->rehashidx < 0 && hptr->oldnodes.head == NULL;
+}
+
+// 简单扩容两倍
+// 扩容之后需要重新哈希分布，然后拷贝数据到新的哈希表上，释放掉原来的数据
+// 并且重新计算负载因子，如果负载因子还是比原来的大，那么加入随机数，再次
+// 重复以上步骤（重新计算还是先不搞了，it`s too troublesome）
+// 渐进式扩容：新旧两个表同时存在，之后每次insert、find、erase迁移rehashstep
+// 个桶，避免一次插入就要遍历整个旧表。rehashstep为0时一次性迁移完
+// 上一次的迁移还没完成时推迟扩容，负载因子暂时会超过maxload
+static inline Hashptr growHash(Hashptr hptr) {
+    if (hptr->lfactor >= hptr->policy.maxload && finishRehash(hptr)) {
+#ifdef HASHSTATS
+        double t0 = hashStatsNow();
+#endif
+        hptr->old = hptr->array;
+        hptr->oldcap = hptr->cap;
+        hptr->rehashidx = 0;
+        hptr->oldfreed = 0;
+        // 按扩容策略计算新容量，至少增加一个桶
+        size_t newcap = hptr->policy.growstep
+                            ? hptr->cap + hptr->policy.growstep
+                            : (size_t)(hptr->cap * hptr->policy.growfactor);
+        if (newcap <= hptr->cap) {
+            newcap = hptr->cap + 1;
+        }
+        // 重新初始化各项参数
+        initTableItem(hptr, newcap);
+        startBloomRehash(hptr);
+        if (hptr->rehashstep <= 0) {
+            rehashStep(hptr, hptr->oldcap);
+        }
+#ifdef HASHSTATS
+        hashCountersAdd(&hptr->counters, t0);
+#endif
+    }
+
+    return hptr;
+}
+
+// 负载因子低于minload时缩容，新容量让负载因子落在minload和maxload中间
+// 缩容和扩容一样是渐进式的。slab里一半以上是空闲结点时，迁移的同时把结点
+// 复制到新的slab里，迁移完释放整个旧slab，否则删掉的结点一直留在空闲链表里，
+// 内存还不回去。复制以后之前findNode拿到的结点指针都会失效
+static inline void shrinkHash(Hashptr hptr) {
+    if (hptr->policy.minload <= 0.0 || hptr->lfactor >= hptr->policy.minload ||
+        hptr->cap <= hptr->policy.mincap || !finishRehash(hptr)) {
+        return;
+    }
+#ifdef HASHSTATS
+    double t0 = hashStatsNow();
+#endif
+    float target = (hptr->policy.minload + hptr->policy.maxload) / 2;
+    size_t newcap = (size_t)(hptr->len / target) + 1;
+    if (newcap < hptr->policy.mincap) {
+        newcap = hptr->policy.mincap;
+    }
+    if (newcap >= hptr->cap) {
+        return;
+    }
+    hptr->old = hptr->array;
+    hptr->oldcap = hptr->cap;
+    hptr->rehashidx = 0;
+    hptr->oldfreed = 0;
+    if (!slabIsMalloc(&hptr->nodes) &&
+        hptr->nodes.live * hptr->nodes.objsize * 2 < hptr->nodes.bytes) {
+        hptr->oldnodes = hptr->nodes;
+        slabInit(&hptr->nodes, sizeof(Node), 1);
+        hptr->movenodes = 1;
+    }
+    initTableItem(hptr, newcap);
+    startBloomRehash(hptr);
+    if (hptr->rehashstep <= 0) {
+        rehashStep(hptr, hptr->oldcap);
+    }
+#ifdef HASHSTATS
+    hashCountersAdd(&hptr->counters, t0);
+#endif
+}
+
+// 结点的键是否等于key
+// 哈希值或者长度不相等的结点一定不是，都相等才需要memcmp
+static inline int keyEquals(Nodeptr node, const char* key, uint32_t klen,
+                            uint64_t hash) {
+    return node->hash == hash && node->klen == klen &&
+           memcmp(nodeKey(node), key, klen) == 0;
+}
+
+// 在一个链表中查找结点
+static inline Nodeptr findInList(HashElptr item, const char* key,
+                                 uint32_t klen, uint64_t hash) {
+    Nodeptr tmp = item->h;
+    while (tmp != NULL && !keyEquals(tmp, key, klen, hash)) {
+        tmp = tmp->next;
+    }
+    return tmp;
+}
+
+// 根据已经算好的长度和哈希值查找结点
+// 扩容期间key可能还在旧表中没迁移过去，新表找不到的话还要查旧表
+static inline Nodeptr findNodeByHash(Hashptr hptr, const char* key,
+                                     uint32_t klen, uint64_t hash) {
+    rehashStep(hptr, hptr->rehashstep);
+    if (!bloomCheck(hptr, hash)) {
+        return NULL;
+    }
+
+    Nodeptr tmp = findInList(&hptr->array[hash % hptr->cap], key, klen, hash);
+    if (tmp == NULL && hptr->rehashidx >= 0) {
+        size_t j = hash % hptr->oldcap;
+        // 下标小于rehashidx的旧桶已经迁移并释放了
+        if (j >= (size_t)hptr->rehashidx) {
+            tmp = findInList(&hptr->old[j], key, klen, hash);
+        }
+    }
+
+    return tmp;
+}
+
+// 查找结点
+static inline Nodeptr findNode(Hashptr hptr, const char* key) {
+    isNull(hptr, key);
+    uint32_t klen = keyLen(key);
+    return findNodeByHash(hptr, key, klen, hashBytes(key, klen));
+}
+
+// 批量查找keys中的n个键，结果依次放到out中，找不到的是NULL
+/*
+    逐个findNode的时候，表项array[i]和链表上的结点这几次访存前后依赖，
+    表比缓存大的时候每个键要等好几次完整的cache miss。
+    批量查找每次处理FINDBATCH个键：
+        1. 先把这一组的哈希值都算好，预取array[i]
+        2. 每一轮把所有键往前推进一步（array[i] -> 结点 -> 下一个结点），
+           推进之后马上预取下一步要访问的内存，
+           这样同一组里不同键的cache miss可以重叠在一起
+*/
+#define FINDBATCH 16
+
+static inline void findMany(Hashptr hptr, const char* const* keys, size_t n,
+                            Nodeptr* out) {
+    uint32_t klens[FINDBATCH];
+    uint64_t hashes[FINDBATCH];
+    HashElptr slots[FINDBATCH];
+
+    for (size_t base = 0; base < n; base += FINDBATCH) {
+        size_t m = n - base < FINDBATCH ? n - base : FINDBATCH;
+        const char* const* ks = keys + base;
+        Nodeptr* res = out + base;
+
+        for (size_t j = 0; j < m; j++) {
+            isNull(hptr, ks[j]);
+            klens[j] = keyLen(ks[j]);
+            hashes[j] = hashBytes(ks[j], klens[j]);
+            slots[j] = &hptr->array[hashes[j] % hptr->cap];
+            __builtin_prefetch(slots[j]);
+        }
+        // 和逐个查找一样，每个键推进一次渐进式扩容，扩容不会改变新表
+        rehashStep(hptr, hptr->rehashstep * (int)m);
+        // 过滤器确定不存在的键不再往下走
+        for (size_t j = 0; j < m; j++) {
+            if (!bloomCheck(hptr, hashes[j])) {
+                slots[j] = NULL;
+            }
+        }
+        for (size_t j = 0; j < m; j++) {
+            res[j] = slots[j] != NULL ? slots[j]->h : NULL;
+            if (res[j] != NULL) {
+                __builtin_prefetch(res[j]);
+            }
+        }
+
+        // 所有键交替沿着链表往下走，走到的结点是答案或者NULL就不再动
+        size_t active = m;
+        while (active > 0) {
+            active = 0;
+            for (size_t j = 0; j < m; j++) {
+                Nodeptr tmp = res[j];
+                if (tmp == NULL || keyEquals(tmp, ks[j], klens[j], hashes[j])) {
+                    continue;
+                }
+                res[j] = tmp->next;
+                if (res[j] != NULL) {
+                    __builtin_prefetch(res[j]);
+                    ++active;
+                }
+            }
+        }
+
+        // 扩容期间新表没找到的键还可能在旧表中，这种情况很少，直接逐个查
+        if (hptr->rehashidx >= 0) {
+            for (size_t j = 0; j < m; j++) {
+                size_t k = hashes[j] % hptr->oldcap;
+                if (res[j] == NULL && slots[j] != NULL &&
+                    k >= (size_t)hptr->rehashidx) {
+                    res[j] = findInList(&hptr->old[k], ks[j], klens[j],
+                                        hashes[j]);
+                }
+            }
+        }
+    }
+}
+
+// 把一个表数组上所有结点的长键和值复制到新的字符串区
+static inline void copyTableStrings(StrArena* to, HashElptr array,
+                                    size_t from, size_t cap) {
+    for (size_t i = from; i < cap; i++) {
+        for (Nodeptr tmp = array[i].h; tmp != NULL; tmp = tmp->next) {
+            if (tmp->klen > INLINEKEY) {
+                tmp->key.ptr = strArenaCopy(to, tmp->key.ptr, tmp->klen);
+                if (tmp->key.ptr == NULL) {
+                    errExit("out of memory");
+                }
+            }
+            tmp->value =
+                strArenaCopy(to, tmp->value, strArenaLen(tmp->value));
+            if (tmp->value == NULL) {
+                errExit("out of memory");
+            }
+        }
+    }
+}
+
+// 字符串区里死掉的字节超过一半的时候，把活着的字符串复制到新的区里
+static inline void compactStrings(Hashptr hptr) {
+    if (!hptr->owning || hptr->strs.dead < STRARENA_CHUNK ||
+        hptr->strs.dead * 2 < hptr->strs.used) {
+        return;
+    }
+    StrArena to;
+    strArenaInit(&to);
+    copyTableStrings(&to, hptr->array, 0, hptr->cap);
+    if (hptr->rehashidx >= 0) {
+        copyTableStrings(&to, hptr->old, hptr->rehashidx, hptr->oldcap);
+    }
+    strArenaDestroy(&hptr->strs);
+    hptr->strs = to;
+}
+
+static inline void insert(Hashptr hptr, const char* key, const char* value) {
+    if (hptr == NULL) {
+        errExit("hptr is null");
+    }
+
+    if (key == NULL || value == NULL) {
+        errExit("key or value is null");
+    }
+    if (hptr->trace) {
+        printf("insert %s|%s\n", key, value);
+    }
+    // 长度和哈希值只算一次，查找和插入都用它
+    uint32_t klen = keyLen(key);
+    uint64_t hash = hashBytes(key, klen);
+    Nodeptr tmp = findNodeByHash(hptr, key, klen, hash);
+    // 如果key不存在，那么就插入键值对
+    if (tmp == NULL) {
+        // 首先需要处理是否需要扩容
+        growHash(hptr);
+        // 插入新的键值对
+        addNodeToList(hptr, key, klen, value, hash);
+        // 反复删除又插入新键的时候表不扩容，过滤器里删掉的键越积越多，
+        // 放进去的键超过预计个数的两倍就重建
+        if (hptr->bloombits != 0 &&
+            hptr->bloom.added > hptr->bloom.capacity * 2) {
+            rebuildBloom(hptr);
+        }
+    } else if (hptr->owning) {  // 如果键已经存在，那么就更新键值
+        strArenaDrop(&hptr->strs, tmp->value);
+        tmp->value = copyString(hptr, value, strlen(value));
+        compactStrings(hptr);
+    } else {
+        // 默认传进来的是字符串字面量，分配在静态储存区的数组
+        tmp->value = value;
+    }
+}
+
+// 在一个链表中删除键值对，删除成功返回1，结点还给nodes
+static inline int eraseFromList(Hashptr hptr, HashElptr item, Slab* nodes,
+                                const char* key, uint32_t klen,
+                                uint64_t hash) {
+    // 查找指向当前给定的key所属的节点的指针，可能是表项里的h，
+    // 也可能是前一个结点的next
+    Nodeptr* link = &item->h;
+    while (*link != NULL && !keyEquals(*link, key, klen, hash)) {
+        link = &(*link)->next;
+    }
+    // 找不到就什么都不做
+    if (*link == NULL) {
+        return 0;
+    }
+    Nodeptr node = *link;
+    *link = node->next;
+    if (hptr->trace) {
+        printf("delete key: %s\n", nodeKey(node));
+    }
+    if (hptr->owning) {
+        if (node->klen > INLINEKEY) {
+            strArenaDrop(&hptr->strs, node->key.ptr);
+        }
+        strArenaDrop(&hptr->strs, node->value);
+    }
+    if (item->len != 0) {
+        // 递减链表的节点数量
+        --item->len;
+    } else {
+        errExit("the length of linked list is 0");
+    }
+    slabFree(nodes, node);
+    return 1;
+}
+
+// 删除键值对
+static inline void erase(Hashptr hptr, const char* key) {
+    isNull(hptr, key);
+    rehashStep(hptr, hptr->rehashstep);
+
+    // 找到就删除该节点，反之什么都不做
+    uint32_t klen = keyLen(key);
+    uint64_t hash = hashBytes(key, klen);
+    int erased = eraseFromList(hptr, &hptr->array[hash % hptr->cap],
+                               &hptr->nodes, key, klen, hash);
+    if (!erased && hptr->rehashidx >= 0) {
+        size_t j = hash % hptr->oldcap;
+        if (j >= (size_t)hptr->rehashidx) {
+            // 缩容迁移期间旧表的结点还在旧slab里
+            Slab* nodes = hptr->movenodes ? &hptr->oldnodes : &hptr->nodes;
+            erased = eraseFromList(hptr, &hptr->old[j], nodes, key, klen, hash);
+        }
+    }
+    if (erased) {
+        --hptr->len;
+        hptr->lfactor = (float)hptr->len / (float)hptr->cap;
+        compactStrings(hptr);
+        shrinkHash(hptr);
+    }
+}
+
+// 释放一个表数组上的所有结点，只有直接使用malloc的时候才需要
+static inline void freeTableNodes(Hashptr hptr, HashElptr array,
+                                  size_t from, size_t cap) {
+    for (size_t i = from; i < cap; i++) {
+        Nodeptr tmp = array[i].h;
+        while (tmp != NULL) {
+            Nodeptr next = tmp->next;
+            slabFree(&hptr->nodes, tmp);
+            tmp = next;
+        }
+    }
+}
+
+// 销毁哈希表
+// 结点都在slab里，整块释放就行，不需要逐个free
+static inline void destroyHash(Hashptr hptr) {
+    if (hptr == NULL) {
+        return;
+    }
+    if (slabIsMalloc(&hptr->nodes)) {
+        freeTableNodes(hptr, hptr->array, 0, hptr->cap);
+        if (hptr->rehashidx >= 0) {
+            freeTableNodes(hptr, hptr->old, hptr->rehashidx, hptr->oldcap);
+        }
+    }
+    slabDestroy(&hptr->nodes);
+    slabDestroy(&hptr->oldnodes);
+    strArenaDestroy(&hptr->strs);
+    bloomDestroy(&hptr->bloom);
+    bloomDestroy(&hptr->oldbloom);
+    free(hptr->array);
+    free(hptr->old);
+    free(hptr);
+}
+
+// 哈希表本身占用的字节数（不含键值字符串和malloc的额外开销）
+static inline size_t tableBytes(Hashptr hptr) {
+    size_t bucket = sizeof(HashEl);
+    size_t remain = hptr->rehashidx >= 0 ? hptr->oldcap - hptr->rehashidx : 0;
+    return sizeof(Hash) + (hptr->cap + remain) * bucket + hptr->nodes.bytes +
+           hptr->oldnodes.bytes + hptr->strs.bytes + bloomBytes(&hptr->bloom) +
+           bloomBytes(&hptr->oldbloom);
+}
+
+#ifdef HASHSTATS
+// 统计链长的分布，扩容期间旧表中还没迁移的桶也算上
+// 渐进式扩容的时间分摊在之后的操作里，这里只算growHash和shrinkHash本身的用时
+static inline HashStats hashStats(Hashptr hptr) {
+    HashStats st;
+    hashStatsInit(&st, &hptr->counters);
+    for (size_t i = 0; i < hptr->cap; i++) {
+        hashStatsAdd(&st, hptr->array[i].len);
+    }
+    if (hptr->rehashidx >= 0) {
+        for (size_t i = hptr->rehashidx; i < hptr->oldcap; i++) {
+            hashStatsAdd(&st, hptr->old[i].len);
+        }
+    }
+    st.len = hptr->len;
+    st.cap = hptr->cap;
+    st.bytes = tableBytes(hptr);
+    return st;
+}
+#endif
+
+#endif
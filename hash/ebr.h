@@ -0,0 +1,188 @@
+// 基于epoch的内存回收（EBR），给无锁读的并发哈希表用
+/*
+    模型
+        被删除的结点、被替换的旧表不能马上free，可能还有读线程在访问。
+        全局有一个epoch计数，每个线程有一个记录槽，各占一个缓存行：
+
+        slots--->+-----------+-----------+-----------+-----+
+                 | e<<1 | 1  |     0     | e-1<<1|1  | ... |
+                 +-----------+-----------+-----------+-----+
+                   线程0在读    线程1不在读   线程2还在上一个epoch
+
+        读线程进入的时候记录当前epoch，最低位置1，退出的时候清零。
+        删除的对象记下删除时的epoch放进待回收列表。所有正在读的线程都
+        进入过当前epoch之后全局epoch加一，比当前epoch小2的对象就没有
+        读线程能访问到了，调用它的释放函数
+
+    线程编号
+        每个线程第一次进入时分配一个编号，所有Ebr共用，线程退出的时候
+        通过pthread_key的析构函数归还，给后面的线程复用。最多EBR_MAXTHREADS个
+*/
+
+#ifndef EBR_H
+#define EBR_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define EBR_MAXTHREADS 128  // 最多的线程数量
+#define EBR_CACHELINE 64
+
+// 每个线程的epoch记录，最低位为1表示正在读
+typedef struct ebrSlot {
+    _Alignas(EBR_CACHELINE) _Atomic uint64_t v;
+} EbrSlot;
+
+// 待回收的对象
+typedef struct ebrRetired {
+    void* ptr;
+    void (*release)(void*);  // 释放函数
+    uint64_t epoch;          // 被删除时的全局epoch
+} EbrRetired;
+
+typedef struct ebr {
+    _Atomic uint64_t epoch;  // 全局epoch
+    EbrSlot slots[EBR_MAXTHREADS];
+    pthread_mutex_t lock;  // 保护待回收列表
+    EbrRetired* retired;   // 待回收列表
+    size_t nretired;
+    size_t retiredcap;
+    size_t batch;  // 待回收的对象每攒够这么多个尝试回收一次
+} Ebr;
+
+static _Thread_local int ebrThreadId = -1;
+static atomic_bool ebrThreadIdUsed[EBR_MAXTHREADS];
+static atomic_int ebrThreadIdHigh;  // 分配过的最大编号加一，回收时只扫描这么多
+static pthread_key_t ebrThreadIdKey;
+static pthread_once_t ebrThreadIdOnce = PTHREAD_ONCE_INIT;
+
+static inline void ebrFatal(const char* msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+static void ebrReleaseThreadId(void* p) {
+    (void)p;
+    atomic_store(&ebrThreadIdUsed[ebrThreadId], false);
+    ebrThreadId = -1;
+}
+
+static void ebrCreateThreadIdKey(void) {
+    pthread_key_create(&ebrThreadIdKey, ebrReleaseThreadId);
+}
+
+// 当前线程的编号，第一次调用时分配
+static inline int ebrMyThreadId(void) {
+    if (ebrThreadId < 0) {
+        pthread_once(&ebrThreadIdOnce, ebrCreateThreadIdKey);
+        for (int i = 0; i < EBR_MAXTHREADS; i++) {
+            bool expected = false;
+            if (atomic_compare_exchange_strong(&ebrThreadIdUsed[i], &expected,
+                                               true)) {
+                ebrThreadId = i;
+                break;
+            }
+        }
+        if (ebrThreadId < 0) {
+            ebrFatal("too many threads");
+        }
+        int high = atomic_load(&ebrThreadIdHigh);
+        while (high < ebrThreadId + 1 &&
+               !atomic_compare_exchange_weak(&ebrThreadIdHigh, &high,
+                                             ebrThreadId + 1)) {
+        }
+        pthread_setspecific(ebrThreadIdKey, (void*)1);
+    }
+    return ebrThreadId;
+}
+
+// e所在的内存要按EBR_CACHELINE对齐，记录槽才能各占一个缓存行
+static inline void ebrInit(Ebr* e, size_t batch) {
+    atomic_init(&e->epoch, 0);
+    for (int i = 0; i < EBR_MAXTHREADS; i++) {
+        atomic_init(&e->slots[i].v, 0);
+    }
+    pthread_mutex_init(&e->lock, NULL);
+    e->retired = NULL;
+    e->nretired = 0;
+    e->retiredcap = 0;
+    e->batch = batch ? batch : 1;
+}
+
+// 释放所有待回收的对象，调用者保证没有其他线程还在使用
+static inline void ebrDestroy(Ebr* e) {
+    for (size_t i = 0; i < e->nretired; i++) {
+        e->retired[i].release(e->retired[i].ptr);
+    }
+    free(e->retired);
+    e->retired = NULL;
+    e->nretired = 0;
+    e->retiredcap = 0;
+    pthread_mutex_destroy(&e->lock);
+}
+
+// 进入读临界区，记下当前的全局epoch
+static inline void ebrEnter(Ebr* e) {
+    uint64_t epoch = atomic_load(&e->epoch);
+    atomic_store(&e->slots[ebrMyThreadId()].v, (epoch << 1) | 1);
+}
+
+// 退出读临界区
+static inline void ebrExit(Ebr* e) {
+    atomic_store_explicit(&e->slots[ebrMyThreadId()].v, 0,
+                          memory_order_release);
+}
+
+// 尝试推进全局epoch，并释放不可能再被访问的对象，调用者持有lock
+static inline void ebrReclaim(Ebr* e) {
+    uint64_t epoch = atomic_load(&e->epoch);
+    int n = atomic_load(&ebrThreadIdHigh);
+    bool advance = true;
+    for (int i = 0; i < n; i++) {
+        uint64_t v = atomic_load(&e->slots[i].v);
+        if ((v & 1) && (v >> 1) != epoch) {
+            advance = false;
+            break;
+        }
+    }
+    if (advance) {
+        atomic_compare_exchange_strong(&e->epoch, &epoch, epoch + 1);
+        ++epoch;
+    }
+
+    // 比当前epoch小2的对象已经没有读线程能访问到
+    size_t kept = 0;
+    for (size_t i = 0; i < e->nretired; i++) {
+        EbrRetired r = e->retired[i];
+        if (r.epoch + 2 <= epoch) {
+            r.release(r.ptr);
+        } else {
+            e->retired[kept++] = r;
+        }
+    }
+    e->nretired = kept;
+}
+
+// 把对象放进待回收列表，没人能访问的时候调用release(ptr)
+static inline void ebrRetire(Ebr* e, void* ptr, void (*release)(void*)) {
+    pthread_mutex_lock(&e->lock);
+    if (e->nretired == e->retiredcap) {
+        e->retiredcap = e->retiredcap ? e->retiredcap * 2 : 64;
+        e->retired = realloc(e->retired, sizeof(EbrRetired) * e->retiredcap);
+        if (e->retired == NULL) {
+            ebrFatal("out of memory");
+        }
+    }
+    EbrRetired r = {ptr, release, atomic_load(&e->epoch)};
+    e->retired[e->nretired++] = r;
+    if (e->nretired % e->batch == 0) {
+        ebrReclaim(e);
+    }
+    pthread_mutex_unlock(&e->lock);
+}
+
+#endif
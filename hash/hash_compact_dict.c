@@ -0,0 +1,468 @@
+// 紧凑有序哈希表（类似CPython的dict）
+/*
+    模型
+        键值对按插入顺序追加到连续的entries数组里，
+        另外有一个开放定址的索引数组indices，槽位里存的是entries的下标
+
+        indices (cap = 8, 8位)        entries (ecap = cap * 2 / 3 = 5)
+          +---+                        +------+-------+-------+
+        0 | 0 |                      0 | hash | key-a | val-a |
+          +---+                        +------+-------+-------+
+        1 | 5 |--------+             1 | hash | NULL  |       |  <-- 已删除
+          +---+        |               +------+-------+-------+
+        2 | 2 |        |             2 | hash | key-c | val-c |
+          +---+        |               +------+-------+-------+
+        3 | 1 |        +-----------> 3 | hash | key-d | val-d |
+          +---+                        +------+-------+-------+
+        4 | 4 |                      4 |                      |  <-- nentries
+          +---+                        +----------------------+
+         ...
+
+        索引槽位的值：0是空，1是删除留下的墓碑，其他值是entries的下标加2，
+        这样calloc出来的索引就全是空槽
+
+    索引宽度
+        entries的下标放得进8位就用uint8_t，否则16位，再否则32位，
+        小表的索引只有几个字节，一个缓存行能放下整张索引
+
+    遍历
+        直接从头到尾扫entries，是连续内存的顺序读，顺序就是插入顺序，
+        跳过key为NULL的已删除项。更新已经存在的key不改变它的位置
+
+    删除
+        索引槽位改成墓碑，entries里的key置NULL，表都不移动。
+        插入时entries用完了就重建：去掉已删除项把entries压实，按元素个数
+        重新选索引的容量和宽度，重新填索引。元素个数低于LOAD_FACTOR_MIN时
+        同样重建来缩容
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hashstats.h"
+#include "wyhash.h"
+
+#define MINCAP 8             // 索引的最小容量，2的幂
+#define GROWRATE 3           // 重建时索引至少能放下len * GROWRATE个元素
+#define LOAD_FACTOR_MIN 0.1  // 元素个数低于entries容量的这个比例时缩容
+
+#define IX_EMPTY 0    // 空槽
+#define IX_DELETED 1  // 墓碑
+
+// 键值对
+typedef struct entry {
+    uint64_t hash;      // 键的哈希值，重建索引时直接复用
+    const char* key;    // 键，NULL表示已删除
+    const char* value;  // 值
+} Entry, *Entryptr;
+
+typedef struct hash {
+    void* indices;      // 索引数组，元素是uint8_t、uint16_t或者uint32_t
+    int width;          // 索引元素的字节数：1、2或者4
+    size_t cap;         // 索引的容量，2的幂
+    Entryptr entries;   // 键值对数组，按插入顺序排列
+    size_t ecap;        // entries的容量，cap * 2 / 3
+    size_t nentries;    // entries已经用到的位置，包括已删除的
+    size_t len;         // 元素个数
+    size_t mincap;      // 缩容的下限，就是初始容量
+#ifdef HASHSTATS
+    HashCounters counters;  // 重建次数和用时
+#endif
+} Hash, *Hashptr;
+
+int trace = 1;  // 是否打印插入和删除的过程，跑基准测试时关掉
+
+void errExit(const char* errMsg) {
+    fprintf(stderr, "%s\n", errMsg);
+    exit(EXIT_FAILURE);
+}
+
+void isNull(Hashptr hptr, const char* key) {
+    if (hptr == NULL) {
+        errExit("hptr is NULL");
+    }
+    if (key == NULL) {
+        errExit("key is NULL");
+    }
+}
+
+uint64_t hashKey(const char* key) {
+    return wyhashStr(key);
+}
+
+// 索引的第i个槽位
+size_t getIndex(Hashptr hptr, size_t i) {
+    switch (hptr->width) {
+        case 1:
+            return ((uint8_t*)hptr->indices)[i];
+        case 2:
+            return ((uint16_t*)hptr->indices)[i];
+        default:
+            return ((uint32_t*)hptr->indices)[i];
+    }
+}
+
+void setIndex(Hashptr hptr, size_t i, size_t ix) {
+    switch (hptr->width) {
+        case 1:
+            ((uint8_t*)hptr->indices)[i] = (uint8_t)ix;
+            break;
+        case 2:
+            ((uint16_t*)hptr->indices)[i] = (uint16_t)ix;
+            break;
+        default:
+            ((uint32_t*)hptr->indices)[i] = (uint32_t)ix;
+            break;
+    }
+}
+
+// 能放下ecap个下标（加上两个特殊值）的最小宽度
+int indexWidth(size_t ecap) {
+    if (ecap + 2 <= UINT8_MAX + 1) {
+        return 1;
+    }
+    if (ecap + 2 <= UINT16_MAX + 1) {
+        return 2;
+    }
+    if (ecap + 2 <= (size_t)UINT32_MAX + 1) {
+        return 4;
+    }
+    errExit("too many entries");
+    return 0;
+}
+
+// 分配容量为cap的空索引和对应的entries，entries里原来的内容保留
+void allocTable(Hashptr hptr, size_t cap) {
+    size_t ecap = cap * 2 / 3;
+    int width = indexWidth(ecap);
+    void* indices = calloc(cap, width);
+    Entryptr entries = realloc(hptr->entries, sizeof(Entry) * ecap);
+    if (indices == NULL || entries == NULL) {
+        errExit("out of memory");
+    }
+    free(hptr->indices);
+    hptr->indices = indices;
+    hptr->width = width;
+    hptr->cap = cap;
+    hptr->entries = entries;
+    hptr->ecap = ecap;
+}
+
+// 初始化哈希表，initcap是预计的元素个数
+Hashptr initHashTable(size_t initcap) {
+    Hashptr hptr = calloc(1, sizeof(Hash));
+    if (hptr == NULL) {
+        errExit("out of memory");
+    }
+    size_t cap = MINCAP;
+    while (cap * 2 / 3 < initcap) {
+        cap <<= 1;
+    }
+    allocTable(hptr, cap);
+    hptr->mincap = cap;
+    return hptr;
+}
+
+void destroyHash(Hashptr hptr) {
+    if (hptr == NULL) {
+        return;
+    }
+    free(hptr->indices);
+    free(hptr->entries);
+    free(hptr);
+}
+
+// 在索引里给hash找一个空槽，重建时用，索引里没有墓碑
+size_t findEmptySlot(Hashptr hptr, uint64_t hash) {
+    size_t mask = hptr->cap - 1;
+    size_t i = hash & mask;
+    while (getIndex(hptr, i) != IX_EMPTY) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+// 重建：压实entries，按元素个数选新的索引容量，重新填索引
+// 已删除的项在这里才真正去掉，剩下的项相对顺序不变
+void rebuild(Hashptr hptr) {
+#ifdef HASHSTATS
+    double t0 = hashStatsNow();
+#endif
+    size_t n = 0;
+    for (size_t i = 0; i < hptr->nentries; i++) {
+        if (hptr->entries[i].key != NULL) {
+            hptr->entries[n++] = hptr->entries[i];
+        }
+    }
+    hptr->nentries = n;
+    size_t cap = hptr->mincap;
+    while (cap * 2 / 3 < n * GROWRATE) {
+        cap <<= 1;
+    }
+    allocTable(hptr, cap);
+    for (size_t i = 0; i < n; i++) {
+        setIndex(hptr, findEmptySlot(hptr, hptr->entries[i].hash), i + 2);
+    }
+#ifdef HASHSTATS
+    hashCountersAdd(&hptr->counters, t0);
+#endif
+}
+
+// 查找key所在的索引槽位，不存在返回cap
+size_t lookup(Hashptr hptr, const char* key, uint64_t hash) {
+    size_t mask = hptr->cap - 1;
+    size_t i = hash & mask;
+    for (;;) {
+        size_t ix = getIndex(hptr, i);
+        if (ix == IX_EMPTY) {
+            return hptr->cap;
+        }
+        if (ix != IX_DELETED) {
+            Entryptr e = &hptr->entries[ix - 2];
+            if (e->hash == hash && strcmp(e->key, key) == 0) {
+                return i;
+            }
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+// 查找key对应的值，不存在返回NULL
+const char* find(Hashptr hptr, const char* key) {
+    isNull(hptr, key);
+    uint64_t hash = hashKey(key);
+    size_t i = lookup(hptr, key, hash);
+    if (i == hptr->cap) {
+        return NULL;
+    }
+    return hptr->entries[getIndex(hptr, i) - 2].value;
+}
+
+// 插入键值对，key已经存在就更新值，位置不变
+void insert(Hashptr hptr, const char* key, const char* value) {
+    isNull(hptr, key);
+    if (value == NULL) {
+        errExit("value is NULL");
+    }
+    if (trace) {
+        printf("insert %s|%s\n", key, value);
+    }
+    uint64_t hash = hashKey(key);
+    size_t i = lookup(hptr, key, hash);
+    if (i != hptr->cap) {
+        hptr->entries[getIndex(hptr, i) - 2].value = value;
+        return;
+    }
+    if (hptr->nentries == hptr->ecap) {
+        rebuild(hptr);
+    }
+    // 墓碑也可以复用，entries和索引的对应关系和位置无关
+    size_t mask = hptr->cap - 1;
+    i = hash & mask;
+    while (getIndex(hptr, i) > IX_DELETED) {
+        i = (i + 1) & mask;
+    }
+    Entry e = {hash, key, value};
+    hptr->entries[hptr->nentries] = e;
+    setIndex(hptr, i, hptr->nentries + 2);
+    ++hptr->nentries;
+    ++hptr->len;
+}
+
+// 删除键值对，删除成功返回1
+int erase(Hashptr hptr, const char* key) {
+    isNull(hptr, key);
+    uint64_t hash = hashKey(key);
+    size_t i = lookup(hptr, key, hash);
+    if (i == hptr->cap) {
+        return 0;
+    }
+    if (trace) {
+        printf("delete key: %s\n", key);
+    }
+    Entryptr e = &hptr->entries[getIndex(hptr, i) - 2];
+    e->key = NULL;
+    e->value = NULL;
+    setIndex(hptr, i, IX_DELETED);
+    --hptr->len;
+    if (hptr->cap > hptr->mincap && hptr->len < hptr->ecap * LOAD_FACTOR_MIN) {
+        rebuild(hptr);
+    }
+    return 1;
+}
+
+// 按插入顺序遍历，pos从0开始，返回0表示遍历结束
+// 遍历期间不能插入和删除，rebuild会移动entries
+int next(Hashptr hptr, size_t* pos, const char** key, const char** value) {
+    while (*pos < hptr->nentries) {
+        Entryptr e = &hptr->entries[(*pos)++];
+        if (e->key != NULL) {
+            *key = e->key;
+            *value = e->value;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void printKeyValue(Hashptr hptr) {
+    if (hptr == NULL) {
+        errExit("hptr is NULL");
+    }
+    printf("cap: %zu | entries: %zu/%zu | len: %zu | index width: %d\n",
+           hptr->cap, hptr->nentries, hptr->ecap, hptr->len, hptr->width * 8);
+    size_t pos = 0;
+    const char *key, *value;
+    while (next(hptr, &pos, &key, &value)) {
+        printf("`%s|%s` ", key, value);
+    }
+    printf("\n");
+}
+
+// 哈希表本身占用的字节数（不含键值字符串）
+size_t tableBytes(Hashptr hptr) {
+    return sizeof(Hash) + hptr->cap * hptr->width + hptr->ecap * sizeof(Entry);
+}
+
+#ifdef HASHSTATS
+// 统计索引里每个元素的探测长度
+HashStats hashStats(Hashptr hptr) {
+    HashStats st;
+    hashStatsInit(&st, &hptr->counters);
+    size_t mask = hptr->cap - 1;
+    for (size_t i = 0; i < hptr->cap; i++) {
+        size_t ix = getIndex(hptr, i);
+        if (ix == IX_DELETED) {
+            ++st.tombstones;
+        }
+        if (ix <= IX_DELETED) {
+            continue;
+        }
+        size_t home = hptr->entries[ix - 2].hash & mask;
+        hashStatsAdd(&st, ((i - home) & mask) + 1);
+    }
+    st.len = hptr->len;
+    st.cap = hptr->cap;
+    st.bytes = tableBytes(hptr);
+    return st;
+}
+#endif
+
+double nowSec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+uint64_t nextRand(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// 基准测试：插入n个键，随机查找，顺序遍历，删掉90%以后再遍历一次
+// 键统一放在一块连续内存中，每个键固定KEYWIDTH个字节
+#define KEYWIDTH 24
+void bench(size_t n) {
+    char* keys = malloc(n * KEYWIDTH);
+    if (keys == NULL) {
+        errExit("out of memory");
+    }
+    for (size_t i = 0; i < n; i++) {
+        snprintf(keys + i * KEYWIDTH, KEYWIDTH, "key-%zu", i);
+    }
+    trace = 0;
+    Hashptr hptr = initHashTable(0);
+
+    double t0 = nowSec();
+    for (size_t i = 0; i < n; i++) {
+        insert(hptr, keys + i * KEYWIDTH, keys + i * KEYWIDTH);
+    }
+    double t1 = nowSec();
+    uint64_t seed = 88172645463325252ULL;
+    size_t found = 0;
+    for (size_t i = 0; i < n; i++) {
+        found += find(hptr, keys + nextRand(&seed) % n * KEYWIDTH) != NULL;
+    }
+    double t2 = nowSec();
+    size_t pos = 0, seen = 0, sum = 0;
+    const char *key, *value;
+    while (next(hptr, &pos, &key, &value)) {
+        sum += (size_t)key[4];
+        ++seen;
+    }
+    double t3 = nowSec();
+    printf("keys: %zu cap: %zu index width: %d bytes/entry: %.1f\n", n,
+           hptr->cap, hptr->width * 8, (double)tableBytes(hptr) / hptr->len);
+    printf("insert: %.1f ns/op\n", (t1 - t0) / n * 1e9);
+    printf("find:   %.1f ns/op found: %zu\n", (t2 - t1) / n * 1e9, found);
+    printf("scan:   %.1f ns/entry seen: %zu checksum: %zu\n",
+           (t3 - t2) / seen * 1e9, seen, sum);
+
+    // 删掉90%，缩容时entries被压实，遍历仍然是顺序读
+    double t4 = nowSec();
+    for (size_t i = 0; i < n; i++) {
+        if (i % 10 != 0) {
+            erase(hptr, keys + i * KEYWIDTH);
+        }
+    }
+    double t5 = nowSec();
+    pos = seen = 0;
+    size_t prev = 0, ordered = 1;
+    while (next(hptr, &pos, &key, &value)) {
+        size_t k = (size_t)(key - keys) / KEYWIDTH;
+        ordered &= seen == 0 || k > prev;
+        prev = k;
+        ++seen;
+    }
+    double t6 = nowSec();
+    printf("erase:  %.1f ns/op\n", (t5 - t4) / (n - seen) * 1e9);
+    printf("sparse scan: %.1f ns/entry seen: %zu cap: %zu entries: %zu "
+           "ordered: %zu\n",
+           (t6 - t5) / seen * 1e9, seen, hptr->cap, hptr->nentries, ordered);
+#ifdef HASHSTATS
+    HashStats st = hashStats(hptr);
+    hashStatsPrint(&st);
+#endif
+    destroyHash(hptr);
+    free(keys);
+}
+
+// 用法：不带参数运行演示
+//      `bench [n]` 跑基准测试，默认10^7个键
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench(argc > 2 ? strtoull(argv[2], NULL, 10) : 10000000);
+        return 0;
+    }
+
+    Hashptr hptr = initHashTable(0);
+    insert(hptr, "key-1", "value-1");
+    insert(hptr, "key-2", "value-2");
+    insert(hptr, "key-3", "value-3");
+    insert(hptr, "key-4", "value-4");
+    insert(hptr, "key-5", "value-5");
+    printKeyValue(hptr);
+    // 插入第6个元素时entries用完，重建成32个槽位的索引
+    insert(hptr, "key-6", "value-6");
+    insert(hptr, "hello", "world");
+    printKeyValue(hptr);
+    // 更新不改变顺序，删除以后再插入排到最后
+    insert(hptr, "key-2", "value-2'");
+    erase(hptr, "key-3");
+    insert(hptr, "key-3", "value-3'");
+    erase(hptr, "hello");
+    erase(hptr, "helloni");
+    printKeyValue(hptr);
+    printf("find key-2: %s\n", find(hptr, "key-2"));
+#ifdef HASHSTATS
+    HashStats st = hashStats(hptr);
+    hashStatsPrint(&st);
+#endif
+    destroyHash(hptr);
+    return 0;
+}
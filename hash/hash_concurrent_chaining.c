@@ -0,0 +1,471 @@
+// 分离链接法实现的并发哈希表
+/*
+    模型
+        写操作（insert、erase）按哈希值的低位加分段锁，桶i由第 i % NLOCKS 把锁
+        保护。容量和NLOCKS都是2的幂，所以扩容前后同一个key用的都是同一把锁
+
+        读操作（findNode）不加锁：桶和next指针都是原子变量，写线程先把新结点
+        的next填好再发布到链表上，删除的时候只修改前一个结点的next，被删除的
+        结点自己的next保持不变，正在读它的线程还能继续往后走
+
+    内存回收（基于epoch，见ebr.h）
+        被删除的结点不能马上free，可能还有读线程在访问。读线程进入时记录
+        全局epoch，删除的结点放进待回收列表，等没有读线程能访问到再free
+
+    扩容
+        拿到全部分段锁之后把所有结点复制到新表，然后原子地替换表指针。
+        读线程在扩容期间继续读旧表，旧表和旧结点也通过epoch回收。
+        负载因子低于SHRINKLOAD时用同样的方式缩容，容量不会小于初始容量
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ebr.h"
+#include "hashstats.h"
+#include "wyhash.h"
+
+#define LOADFACTOR 0.75   // 触发扩容的负载因子
+#define SHRINKLOAD 0.1    // 触发缩容的负载因子
+#define NLOCKS 64         // 分段锁的数量，2的幂
+#define RECLAIMBATCH 256  // 待回收的对象攒够这么多个之后尝试回收一次
+#define CACHELINE 64
+
+// 链表结点
+typedef struct node {
+    _Atomic(struct node*) next;
+    uint64_t hash;               // 键的完整哈希值
+    const char* key;             // hash元素的键
+    _Atomic(const char*) value;  // hash元素的值，更新时原子替换
+} Node, *Nodeptr;
+
+// 一代哈希表数组，扩容的时候整个替换
+typedef struct table {
+    size_t cap;                 // 容量，2的幂
+    _Atomic(Nodeptr)* buckets;  // 每个桶指向链表的第一个结点
+} Table, *Tableptr;
+
+// 分段锁，每把锁单独占一个缓存行，避免伪共享
+typedef struct stripe {
+    _Alignas(CACHELINE) pthread_mutex_t lock;
+    size_t len;  // 这把锁保护的所有桶中的结点个数，只在持有锁的时候读写
+} Stripe;
+
+typedef struct hash {
+    _Atomic(Tableptr) table;   // 当前的哈希表数组
+    Stripe stripes[NLOCKS];    // 分段锁
+    pthread_mutex_t growLock;  // 同一时间只有一个线程扩容
+    size_t mincap;             // 缩容的下限，就是初始容量
+    Ebr ebr;                   // 回收删除的结点和旧表
+#ifdef HASHSTATS
+    HashCounters counters;  // 扩容次数和用时，只在持有growLock的时候修改
+#endif
+} Hash, *Hashptr;
+
+void errExit(const char* errMsg) {
+    fprintf(stderr, "%s\n", errMsg);
+    exit(EXIT_FAILURE);
+}
+
+void isNull(Hashptr hptr, const char* key) {
+    // 判断hash结构是否已经初始化
+    if (hptr == NULL) {
+        errExit("hptr is NULL");
+    }
+
+    // 判断键是否为空
+    if (key == NULL) {
+        errExit("key if NULL");
+    }
+}
+
+// 计算key的64位哈希值
+uint64_t hashKey(const char* key) {
+    return wyhashStr(key);
+}
+
+Tableptr newTable(size_t cap) {
+    Tableptr t = malloc(sizeof(Table));
+    if (t == NULL) {
+        errExit("out of memory");
+    }
+    t->cap = cap;
+    t->buckets = calloc(cap, sizeof(_Atomic(Nodeptr)));
+    if (t->buckets == NULL) {
+        errExit("out of memory");
+    }
+    return t;
+}
+
+// 释放旧表和旧表上的所有结点
+void freeTable(void* ptr) {
+    Tableptr t = ptr;
+    for (size_t i = 0; i < t->cap; i++) {
+        Nodeptr tmp = atomic_load_explicit(&t->buckets[i], memory_order_relaxed);
+        while (tmp != NULL) {
+            Nodeptr next = atomic_load_explicit(&tmp->next, memory_order_relaxed);
+            free(tmp);
+            tmp = next;
+        }
+    }
+    free(t->buckets);
+    free(t);
+}
+
+// 初始化哈希表，initcap会向上取到不小于NLOCKS的2的幂
+Hashptr initHashTable(size_t initcap) {
+    // 按缓存行对齐，分段锁和epoch记录才能各占一个缓存行
+    Hashptr hptr = aligned_alloc(CACHELINE, sizeof(Hash));
+    if (hptr == NULL) {
+        errExit("out of memory");
+    }
+    memset(hptr, 0, sizeof(Hash));
+    size_t cap = NLOCKS;
+    while (cap < initcap) {
+        cap <<= 1;
+    }
+    atomic_init(&hptr->table, newTable(cap));
+    hptr->mincap = cap;
+    for (int i = 0; i < NLOCKS; i++) {
+        pthread_mutex_init(&hptr->stripes[i].lock, NULL);
+    }
+    pthread_mutex_init(&hptr->growLock, NULL);
+    ebrInit(&hptr->ebr, RECLAIMBATCH);
+    return hptr;
+}
+
+// 销毁哈希表，调用者保证没有其他线程还在使用
+void destroyHash(Hashptr hptr) {
+    ebrDestroy(&hptr->ebr);
+    freeTable(atomic_load(&hptr->table));
+    free(hptr);
+}
+
+// 查找键对应的值，找不到返回NULL，不加锁
+// 返回的是值指针本身（调用者的内存），结点可能随时被删除，所以不返回结点
+const char* findNode(Hashptr hptr, const char* key) {
+    isNull(hptr, key);
+    uint64_t hash = hashKey(key);
+    const char* value = NULL;
+
+    ebrEnter(&hptr->ebr);
+    Tableptr t = atomic_load_explicit(&hptr->table, memory_order_acquire);
+    Nodeptr tmp = atomic_load_explicit(&t->buckets[hash & (t->cap - 1)],
+                                       memory_order_acquire);
+    while (tmp != NULL) {
+        if (tmp->hash == hash && strcmp(tmp->key, key) == 0) {
+            value = atomic_load_explicit(&tmp->value, memory_order_acquire);
+            break;
+        }
+        tmp = atomic_load_explicit(&tmp->next, memory_order_acquire);
+    }
+    ebrExit(&hptr->ebr);
+
+    return value;
+}
+
+// 加上key对应的分段锁，返回加锁时的哈希表数组
+// 扩容会拿走全部的锁，所以拿到锁之后表指针不会再变
+Tableptr lockStripe(Hashptr hptr, uint64_t hash) {
+    Stripe* s = &hptr->stripes[hash & (NLOCKS - 1)];
+    pthread_mutex_lock(&s->lock);
+    return atomic_load_explicit(&hptr->table, memory_order_acquire);
+}
+
+void unlockStripe(Hashptr hptr, uint64_t hash) {
+    pthread_mutex_unlock(&hptr->stripes[hash & (NLOCKS - 1)].lock);
+}
+
+// 负载因子超过LOADFACTOR时扩容两倍，低于SHRINKLOAD时缩容，
+// 缩到负载因子落在两个阈值中间，阈值附近反复插入删除不会来回扩容缩容。
+// 调用者只是按一把锁的结点数估算，这里拿到全部分段锁之后按准确的个数判断。
+// 复制所有结点到新表，读线程继续读旧表不受影响
+void resizeHash(Hashptr hptr) {
+    // 已经有线程在扩容了，不用重复扩容
+    if (pthread_mutex_trylock(&hptr->growLock) != 0) {
+        return;
+    }
+#ifdef HASHSTATS
+    double t0 = hashStatsNow();
+#endif
+    for (int i = 0; i < NLOCKS; i++) {
+        pthread_mutex_lock(&hptr->stripes[i].lock);
+    }
+
+    Tableptr old = atomic_load(&hptr->table);
+    size_t len = 0;
+    for (int i = 0; i < NLOCKS; i++) {
+        len += hptr->stripes[i].len;
+    }
+    size_t newcap = old->cap;
+    if ((float)len / (float)old->cap >= LOADFACTOR) {
+        newcap = old->cap * 2;
+    } else if ((float)len / (float)old->cap < SHRINKLOAD) {
+        float mid = (SHRINKLOAD + LOADFACTOR) / 2;
+        while (newcap > hptr->mincap && (float)len / (newcap / 2) < mid) {
+            newcap /= 2;
+        }
+    }
+    Tableptr t = NULL;
+    if (newcap != old->cap) {
+        t = newTable(newcap);
+        for (size_t i = 0; i < old->cap; i++) {
+            Nodeptr tmp = atomic_load_explicit(&old->buckets[i],
+                                               memory_order_relaxed);
+            for (; tmp != NULL; tmp = atomic_load_explicit(
+                                    &tmp->next, memory_order_relaxed)) {
+                Nodeptr node = malloc(sizeof(Node));
+                if (node == NULL) {
+                    errExit("out of memory");
+                }
+                size_t j = tmp->hash & (t->cap - 1);
+                node->hash = tmp->hash;
+                node->key = tmp->key;
+                atomic_init(&node->value, atomic_load(&tmp->value));
+                atomic_init(&node->next, atomic_load_explicit(
+                                             &t->buckets[j], memory_order_relaxed));
+                atomic_store_explicit(&t->buckets[j], node, memory_order_relaxed);
+            }
+        }
+        // 发布新表，之后的读线程都会读新表
+        atomic_store_explicit(&hptr->table, t, memory_order_release);
+    }
+
+    for (int i = NLOCKS - 1; i >= 0; i--) {
+        pthread_mutex_unlock(&hptr->stripes[i].lock);
+    }
+#ifdef HASHSTATS
+    if (t != NULL) {
+        hashCountersAdd(&hptr->counters, t0);
+    }
+#endif
+    pthread_mutex_unlock(&hptr->growLock);
+    if (t != NULL) {
+        ebrRetire(&hptr->ebr, old, freeTable);
+    }
+}
+
+#ifdef HASHSTATS
+// 和扩容一样拿到全部的锁，统计的是同一时刻的链长分布
+// 待回收列表里的旧结点和旧表不算在bytes里
+HashStats hashStats(Hashptr hptr) {
+    HashStats st;
+    pthread_mutex_lock(&hptr->growLock);
+    for (int i = 0; i < NLOCKS; i++) {
+        pthread_mutex_lock(&hptr->stripes[i].lock);
+    }
+    hashStatsInit(&st, &hptr->counters);
+    Tableptr t = atomic_load(&hptr->table);
+    for (size_t i = 0; i < t->cap; i++) {
+        size_t n = 0;
+        Nodeptr tmp = atomic_load_explicit(&t->buckets[i], memory_order_relaxed);
+        while (tmp != NULL) {
+            ++n;
+            tmp = atomic_load_explicit(&tmp->next, memory_order_relaxed);
+        }
+        hashStatsAdd(&st, n);
+        st.len += n;
+    }
+    st.cap = t->cap;
+    st.bytes = sizeof(Hash) + sizeof(Table) + t->cap * sizeof(Nodeptr) +
+               st.len * sizeof(Node);
+    for (int i = NLOCKS - 1; i >= 0; i--) {
+        pthread_mutex_unlock(&hptr->stripes[i].lock);
+    }
+    pthread_mutex_unlock(&hptr->growLock);
+    return st;
+}
+#endif
+
+void insert(Hashptr hptr, const char* key, const char* value) {
+    isNull(hptr, key);
+    if (value == NULL) {
+        errExit("value is null");
+    }
+    uint64_t hash = hashKey(key);
+    Stripe* s = &hptr->stripes[hash & (NLOCKS - 1)];
+
+    Tableptr t = lockStripe(hptr, hash);
+    _Atomic(Nodeptr)* head = &t->buckets[hash & (t->cap - 1)];
+    Nodeptr tmp = atomic_load_explicit(head, memory_order_relaxed);
+    while (tmp != NULL && (tmp->hash != hash || strcmp(tmp->key, key) != 0)) {
+        tmp = atomic_load_explicit(&tmp->next, memory_order_relaxed);
+    }
+    // 如果键已经存在，那么就原子地更新键值
+    if (tmp != NULL) {
+        atomic_store_explicit(&tmp->value, value, memory_order_release);
+        unlockStripe(hptr, hash);
+        return;
+    }
+    // 先把新结点填好，再发布到链表头部
+    Nodeptr newNode = malloc(sizeof(Node));
+    if (newNode == NULL) {
+        errExit("out of memory");
+    }
+    newNode->hash = hash;
+    newNode->key = key;
+    atomic_init(&newNode->value, value);
+    atomic_init(&newNode->next, atomic_load_explicit(head, memory_order_relaxed));
+    atomic_store_explicit(head, newNode, memory_order_release);
+    // 按这把锁的结点数估算整张表的负载因子
+    bool grow = (float)(++s->len * NLOCKS) / (float)t->cap >= LOADFACTOR;
+    unlockStripe(hptr, hash);
+
+    if (grow) {
+        resizeHash(hptr);
+    }
+}
+
+// 删除键值对，找不到就什么都不做
+void erase(Hashptr hptr, const char* key) {
+    isNull(hptr, key);
+    uint64_t hash = hashKey(key);
+
+    Stripe* s = &hptr->stripes[hash & (NLOCKS - 1)];
+
+    Tableptr t = lockStripe(hptr, hash);
+    _Atomic(Nodeptr)* prev = &t->buckets[hash & (t->cap - 1)];
+    Nodeptr tmp = atomic_load_explicit(prev, memory_order_relaxed);
+    while (tmp != NULL && (tmp->hash != hash || strcmp(tmp->key, key) != 0)) {
+        prev = &tmp->next;
+        tmp = atomic_load_explicit(prev, memory_order_relaxed);
+    }
+    if (tmp != NULL) {
+        // 只改前一个结点的next，tmp->next保持不变，正在读tmp的线程不受影响
+        atomic_store_explicit(
+            prev, atomic_load_explicit(&tmp->next, memory_order_relaxed),
+            memory_order_release);
+        --s->len;
+    }
+    // 和插入一样按这把锁的结点数估算负载因子
+    bool shrink = tmp != NULL && t->cap > hptr->mincap &&
+                  (float)(s->len * NLOCKS) / (float)t->cap < SHRINKLOAD;
+    unlockStripe(hptr, hash);
+
+    if (tmp != NULL) {
+        ebrRetire(&hptr->ebr, tmp, free);
+    }
+    if (shrink) {
+        resizeHash(hptr);
+    }
+}
+
+/*
+    基准测试
+        预先插入一半的键，每个线程按给定的读比例随机执行查找或者增删，
+        统计所有线程的总吞吐量
+*/
+
+#define KEYWIDTH 24
+
+typedef struct benchArg {
+    Hashptr hptr;
+    const char* keys;
+    size_t nkeys;
+    size_t ops;
+    int readPct;
+    uint64_t seed;
+    size_t hits;
+} BenchArg;
+
+double nowSec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+uint64_t nextRand(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+void* benchWorker(void* p) {
+    BenchArg* arg = p;
+    for (size_t i = 0; i < arg->ops; i++) {
+        uint64_t r = nextRand(&arg->seed);
+        const char* key = arg->keys + (r >> 8) % arg->nkeys * KEYWIDTH;
+        if ((int)(r % 100) < arg->readPct) {
+            arg->hits += findNode(arg->hptr, key) != NULL;
+        } else if (r & 0x80) {
+            insert(arg->hptr, key, key);
+        } else {
+            erase(arg->hptr, key);
+        }
+    }
+    return NULL;
+}
+
+void bench(size_t nkeys, size_t opsPerThread) {
+    const int threads[] = {1, 2, 4, 8, 16, 32};
+    const int reads[] = {50, 90, 95, 99};
+    char* keys = malloc(nkeys * KEYWIDTH);
+    if (keys == NULL) {
+        errExit("out of memory");
+    }
+    for (size_t i = 0; i < nkeys; i++) {
+        snprintf(keys + i * KEYWIDTH, KEYWIDTH, "key-%zu", i);
+    }
+
+    printf("keys: %zu ops/thread: %zu\n", nkeys, opsPerThread);
+    printf("%-8s %-8s %12s\n", "threads", "read%", "Mops/s");
+    for (size_t r = 0; r < sizeof(reads) / sizeof(reads[0]); r++) {
+        for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+            Hashptr hptr = initHashTable(1024);
+            for (size_t i = 0; i < nkeys; i += 2) {
+                insert(hptr, keys + i * KEYWIDTH, keys + i * KEYWIDTH);
+            }
+            int n = threads[t];
+            pthread_t tids[32];
+            BenchArg args[32];
+            double t0 = nowSec();
+            for (int i = 0; i < n; i++) {
+                BenchArg a = {hptr, keys, nkeys, opsPerThread, reads[r],
+                              0x9E3779B97F4A7C15ULL * (i + 1), 0};
+                args[i] = a;
+                pthread_create(&tids[i], NULL, benchWorker, &args[i]);
+            }
+            for (int i = 0; i < n; i++) {
+                pthread_join(tids[i], NULL);
+            }
+            double t1 = nowSec();
+            printf("%-8d %-8d %12.2f\n", n, reads[r],
+                   n * opsPerThread / (t1 - t0) / 1e6);
+            destroyHash(hptr);
+        }
+    }
+    free(keys);
+}
+
+// 用法：不带参数运行演示，`bench [keys] [ops]` 跑多线程吞吐量测试
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench(argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000,
+              argc > 3 ? strtoull(argv[3], NULL, 10) : 1000000);
+        return 0;
+    }
+
+    Hashptr hptr = initHashTable(4);
+    insert(hptr, "key-1", "value-1");
+    insert(hptr, "key-2", "value-2");
+    insert(hptr, "hello", "world");
+    insert(hptr, "key-1", "value-1-new");
+    printf("key-1: %s\n", findNode(hptr, "key-1"));
+    printf("hello: %s\n", findNode(hptr, "hello"));
+    erase(hptr, "key-2");
+    const char* v = findNode(hptr, "key-2");
+    printf("key-2: %s\n", v == NULL ? "not exists" : v);
+#ifdef HASHSTATS
+    HashStats st = hashStats(hptr);
+    hashStatsPrint(&st);
+#endif
+    destroyHash(hptr);
+    return 0;
+}
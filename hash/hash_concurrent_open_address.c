@@ -0,0 +1,700 @@
+// 无锁的开放定址哈希集合，键是int32_t
+/*
+    模型
+        每个槽位是一个64位的原子字，高32位是状态，低32位是键，
+        状态和键用一次CAS同时修改，不需要锁
+
+        slots--->+-----------+-----------+-----------+-----+
+                 | FULL | k0 | EMPTY | 0 | DEL  | k2 | ... |
+                 +-----------+-----------+-----------+-----+
+
+        EMPTY     空槽，探测到这里说明key不存在
+        FULL      key在集合中
+        DELETED   key被删除了，槽位仍然属于这个key，重新插入时直接改回FULL
+        MOVED     扩容时已经迁移到新表，遇到它就去帮忙迁移，然后到新表重试
+
+        容量是2的幂，线性探测。一个key在一张表里只会占一个槽位：
+        插入时沿探测序列找，遇到自己的槽位就在原地改状态，遇到EMPTY就用
+        CAS把它抢过来，CAS失败说明别的线程刚抢走，重新读同一个槽位再判断
+
+    扩容（协作式）
+        已用的槽（FULL加DELETED）超过MAXLOAD时，一个线程分配新表并用CAS
+        挂到旧表的next上。旧表按COPYCHUNK个槽位分块，插入、删除、查找遇到
+        next不为空或者MOVED的槽位时都来领块迁移：逐个槽位CAS成MOVED封住，
+        FULL的键复制到新表，DELETED直接丢掉，所以扩容同时也清掉了墓碑。
+        新表的大小按存活的元素个数算，墓碑多的时候可能和旧表一样大甚至更小。
+        最后一块迁完以后用CAS把新表发布成当前表，旧表通过epoch回收
+
+        迁移期间新表只有迁移线程在写，其他线程要等迁移完才能在新表上操作，
+        所以被封住的key不会在复制到新表之前被删除或者查到旧值。
+        等待只发生在扩容期间，其余时候所有操作都是无锁的
+
+    内存回收（基于epoch，见ebr.h）
+        读写线程进入时记录全局epoch，旧表替换以后放进待回收列表，
+        等没有线程能访问到再free。旧表很大而且替换得不频繁，每次都尝试回收
+*/
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ebr.h"
+#include "hashstats.h"
+
+#define MAXLOAD 0.5       // 已用的槽（元素加墓碑）占容量的最大比例
+#define TARGETLOAD 0.25   // 扩容以后元素占新表容量的比例
+#define MINCAP 1024       // 最小容量，2的幂
+#define COPYCHUNK 1024    // 迁移时每次领取的槽位数
+#define NCOUNTERS 16      // 计数器分成多少份，按哈希值分散，2的幂
+#define CACHELINE 64
+
+// 槽位的状态
+enum slotState { slotEmpty, slotFull, slotDeleted, slotMoved };
+
+#define SLOTWORD(state, key) ((uint64_t)(state) << 32 | (uint32_t)(key))
+#define SLOTSTATE(w) ((enum slotState)((w) >> 32))
+#define SLOTKEY(w) ((int32_t)(uint32_t)(w))
+
+// 分散的计数器，每份单独占一个缓存行，避免所有线程更新同一个缓存行
+typedef struct counter {
+    _Alignas(CACHELINE) _Atomic int64_t v;
+} Counter;
+
+// 一代哈希表数组，扩容的时候整个替换
+typedef struct table {
+    size_t cap;                     // 容量，2的幂
+    _Atomic uint64_t* slots;        // 槽位数组
+    Counter used[NCOUNTERS];        // 已用的槽位个数（元素加墓碑）
+    _Atomic(struct table*) next;    // 扩容的目标表，不在扩容时为NULL
+    _Alignas(CACHELINE) _Atomic size_t copyidx;  // 下一个要领取的块
+    _Alignas(CACHELINE) _Atomic size_t copydone;  // 已经迁移完的块数
+#ifdef HASHSTATS
+    double t0;  // 开始迁移到这张表的时间
+#endif
+} Table, *Tableptr;
+
+typedef struct hash {
+    _Atomic(Tableptr) table;  // 当前的哈希表数组
+    Counter live[NCOUNTERS];  // 元素个数，按哈希值分散
+    uint64_t seed;            // 哈希种子
+    Ebr ebr;                  // 回收旧表
+#ifdef HASHSTATS
+    HashCounters counters;  // 扩容次数和用时，只有发布新表的线程修改
+#endif
+} Hash, *Hashptr;
+
+void errExit(const char* errMsg) {
+    fprintf(stderr, "%s\n", errMsg);
+    exit(EXIT_FAILURE);
+}
+
+void freeTable(void* ptr) {
+    Tableptr t = ptr;
+    free(t->slots);
+    free(t);
+}
+
+// murmur3的64位终结函数
+uint64_t fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+uint64_t hashfunc(Hashptr hptr, int32_t key) {
+    return fmix64((uint32_t)key ^ hptr->seed);
+}
+
+// 计数器的下标取哈希值的高位，和槽位下标用的低位无关
+size_t counterIdx(uint64_t hash) {
+    return (hash >> 58) & (NCOUNTERS - 1);
+}
+
+int64_t sumCounters(Counter* c) {
+    int64_t sum = 0;
+    for (int i = 0; i < NCOUNTERS; i++) {
+        sum += atomic_load_explicit(&c[i].v, memory_order_relaxed);
+    }
+    return sum;
+}
+
+Tableptr newTable(size_t cap) {
+    Tableptr t = aligned_alloc(CACHELINE, sizeof(Table));
+    if (t == NULL) {
+        errExit("out of memory");
+    }
+    memset(t, 0, sizeof(Table));
+    t->cap = cap;
+    // 全部清零就是全部EMPTY
+    t->slots = calloc(cap, sizeof(uint64_t));
+    if (t->slots == NULL) {
+        errExit("out of memory");
+    }
+    atomic_init(&t->next, NULL);
+    return t;
+}
+
+// 初始化哈希表，initcap会向上取到不小于MINCAP的2的幂
+Hashptr initHashTable(size_t initcap) {
+    Hashptr hptr = aligned_alloc(CACHELINE, sizeof(Hash));
+    if (hptr == NULL) {
+        errExit("out of memory");
+    }
+    memset(hptr, 0, sizeof(Hash));
+    size_t cap = MINCAP;
+    while (cap < initcap) {
+        cap <<= 1;
+    }
+    atomic_init(&hptr->table, newTable(cap));
+    hptr->seed = 0x9E3779B97F4A7C15ULL;
+    ebrInit(&hptr->ebr, 1);
+    return hptr;
+}
+
+// 销毁哈希表，调用者保证没有其他线程还在使用
+void destroyHash(Hashptr hptr) {
+    ebrDestroy(&hptr->ebr);
+    freeTable(atomic_load(&hptr->table));
+    free(hptr);
+}
+
+// 把key放进迁移目标表，只有迁移线程调用，key在新表中一定不存在
+void copyKey(Hashptr hptr, Tableptr t, int32_t key) {
+    size_t mask = t->cap - 1;
+    size_t pos = hashfunc(hptr, key) & mask;
+    for (;;) {
+        uint64_t w = atomic_load_explicit(&t->slots[pos], memory_order_relaxed);
+        if (SLOTSTATE(w) == slotEmpty) {
+            // 别的迁移线程可能同时在抢这个槽位
+            if (atomic_compare_exchange_strong(&t->slots[pos], &w,
+                                               SLOTWORD(slotFull, key))) {
+                return;
+            }
+            continue;
+        }
+        pos = (pos + 1) & mask;
+    }
+}
+
+// 迁移第c块：逐个槽位封成MOVED，FULL的键复制到新表
+void copyChunk(Hashptr hptr, Tableptr t, Tableptr nt, size_t c) {
+    size_t end = (c + 1) * COPYCHUNK < t->cap ? (c + 1) * COPYCHUNK : t->cap;
+    int64_t copied[NCOUNTERS] = {0};
+    for (size_t i = c * COPYCHUNK; i < end; i++) {
+        uint64_t w = atomic_load(&t->slots[i]);
+        // CAS失败说明有线程刚改了这个槽位，w已经是新值，重新判断
+        while (!atomic_compare_exchange_weak(
+            &t->slots[i], &w, SLOTWORD(slotMoved, SLOTKEY(w)))) {
+        }
+        if (SLOTSTATE(w) == slotFull) {
+            copyKey(hptr, nt, SLOTKEY(w));
+            ++copied[counterIdx(hashfunc(hptr, SLOTKEY(w)))];
+        }
+    }
+    for (int i = 0; i < NCOUNTERS; i++) {
+        if (copied[i] != 0) {
+            atomic_fetch_add_explicit(&nt->used[i].v, copied[i],
+                                      memory_order_relaxed);
+        }
+    }
+}
+
+// 帮忙迁移t，返回时迁移已经完成，新表已经发布
+void helpMigrate(Hashptr hptr, Tableptr t) {
+    Tableptr nt = atomic_load(&t->next);
+    size_t nchunks = (t->cap + COPYCHUNK - 1) / COPYCHUNK;
+    for (;;) {
+        size_t c = atomic_fetch_add(&t->copyidx, 1);
+        if (c >= nchunks) {
+            break;
+        }
+        copyChunk(hptr, t, nt, c);
+        atomic_fetch_add(&t->copydone, 1);
+    }
+    // 剩下的块被别的线程领走了，等它们迁完
+    while (atomic_load(&t->copydone) < nchunks) {
+        sched_yield();
+    }
+    // 所有等待的线程都尝试发布，只有一个会成功
+    Tableptr expected = t;
+    if (atomic_compare_exchange_strong(&hptr->table, &expected, nt)) {
+#ifdef HASHSTATS
+        hashCountersAdd(&hptr->counters, nt->t0);
+#endif
+        ebrRetire(&hptr->ebr, t, freeTable);
+    }
+}
+
+// 按存活的元素个数分配新表，挂到t->next上，然后帮忙迁移
+// next挂上以后新开始的插入都会先去帮忙迁移，只有已经在探测中的插入还会
+// 落到旧表里，每个线程最多一个，所以新表至少有MINCAP个槽位就放得下
+void startResize(Hashptr hptr, Tableptr t) {
+    if (atomic_load(&t->next) == NULL) {
+        int64_t live = sumCounters(hptr->live);
+        size_t cap = MINCAP;
+        while ((double)live > cap * TARGETLOAD) {
+            cap <<= 1;
+        }
+        Tableptr nt = newTable(cap);
+#ifdef HASHSTATS
+        nt->t0 = hashStatsNow();
+#endif
+        Tableptr expected = NULL;
+        if (!atomic_compare_exchange_strong(&t->next, &expected, nt)) {
+            // 别的线程已经挂上了新表
+            freeTable(nt);
+        }
+    }
+    helpMigrate(hptr, t);
+}
+
+// 占用了一个EMPTY槽位，按这个计数器估算已用的槽位，超过MAXLOAD就扩容
+void claimSlot(Hashptr hptr, Tableptr t, uint64_t hash) {
+    int64_t used = atomic_fetch_add_explicit(&t->used[counterIdx(hash)].v, 1,
+                                             memory_order_relaxed) +
+                   1;
+    if ((double)(used * NCOUNTERS) > t->cap * MAXLOAD) {
+        startResize(hptr, t);
+    }
+}
+
+// 插入key，新插入返回true，已经存在返回false
+bool insert(Hashptr hptr, int32_t key) {
+    uint64_t hash = hashfunc(hptr, key);
+    bool inserted = false;
+    ebrEnter(&hptr->ebr);
+retry:;
+    Tableptr t = atomic_load(&hptr->table);
+    if (atomic_load(&t->next) != NULL) {
+        helpMigrate(hptr, t);
+        goto retry;
+    }
+    size_t mask = t->cap - 1;
+    size_t pos = hash & mask;
+    for (size_t i = 0; i < t->cap;) {
+        uint64_t w = atomic_load(&t->slots[pos]);
+        enum slotState state = SLOTSTATE(w);
+        if (state == slotMoved) {
+            helpMigrate(hptr, t);
+            goto retry;
+        }
+        if (state == slotEmpty) {
+            if (atomic_compare_exchange_strong(&t->slots[pos], &w,
+                                               SLOTWORD(slotFull, key))) {
+                inserted = true;
+                atomic_fetch_add_explicit(&hptr->live[counterIdx(hash)].v, 1,
+                                          memory_order_relaxed);
+                claimSlot(hptr, t, hash);
+                goto done;
+            }
+            // 被别的线程抢走了，重新看这个槽位
+            continue;
+        }
+        if (SLOTKEY(w) == key) {
+            if (state == slotFull) {
+                goto done;
+            }
+            // 自己的墓碑，原地改回FULL
+            if (atomic_compare_exchange_strong(&t->slots[pos], &w,
+                                               SLOTWORD(slotFull, key))) {
+                inserted = true;
+                atomic_fetch_add_explicit(&hptr->live[counterIdx(hash)].v, 1,
+                                          memory_order_relaxed);
+                goto done;
+            }
+            continue;
+        }
+        pos = (pos + 1) & mask;
+        ++i;
+    }
+    // 整张表都探测完了也没有空位
+    startResize(hptr, t);
+    goto retry;
+done:
+    ebrExit(&hptr->ebr);
+    return inserted;
+}
+
+// 删除key，删除了返回true，不存在返回false
+bool erase(Hashptr hptr, int32_t key) {
+    uint64_t hash = hashfunc(hptr, key);
+    bool erased = false;
+    ebrEnter(&hptr->ebr);
+retry:;
+    Tableptr t = atomic_load(&hptr->table);
+    if (atomic_load(&t->next) != NULL) {
+        helpMigrate(hptr, t);
+        goto retry;
+    }
+    size_t mask = t->cap - 1;
+    size_t pos = hash & mask;
+    for (size_t i = 0; i < t->cap;) {
+        uint64_t w = atomic_load(&t->slots[pos]);
+        enum slotState state = SLOTSTATE(w);
+        if (state == slotMoved) {
+            helpMigrate(hptr, t);
+            goto retry;
+        }
+        if (state == slotEmpty) {
+            break;
+        }
+        if (SLOTKEY(w) == key) {
+            if (state == slotDeleted) {
+                break;
+            }
+            if (atomic_compare_exchange_strong(&t->slots[pos], &w,
+                                               SLOTWORD(slotDeleted, key))) {
+                erased = true;
+                atomic_fetch_sub_explicit(&hptr->live[counterIdx(hash)].v, 1,
+                                          memory_order_relaxed);
+                break;
+            }
+            continue;
+        }
+        pos = (pos + 1) & mask;
+        ++i;
+    }
+    ebrExit(&hptr->ebr);
+    return erased;
+}
+
+// key是否在集合中
+// 不在扩容的时候只读不写；遇到MOVED说明正在扩容，帮忙迁移完再到新表查
+bool contains(Hashptr hptr, int32_t key) {
+    uint64_t hash = hashfunc(hptr, key);
+    bool found = false;
+    ebrEnter(&hptr->ebr);
+retry:;
+    Tableptr t = atomic_load(&hptr->table);
+    size_t mask = t->cap - 1;
+    size_t pos = hash & mask;
+    for (size_t i = 0; i < t->cap; i++) {
+        uint64_t w = atomic_load(&t->slots[pos]);
+        enum slotState state = SLOTSTATE(w);
+        if (state == slotMoved) {
+            helpMigrate(hptr, t);
+            goto retry;
+        }
+        if (state == slotEmpty) {
+            break;
+        }
+        if (SLOTKEY(w) == key) {
+            found = state == slotFull;
+            break;
+        }
+        pos = (pos + 1) & mask;
+    }
+    ebrExit(&hptr->ebr);
+    return found;
+}
+
+// 元素个数，其他线程同时在写的时候只是一个近似值
+size_t hashLen(Hashptr hptr) {
+    return (size_t)sumCounters(hptr->live);
+}
+
+#ifdef HASHSTATS
+// 统计每个元素的探测长度，调用者保证没有其他线程同时在写
+HashStats hashStats(Hashptr hptr) {
+    HashStats st;
+    hashStatsInit(&st, &hptr->counters);
+    Tableptr t = atomic_load(&hptr->table);
+    size_t mask = t->cap - 1;
+    for (size_t i = 0; i < t->cap; i++) {
+        uint64_t w = atomic_load(&t->slots[i]);
+        if (SLOTSTATE(w) == slotDeleted) {
+            ++st.tombstones;
+        }
+        if (SLOTSTATE(w) != slotFull) {
+            continue;
+        }
+        size_t home = hashfunc(hptr, SLOTKEY(w)) & mask;
+        hashStatsAdd(&st, ((i - home) & mask) + 1);
+        ++st.len;
+    }
+    st.cap = t->cap;
+    st.bytes = sizeof(Hash) + sizeof(Table) + t->cap * sizeof(uint64_t);
+    return st;
+}
+#endif
+
+double nowSec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+uint64_t nextRand(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// 压力测试
+/*
+    每个线程有一段自己的键，随机插入删除，自己记着每个键在不在；
+    所有线程还共同争抢一小段共享的键，记下每个键插入成功和删除成功的次数。
+    表从最小容量开始，过程中会反复扩容。结束以后检查：
+        自己的键：contains和自己记的一致
+        共享的键：所有线程插入成功的次数减删除成功的次数就是它现在在不在
+        整张表里没有重复的键，元素个数和计数器一致
+*/
+#define STRESSOWN 20000  // 每个线程自己的键的个数
+#define STRESSSHARED 64  // 共享的键的个数
+
+typedef struct stressArg {
+    Hashptr hptr;
+    int id;
+    size_t ops;
+    char* own;                     // 自己的键在不在
+    int64_t balance[STRESSSHARED];  // 共享的键插入成功减删除成功的次数
+    size_t errors;
+} StressArg;
+
+int32_t ownKey(int id, size_t i) {
+    return (int32_t)(STRESSSHARED + (size_t)id * STRESSOWN + i);
+}
+
+void* stressWorker(void* p) {
+    StressArg* arg = p;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL * (arg->id + 1);
+    for (size_t i = 0; i < arg->ops; i++) {
+        uint64_t r = nextRand(&seed);
+        int op = (r >> 8) % 3;
+        if (r & 1) {
+            size_t k = (r >> 16) % STRESSOWN;
+            int32_t key = ownKey(arg->id, k);
+            // 前半段多插入让表长大，后半段多删除让墓碑变多
+            if (op == 0 || (op == 1 && i < arg->ops / 2)) {
+                arg->errors += insert(arg->hptr, key) == arg->own[k];
+                arg->own[k] = 1;
+            } else if (op == 1) {
+                arg->errors += erase(arg->hptr, key) != arg->own[k];
+                arg->own[k] = 0;
+            } else {
+                arg->errors += contains(arg->hptr, key) != arg->own[k];
+            }
+        } else {
+            int32_t key = (int32_t)((r >> 16) % STRESSSHARED);
+            if (op == 0) {
+                arg->balance[key] += insert(arg->hptr, key);
+            } else if (op == 1) {
+                arg->balance[key] -= erase(arg->hptr, key);
+            } else {
+                contains(arg->hptr, key);
+            }
+        }
+    }
+    return NULL;
+}
+
+int cmpInt32(const void* a, const void* b) {
+    int32_t x = *(const int32_t*)a, y = *(const int32_t*)b;
+    return (x > y) - (x < y);
+}
+
+void stress(int nthreads, size_t ops) {
+    if (nthreads < 1 || nthreads > EBR_MAXTHREADS - 1) {
+        errExit("bad thread count");
+    }
+    Hashptr hptr = initHashTable(0);
+    pthread_t* tids = malloc(sizeof(pthread_t) * nthreads);
+    StressArg* args = calloc(nthreads, sizeof(StressArg));
+    if (tids == NULL || args == NULL) {
+        errExit("out of memory");
+    }
+    double t0 = nowSec();
+    for (int i = 0; i < nthreads; i++) {
+        args[i].hptr = hptr;
+        args[i].id = i;
+        args[i].ops = ops;
+        args[i].own = calloc(STRESSOWN, 1);
+        if (args[i].own == NULL) {
+            errExit("out of memory");
+        }
+        pthread_create(&tids[i], NULL, stressWorker, &args[i]);
+    }
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    double t1 = nowSec();
+
+    size_t errors = 0, live = 0;
+    for (int i = 0; i < nthreads; i++) {
+        errors += args[i].errors;
+        for (size_t k = 0; k < STRESSOWN; k++) {
+            errors += contains(hptr, ownKey(i, k)) != args[i].own[k];
+            live += args[i].own[k];
+        }
+    }
+    for (int32_t key = 0; key < STRESSSHARED; key++) {
+        int64_t balance = 0;
+        for (int i = 0; i < nthreads; i++) {
+            balance += args[i].balance[key];
+        }
+        errors += balance != (int64_t)contains(hptr, key);
+        live += contains(hptr, key);
+    }
+    // 表里的键排好序，相邻的相等就是重复
+    Tableptr t = atomic_load(&hptr->table);
+    int32_t* keys = malloc(sizeof(int32_t) * t->cap);
+    if (keys == NULL) {
+        errExit("out of memory");
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < t->cap; i++) {
+        uint64_t w = atomic_load(&t->slots[i]);
+        if (SLOTSTATE(w) == slotFull) {
+            keys[n++] = SLOTKEY(w);
+        }
+    }
+    qsort(keys, n, sizeof(int32_t), cmpInt32);
+    size_t dups = 0;
+    for (size_t i = 1; i < n; i++) {
+        dups += keys[i] == keys[i - 1];
+    }
+    printf("threads: %d ops: %zu time: %.3fs cap: %zu len: %zu\n", nthreads,
+           nthreads * ops, t1 - t0, t->cap, n);
+    printf("errors: %zu duplicates: %zu len mismatch: %d\n", errors, dups,
+           n != live || hashLen(hptr) != live);
+#ifdef HASHSTATS
+    HashStats st = hashStats(hptr);
+    hashStatsPrint(&st);
+#endif
+    if (errors != 0 || dups != 0 || n != live || hashLen(hptr) != live) {
+        errExit("stress test failed");
+    }
+    printf("ok\n");
+
+    free(keys);
+    for (int i = 0; i < nthreads; i++) {
+        free(args[i].own);
+    }
+    free(args);
+    free(tids);
+    destroyHash(hptr);
+}
+
+// 吞吐量测试
+/*
+    模拟多个线程对id去重：每次随机取一个id，多数是insert（已经存在就返回false），
+    少数是erase。对照组是把同一张表的每个操作都包在一把全局互斥锁里
+*/
+typedef struct benchArg {
+    Hashptr hptr;
+    pthread_mutex_t* lock;  // 对照组的全局锁，无锁版本为NULL
+    size_t nkeys;
+    size_t ops;
+    int insertPct;
+    uint64_t seed;
+    size_t hits;
+} BenchArg;
+
+void* benchWorker(void* p) {
+    BenchArg* arg = p;
+    for (size_t i = 0; i < arg->ops; i++) {
+        uint64_t r = nextRand(&arg->seed);
+        int32_t key = (int32_t)((r >> 8) % arg->nkeys);
+        if (arg->lock != NULL) {
+            pthread_mutex_lock(arg->lock);
+        }
+        if ((int)(r % 100) < arg->insertPct) {
+            arg->hits += insert(arg->hptr, key);
+        } else if ((int)(r % 100) < arg->insertPct + 5) {
+            erase(arg->hptr, key);
+        } else {
+            arg->hits += contains(arg->hptr, key);
+        }
+        if (arg->lock != NULL) {
+            pthread_mutex_unlock(arg->lock);
+        }
+    }
+    return NULL;
+}
+
+void bench(size_t nkeys, size_t opsPerThread) {
+    const int threads[] = {1, 2, 4, 8, 16, 32, 64};
+    const int inserts[] = {90, 50};
+    pthread_mutex_t lock;
+    pthread_mutex_init(&lock, NULL);
+
+    printf("keys: %zu ops/thread: %zu cpus: %ld\n", nkeys, opsPerThread,
+           sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-8s %-8s %12s %12s\n", "threads", "insert%", "lockfree",
+           "mutex");
+    for (size_t r = 0; r < sizeof(inserts) / sizeof(inserts[0]); r++) {
+        for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+            int n = threads[t];
+            double mops[2];
+            for (int locked = 0; locked <= 1; locked++) {
+                Hashptr hptr = initHashTable(0);
+                pthread_t tids[64];
+                BenchArg args[64];
+                double t0 = nowSec();
+                for (int i = 0; i < n; i++) {
+                    BenchArg a = {hptr, locked ? &lock : NULL, nkeys,
+                                  opsPerThread, inserts[r],
+                                  0x9E3779B97F4A7C15ULL * (i + 1), 0};
+                    args[i] = a;
+                    pthread_create(&tids[i], NULL, benchWorker, &args[i]);
+                }
+                for (int i = 0; i < n; i++) {
+                    pthread_join(tids[i], NULL);
+                }
+                double t1 = nowSec();
+                mops[locked] = n * opsPerThread / (t1 - t0) / 1e6;
+                destroyHash(hptr);
+            }
+            printf("%-8d %-8d %12.2f %12.2f\n", n, inserts[r], mops[0],
+                   mops[1]);
+        }
+    }
+    pthread_mutex_destroy(&lock);
+}
+
+// 用法：不带参数运行演示
+//      `stress [threads] [ops]` 多线程随机增删查并检查结果，默认8个线程，
+//                               每个线程10^6次操作
+//      `bench [keys] [ops]` 1到64个线程的吞吐量，和全局互斥锁对比，
+//                           默认10^6个键，每个线程10^6次操作
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "stress") == 0) {
+        stress(argc > 2 ? atoi(argv[2]) : 8,
+               argc > 3 ? strtoull(argv[3], NULL, 10) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench(argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000,
+              argc > 3 ? strtoull(argv[3], NULL, 10) : 1000000);
+        return 0;
+    }
+
+    Hashptr hptr = initHashTable(0);
+    int32_t arr[9] = {47, 7, 29, 11, 9, 87, 54, 20, 30};
+    for (int i = 0; i < 9; i++) {
+        insert(hptr, arr[i]);
+    }
+    printf("insert 47 again: %d\n", insert(hptr, 47));
+    printf("erase 29: %d\n", erase(hptr, 29));
+    printf("erase 29 again: %d\n", erase(hptr, 29));
+    printf("contains 29: %d contains 47: %d\n", contains(hptr, 29),
+           contains(hptr, 47));
+    printf("insert 29: %d len: %zu\n", insert(hptr, 29), hashLen(hptr));
+#ifdef HASHSTATS
+    HashStats st = hashStats(hptr);
+    hashStatsPrint(&st);
+#endif
+    destroyHash(hptr);
+    return 0;
+}
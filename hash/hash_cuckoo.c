@@ -0,0 +1,531 @@
+// 分桶的布谷鸟哈希表
+/*
+    模型
+        每个key有两个候选桶，b1和b2分别取64位哈希值的低位和高位，
+        每个桶有4个槽位，key只可能在这两个桶或者stash里。
+        一个桶32字节并且按32字节对齐，正好落在一条缓存行里，
+        所以查找最多访问两条缓存行（stash不为空时再加一条）
+
+        array--->+----+----+----+----+------+
+                 | k0 | k1 | k2 | k3 | used |  b1 = h & mask
+                 +----+----+----+----+------+
+                 |         ...              |
+                 +----+----+----+----+------+
+                 | k4 | k5 | k6 | k7 | used |  b2 = (h >> 32) & mask
+                 +----+----+----+----+------+
+
+    插入
+        两个候选桶都满了的时候，用BFS从b1、b2出发找一条最短的踢出路径：
+        路径上每个key都挪到它的另一个候选桶里，最后一个桶有空位。
+        然后从路径的末尾开始往回挪，每一步都是往空槽里写，
+        中途不会有key暂时无处可放。
+        找不到路径的话先放进stash，stash也满了就扩容
+
+    删除
+        直接清掉used里对应的位，没有墓碑。负载因子低于LOAD_FACTOR_MIN时缩容
+*/
+
+#include <memory.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hashstats.h"
+
+#define BUCKETSLOTS 4         // 每个桶的槽位数
+#define STASHSIZE 8           // stash的大小
+#define MAXBFS 512            // BFS最多访问的桶数
+#define LOAD_FACTOR_MAX 0.95  // 超过这个负载因子直接扩容
+#define LOAD_FACTOR_MIN 0.25  // 低于这个负载因子时缩容
+
+typedef struct bucket {
+    _Alignas(32) int32_t el[BUCKETSLOTS];
+    uint32_t used;  // 第i位为1表示el[i]被占用
+} Bucket, *Bucketptr;
+
+typedef struct hash {
+    Bucketptr array;           // 桶数组
+    float lfactor;             // 负载因子
+    size_t nbuckets;           // 桶的个数，2的幂
+    size_t cap;                // 槽位总数，nbuckets * BUCKETSLOTS
+    size_t len;                // 表的当前元素个数，包括stash
+    int32_t stash[STASHSIZE];  // 放不进桶里的元素
+    size_t stashlen;           // stash中的元素个数
+    uint64_t seed;             // 哈希种子
+    size_t minbuckets;         // 缩容的下限，就是初始的桶数
+#ifdef HASHSTATS
+    HashCounters counters;  // 扩容次数和用时
+#endif
+} Hash, *Hashptr;
+
+// BFS路径上的一个桶
+typedef struct bfsNode {
+    size_t bucket;  // 桶的下标
+    int parent;     // 上一个桶在队列中的下标，-1表示是b1或者b2
+    int slot;       // 上一个桶中哪个槽位的key要挪到这个桶
+} BfsNode;
+
+void errExit(const char* errMsg) {
+    fprintf(stderr, "%s\n", errMsg);
+    exit(EXIT_FAILURE);
+}
+
+void printInfo(Hashptr hptr) {
+    if (hptr == NULL) {
+        return;
+    }
+    printf("load factor: %0.2f\tlen: %zu\tcap: %zu\tstash: %zu\n",
+           hptr->lfactor, hptr->len, hptr->cap, hptr->stashlen);
+    for (size_t i = 0; i < hptr->nbuckets; i++) {
+        printf("%zu ", i);
+        for (int s = 0; s < BUCKETSLOTS; s++) {
+            if (hptr->array[i].used >> s & 1) {
+                printf(" %d", hptr->array[i].el[s]);
+            } else {
+                printf(" -");
+            }
+        }
+        printf("\n");
+    }
+    for (size_t i = 0; i < hptr->stashlen; i++) {
+        printf("stash %d\n", hptr->stash[i]);
+    }
+}
+
+// murmur3的64位终结函数
+uint64_t fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+// 计算key的两个候选桶，两个桶相同的时候第二个换成相邻的桶
+void hashfunc(Hashptr hptr, int32_t key, size_t b[2]) {
+    uint64_t h = fmix64((uint32_t)key ^ hptr->seed);
+    size_t mask = hptr->nbuckets - 1;
+    b[0] = h & mask;
+    b[1] = (h >> 32) & mask;
+    if (b[1] == b[0]) {
+        b[1] = b[0] ^ 1;
+    }
+}
+
+// key在bucket之外的另一个候选桶
+size_t altBucket(Hashptr hptr, int32_t key, size_t bucket) {
+    size_t b[2];
+    hashfunc(hptr, key, b);
+    return b[0] == bucket ? b[1] : b[0];
+}
+
+// 桶中第一个空槽，没有返回-1
+int freeSlot(Bucketptr bk) {
+    for (int s = 0; s < BUCKETSLOTS; s++) {
+        if (!(bk->used >> s & 1)) {
+            return s;
+        }
+    }
+    return -1;
+}
+
+// 如果找到就返回bucket * BUCKETSLOTS + slot，在stash中返回cap + i，
+// 找不到返回-1
+int64_t find(Hashptr hptr, int32_t key) {
+    size_t b[2];
+    hashfunc(hptr, key, b);
+    // 两个桶没有依赖关系，先发出第二个桶的访存
+    __builtin_prefetch(&hptr->array[b[1]]);
+    for (int k = 0; k < 2; k++) {
+        Bucketptr bk = &hptr->array[b[k]];
+        for (int s = 0; s < BUCKETSLOTS; s++) {
+            if ((bk->used >> s & 1) && bk->el[s] == key) {
+                return (int64_t)(b[k] * BUCKETSLOTS + s);
+            }
+        }
+    }
+    for (size_t i = 0; i < hptr->stashlen; i++) {
+        if (hptr->stash[i] == key) {
+            return (int64_t)(hptr->cap + i);
+        }
+    }
+    return -1;
+}
+
+void inithash(Hashptr hptr, size_t nbuckets) {
+    // 至少两个桶，保证两个候选桶可以不同
+    size_t n = 2;
+    while (n < nbuckets) {
+        n <<= 1;
+    }
+    hptr->nbuckets = n;
+    hptr->cap = n * BUCKETSLOTS;
+    hptr->len = 0;
+    hptr->lfactor = 0.0;
+    hptr->stashlen = 0;
+    hptr->array = aligned_alloc(64, sizeof(Bucket) * n);
+    if (hptr->array == NULL) {
+        errExit("out of memory");
+    }
+    memset(hptr->array, 0, sizeof(Bucket) * n);
+}
+
+// 沿着BFS找到的路径往回挪key，q[end]的slot号槽位的key挪到dst桶的空槽里
+// 每一步挪之前都检查一遍，路径经过同一个桶两次导致key已经变了的时候停下来，
+// 已经挪过的key都在自己的候选桶里，表仍然是正确的。
+// 成功的话rootb和roots是在b1或b2中空出来的槽位
+bool movePath(Hashptr hptr, BfsNode* q, int end, int slot, size_t dst,
+              size_t* rootb, int* roots) {
+    int cur = end;
+    while (true) {
+        Bucketptr from = &hptr->array[q[cur].bucket];
+        Bucketptr to = &hptr->array[dst];
+        int f = freeSlot(to);
+        if (f < 0 || !(from->used >> slot & 1) ||
+            altBucket(hptr, from->el[slot], q[cur].bucket) != dst) {
+            return false;
+        }
+        to->el[f] = from->el[slot];
+        to->used |= 1u << f;
+        from->used &= ~(1u << slot);
+        if (q[cur].parent < 0) {
+            *rootb = q[cur].bucket;
+            *roots = slot;
+            return true;
+        }
+        dst = q[cur].bucket;
+        slot = q[cur].slot;
+        cur = q[cur].parent;
+    }
+}
+
+// 用BFS找一条踢出路径并且挪出一个空位，成功的话把key放进去返回1
+// 找不到路径返回0，路径执行到一半停下来返回-1
+int insertByBfs(Hashptr hptr, int32_t key, const size_t b[2]) {
+    BfsNode q[MAXBFS];
+    int head = 0, tail = 0;
+    q[tail++] = (BfsNode){b[0], -1, -1};
+    q[tail++] = (BfsNode){b[1], -1, -1};
+    while (head < tail) {
+        size_t bucket = q[head].bucket;
+        for (int s = 0; s < BUCKETSLOTS; s++) {
+            size_t alt = altBucket(hptr, hptr->array[bucket].el[s], bucket);
+            if (freeSlot(&hptr->array[alt]) >= 0) {
+                size_t rootb;
+                int roots;
+                if (!movePath(hptr, q, head, s, alt, &rootb, &roots)) {
+                    return -1;
+                }
+                hptr->array[rootb].el[roots] = key;
+                hptr->array[rootb].used |= 1u << roots;
+                return 1;
+            }
+            if (tail < MAXBFS) {
+                q[tail++] = (BfsNode){alt, head, s};
+            }
+        }
+        ++head;
+    }
+    return 0;
+}
+
+// 调用者保证key不存在，放不下返回false
+bool insertIntoArray(Hashptr hptr, int32_t key) {
+    size_t b[2];
+    hashfunc(hptr, key, b);
+    bool ok = false;
+    // 两个候选桶有空位就直接放，否则找踢出路径。
+    // 路径执行到一半停下来的时候已经挪动了一些key，重新试一次
+    for (int retry = 0; retry < 4 && !ok; retry++) {
+        for (int k = 0; k < 2 && !ok; k++) {
+            Bucketptr bk = &hptr->array[b[k]];
+            int s = freeSlot(bk);
+            if (s >= 0) {
+                bk->el[s] = key;
+                bk->used |= 1u << s;
+                ok = true;
+            }
+        }
+        if (!ok) {
+            int r = insertByBfs(hptr, key, b);
+            ok = r > 0;
+            if (r == 0) {
+                break;
+            }
+        }
+    }
+    if (!ok && hptr->stashlen < STASHSIZE) {
+        hptr->stash[hptr->stashlen++] = key;
+        ok = true;
+    }
+    if (ok) {
+        ++hptr->len;
+        hptr->lfactor = (float)hptr->len / (float)hptr->cap;
+    }
+    return ok;
+}
+
+// 扩容到至少nbuckets个桶，重新放入所有元素，放不下就再翻倍
+void rehash(Hashptr hptr, size_t nbuckets) {
+#ifdef HASHSTATS
+    double t0 = hashStatsNow();
+#endif
+    Hash old = *hptr;
+    while (true) {
+        inithash(hptr, nbuckets);
+        bool ok = true;
+        for (size_t i = 0; i < old.nbuckets && ok; i++) {
+            for (int s = 0; s < BUCKETSLOTS && ok; s++) {
+                if (old.array[i].used >> s & 1) {
+                    ok = insertIntoArray(hptr, old.array[i].el[s]);
+                }
+            }
+        }
+        for (size_t i = 0; i < old.stashlen && ok; i++) {
+            ok = insertIntoArray(hptr, old.stash[i]);
+        }
+        if (ok) {
+            break;
+        }
+        free(hptr->array);
+        nbuckets = hptr->nbuckets * 2;
+    }
+    free(old.array);
+#ifdef HASHSTATS
+    hashCountersAdd(&hptr->counters, t0);
+#endif
+}
+
+void insert(Hashptr hptr, int32_t key) {
+    if (hptr == NULL) {
+        errExit("need to init before insert");
+    }
+    if (find(hptr, key) >= 0) {
+        return;
+    }
+    if ((float)(hptr->len + 1) / (float)hptr->cap > LOAD_FACTOR_MAX) {
+        rehash(hptr, hptr->nbuckets * 2);
+    }
+    while (!insertIntoArray(hptr, key)) {
+        rehash(hptr, hptr->nbuckets * 2);
+    }
+}
+
+// 删除之后看看stash里有没有可以放回这个桶的元素
+// 负载因子低于LOAD_FACTOR_MIN时缩容，新的负载因子落在两个阈值中间，
+// 在阈值附近反复插入删除不会来回扩容缩容
+void shrinkhash(Hashptr hptr) {
+    if (hptr->lfactor >= LOAD_FACTOR_MIN ||
+        hptr->nbuckets <= hptr->minbuckets) {
+        return;
+    }
+    size_t slots =
+        (size_t)(hptr->len / ((LOAD_FACTOR_MIN + LOAD_FACTOR_MAX) / 2));
+    size_t nbuckets = (slots + BUCKETSLOTS - 1) / BUCKETSLOTS;
+    if (nbuckets < hptr->minbuckets) {
+        nbuckets = hptr->minbuckets;
+    }
+    // inithash会向上取2的幂，取完以后不比现在小就不用缩
+    if (nbuckets * 2 <= hptr->nbuckets) {
+        rehash(hptr, nbuckets);
+    }
+}
+
+void erase(Hashptr hptr, int32_t key) {
+    if (hptr == NULL) {
+        errExit("need to init before erase");
+    }
+    int64_t found = find(hptr, key);
+    if (found < 0) {
+        return;
+    }
+    if ((size_t)found >= hptr->cap) {
+        size_t i = (size_t)found - hptr->cap;
+        hptr->stash[i] = hptr->stash[--hptr->stashlen];
+    } else {
+        size_t bucket = (size_t)found / BUCKETSLOTS;
+        int slot = (int)((size_t)found % BUCKETSLOTS);
+        hptr->array[bucket].used &= ~(1u << slot);
+        for (size_t i = 0; i < hptr->stashlen; i++) {
+            size_t b[2];
+            hashfunc(hptr, hptr->stash[i], b);
+            if (b[0] == bucket || b[1] == bucket) {
+                hptr->array[bucket].el[slot] = hptr->stash[i];
+                hptr->array[bucket].used |= 1u << slot;
+                hptr->stash[i] = hptr->stash[--hptr->stashlen];
+                break;
+            }
+        }
+    }
+    // 更新当前元素个数和负载因子
+    --hptr->len;
+    hptr->lfactor = (float)hptr->len / (float)hptr->cap;
+    shrinkhash(hptr);
+}
+
+Hashptr init(size_t initcap) {
+    Hashptr hptr = malloc(sizeof(Hash));
+    if (hptr == NULL) {
+        errExit("out of memory");
+    }
+    memset(hptr, 0, sizeof(Hash));
+    hptr->seed = 0x9E3779B97F4A7C15ULL;
+    inithash(hptr, (initcap + BUCKETSLOTS - 1) / BUCKETSLOTS);
+    hptr->minbuckets = hptr->nbuckets;
+    return hptr;
+}
+
+void destroy(Hashptr hptr) {
+    free(hptr->array);
+    free(hptr);
+}
+
+#ifdef HASHSTATS
+// 探测长度：在b1中是1，在b2中是2，在stash中是3，布谷鸟表没有墓碑
+HashStats hashStats(Hashptr hptr) {
+    HashStats st;
+    hashStatsInit(&st, &hptr->counters);
+    for (size_t i = 0; i < hptr->nbuckets; i++) {
+        for (int s = 0; s < BUCKETSLOTS; s++) {
+            if (hptr->array[i].used >> s & 1) {
+                size_t b[2];
+                hashfunc(hptr, hptr->array[i].el[s], b);
+                hashStatsAdd(&st, b[0] == i ? 1 : 2);
+            }
+        }
+    }
+    for (size_t i = 0; i < hptr->stashlen; i++) {
+        hashStatsAdd(&st, 3);
+    }
+    st.len = hptr->len;
+    st.cap = hptr->cap;
+    st.bytes = sizeof(Hash) + hptr->nbuckets * sizeof(Bucket);
+    return st;
+}
+#endif
+
+// xorshift伪随机数
+uint32_t nextRand(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (uint32_t)(*state >> 16);
+}
+
+double nowSec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int cmpDouble(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// 1. 固定大小的表不扩容一直插入，看第一次放不下时的负载因子
+// 2. 插入n个随机键，测平均查找时间，再逐个计时采样查找延迟的分位数
+void bench(size_t n) {
+    uint64_t seed = 88172645463325252ULL;
+    Hashptr hptr = init(1 << 20);
+    size_t stashed = 0;
+    while (true) {
+        int32_t key = (int32_t)nextRand(&seed);
+        if (find(hptr, key) >= 0) {
+            continue;
+        }
+        size_t before = hptr->stashlen;
+        if (!insertIntoArray(hptr, key)) {
+            break;
+        }
+        if (hptr->stashlen > before && stashed == 0) {
+            stashed = hptr->len;
+        }
+    }
+    printf("fixed %zu slots: first stash at load %.3f, full at load %.3f\n",
+           hptr->cap, (double)stashed / hptr->cap, hptr->lfactor);
+    destroy(hptr);
+
+    int32_t* keys = malloc(n * sizeof(int32_t));
+    if (keys == NULL) {
+        errExit("out of memory");
+    }
+    hptr = init(16);
+    double t0 = nowSec();
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = (int32_t)nextRand(&seed);
+        insert(hptr, keys[i]);
+    }
+    double t1 = nowSec();
+    size_t found = 0;
+    for (size_t i = 0; i < n; i++) {
+        found += find(hptr, keys[nextRand(&seed) % n]) >= 0;
+    }
+    double t2 = nowSec();
+    for (size_t i = 0; i < n; i++) {
+        found += find(hptr, (int32_t)nextRand(&seed)) >= 0;
+    }
+    double t3 = nowSec();
+    printf("keys: %zu len: %zu cap: %zu load: %.3f stash: %zu\n", n,
+           hptr->len, hptr->cap, hptr->lfactor, hptr->stashlen);
+#ifdef HASHSTATS
+    HashStats hs = hashStats(hptr);
+    hashStatsPrint(&hs);
+#endif
+    printf("insert: %.1f ns/op hit: %.1f ns/op miss: %.1f ns/op found: %zu\n",
+           (t1 - t0) / n * 1e9, (t2 - t1) / n * 1e9, (t3 - t2) / n * 1e9,
+           found);
+
+    // 单次查找的时间太短，计时本身的开销也算在里面，只看分位数之间的差别。
+    // 读时钟不会等前面的访存完成，用内存屏障把查找和计时隔开
+    size_t samples = 1000000;
+    double* lat = malloc(samples * sizeof(double));
+    if (lat == NULL) {
+        errExit("out of memory");
+    }
+    for (size_t i = 0; i < samples; i++) {
+        int32_t key = keys[nextRand(&seed) % n];
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        double s = nowSec();
+        found += find(hptr, key) >= 0;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        lat[i] = (nowSec() - s) * 1e9;
+    }
+    qsort(lat, samples, sizeof(double), cmpDouble);
+    printf("lookup ns p50: %.0f p99: %.0f p99.9: %.0f p99.99: %.0f max: %.0f\n",
+           lat[samples / 2], lat[samples * 99 / 100],
+           lat[samples * 999 / 1000], lat[samples * 9999 / 10000],
+           lat[samples - 1]);
+    free(lat);
+    free(keys);
+    destroy(hptr);
+}
+
+// 用法：不带参数运行演示，`bench [n]` 跑基准测试，默认10^7个键
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench(argc > 2 ? strtoull(argv[2], NULL, 10) : 10000000);
+        return 0;
+    }
+
+    int arr[9] = {47, 7, 29, 11, 9, 87, 54, 20, 30};
+    Hashptr hptr = init(8);
+    for (int i = 0; i < 9; i++) {
+        insert(hptr, arr[i]);
+    }
+    printInfo(hptr);
+    erase(hptr, 47);
+    printInfo(hptr);
+    printf("find 29: %lld\tfind 47: %lld\n", (long long)find(hptr, 29),
+           (long long)find(hptr, 47));
+#ifdef HASHSTATS
+    HashStats st = hashStats(hptr);
+    hashStatsPrint(&st);
+#endif
+    destroy(hptr);
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "oamap.h"
+#include "wyhash.h"
+
+// 泛型开放寻址哈希表的演示
+/*
+    OrderMap：int64_t -> Order，订单的内容直接存在槽里
+    WordMap：const char* -> int，用wyhash和strcmp实例化，统计单词出现次数
+*/
+
+typedef struct order {
+    double price;
+    int32_t qty;
+    char symbol[12];
+} Order;
+
+OAMAP_DEFINE(OrderMap, int64_t, Order, oamapHashInt, OAMAP_EQ)
+
+#define strEq(a, b) (strcmp((a), (b)) == 0)
+OAMAP_DEFINE(WordMap, const char*, int, wyhashStr, strEq)
+
+void errExit(const char* errMsg) {
+    fprintf(stderr, "%s\n", errMsg);
+    exit(EXIT_FAILURE);
+}
+
+double nowSec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// 插入n个订单，然后随机查找、删除一半、再查找一遍
+void bench(size_t n) {
+    OrderMap m;
+    if (OrderMapInit(&m, 16) != 0) {
+        errExit("out of memory");
+    }
+    double t0 = nowSec();
+    for (size_t i = 0; i < n; i++) {
+        Order o = {.price = i * 0.5, .qty = (int32_t)i};
+        if (OrderMapPut(&m, (int64_t)(i * 2654435761u), o) < 0) {
+            errExit("out of memory");
+        }
+    }
+    double t1 = nowSec();
+    uint64_t x = 88172645463325252ULL;
+    int64_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        Order* o = OrderMapFind(&m, (int64_t)((x % n) * 2654435761u));
+        if (o == NULL) {
+            errExit("key lost");
+        }
+        sum += o->qty;
+    }
+    double t2 = nowSec();
+    for (size_t i = 0; i < n; i += 2) {
+        OrderMapErase(&m, (int64_t)(i * 2654435761u));
+    }
+    double t3 = nowSec();
+    size_t found = 0;
+    for (size_t i = 0; i < n; i++) {
+        found += OrderMapFind(&m, (int64_t)(i * 2654435761u)) != NULL;
+    }
+    double t4 = nowSec();
+
+    printf("keys: %zu cap: %zu slot bytes: %zu checksum: %lld\n", n, m.cap,
+           sizeof(OrderMapSlot), (long long)sum);
+    printf("insert: %.1f ns/op\n", (t1 - t0) / n * 1e9);
+    printf("find:   %.1f ns/op\n", (t2 - t1) / n * 1e9);
+    printf("erase:  %.1f ns/op\n", (t3 - t2) / (n / 2) * 1e9);
+    printf("find after erase: %.1f ns/op found: %zu\n", (t4 - t3) / n * 1e9,
+           found);
+#ifdef HASHSTATS
+    HashStats st = OrderMapStats(&m);
+    hashStatsPrint(&st);
+#endif
+    OrderMapDestroy(&m);
+}
+
+// 用法：不带参数运行演示
+//      `bench [n]` 跑基准测试，默认10^7个键
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench(argc > 2 ? strtoull(argv[2], NULL, 10) : 10000000);
+        return 0;
+    }
+
+    // 订单表，值直接存在槽里，找到以后可以原地修改
+    OrderMap orders;
+    if (OrderMapInit(&orders, 0) != 0) {
+        errExit("out of memory");
+    }
+    OrderMapPut(&orders, 1001, (Order){101.5, 10, "AAPL"});
+    OrderMapPut(&orders, 1002, (Order){55.25, 200, "INTC"});
+    OrderMapPut(&orders, -7, (Order){9.75, 3, "F"});
+    Order* o = OrderMapFind(&orders, 1002);
+    if (o != NULL) {
+        o->qty += 50;
+    }
+    OrderMapErase(&orders, 1001);
+    int64_t ids[] = {1001, 1002, -7};
+    for (int i = 0; i < 3; i++) {
+        o = OrderMapFind(&orders, ids[i]);
+        if (o == NULL) {
+            printf("order %lld: not found\n", (long long)ids[i]);
+        } else {
+            printf("order %lld: %s %d @ %.2f\n", (long long)ids[i], o->symbol,
+                   o->qty, o->price);
+        }
+    }
+    OrderMapDestroy(&orders);
+
+    // 单词计数，键是字符串，哈希和比较换成wyhash和strcmp
+    const char* text[] = {"the", "quick", "brown", "fox", "jumps", "over",
+                          "the", "lazy",  "dog",   "the", "fox"};
+    WordMap words;
+    if (WordMapInit(&words, 0) != 0) {
+        errExit("out of memory");
+    }
+    for (size_t i = 0; i < sizeof(text) / sizeof(text[0]); i++) {
+        int* cnt = WordMapFind(&words, text[i]);
+        if (cnt != NULL) {
+            ++*cnt;
+        } else {
+            WordMapPut(&words, text[i], 1);
+        }
+    }
+    printf("words: %zu cap: %zu\n", words.len, words.cap);
+#ifdef HASHSTATS
+    HashStats st = WordMapStats(&words);
+    hashStatsPrint(&st);
+#endif
+    for (size_t i = 0; i < words.cap; i++) {
+        if (words.states[i] == OAMAP_FULL) {
+            printf("%s: %d\n", words.slots[i].key, words.slots[i].value);
+        }
+    }
+    WordMapDestroy(&words);
+    return 0;
+}
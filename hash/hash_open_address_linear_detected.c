@@ -1,15 +1,37 @@
+#include <fcntl.h>
 #include <memory.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
-#define LOAD_FACTOR_MAX 0.45
+#include "bloom.h"
+#include "hashstats.h"
+#include "wyhash.h"
+
+#define LOAD_FACTOR_MAX 0.45  // 元素加墓碑占容量的最大比例
+#define LOAD_FACTOR_MIN 0.1   // 低于这个负载因子时缩容
+#define TOMBSTONE_MAX 0.15    // 墓碑超过容量的这个比例时原地清理
+#define SNAP_MAGIC "OAHASH\0"  // 快照文件的魔数，8个字节
+#define SNAP_VERSION 2         // 快照格式的版本，格式变了就加一
 
 // legitimate：表示当前项已经被占用
 // empty：表示当前项可用
 // deleted：表示当前项已经被删除，但是为了完整性还保留着数据，可用
-enum kindOfState { legitimate, empty, deleted };
+// moving：原地清理墓碑时的临时状态，元素还没放到最终的位置
+enum kindOfState { legitimate, empty, deleted, moving };
+
+// 容量和下标的计算方式
+// primeFastmod：容量取素数，用预先算好的倒数做取模，不需要除法指令
+// powerOfTwo：容量取2的幂，先用murmur的fmix64把键打散，再用掩码取下标
+// primeModulo：容量取素数，直接用%取模，只用来和以前的实现对比
+enum indexMode { primeFastmod, powerOfTwo, primeModulo };
 
 typedef struct item {
     int32_t el;
@@ -17,12 +39,49 @@ typedef struct item {
 } Item, *Itemptr;
 
 typedef struct hash {
-    Itemptr array;  // 存储元素的数组
-    float lfactor;  // 负载因子
-    uint16_t cap;   // 表的容量
-    uint16_t len;   // 表的当前元素个数
+    Itemptr array;        // 存储元素的数组
+    float lfactor;        // 负载因子
+    size_t cap;           // 表的容量
+    size_t len;           // 表的当前元素个数
+    size_t deleted;       // 墓碑个数，和len一起算探测序列上被占用的槽
+    size_t mincap;        // 缩容的下限，就是初始容量
+    uint64_t seed;        // 哈希种子，快照里的表必须用同样的种子查找
+    enum indexMode mode;  // 容量和下标的计算方式
+    uint64_t fastM;       // primeFastmod模式下cap的倒数
+    size_t mask;          // powerOfTwo模式下的cap-1
+    void* map;            // 从快照mmap进来的只读表，不是的话为NULL
+    size_t mapsize;       // 映射的字节数
+    size_t bloombits;     // 布隆过滤器每个键的位数，0表示不用过滤器
+    Bloom bloom;          // 表中所有键的布隆过滤器
+#ifdef HASHSTATS
+    HashCounters counters;  // 扩容次数和用时
+#endif
 } Hash, *Hashptr;
 
+// 快照文件格式
+/*
+    +--------------------+---------------------------------+
+    | SnapHeader(64字节) | Item x cap（和内存中的数组一样）|
+    +--------------------+---------------------------------+
+
+    打开快照的时候直接把整个文件mmap进来，array指向头部后面的槽数组，
+    不需要逐个插入也不需要重新哈希。文件按本机的字节序和结构体布局写，
+    itemsize不一致的文件直接拒绝
+*/
+typedef struct snapHeader {
+    char magic[8];      // SNAP_MAGIC
+    uint32_t version;   // SNAP_VERSION
+    uint32_t itemsize;  // sizeof(Item)
+    uint64_t cap;       // 表的容量
+    uint64_t len;       // 表的元素个数
+    uint64_t seed;      // 哈希种子
+    uint64_t checksum;  // 槽数组的wyhash
+    uint32_t mode;      // 容量和下标的计算方式，enum indexMode
+    char pad[12];       // 凑够64字节，让槽数组按缓存行对齐
+} SnapHeader;
+
+int trace = 1;  // 是否打印探测和扩容的过程，跑基准测试时关掉
+
 void errExit(const char* errMsg) {
     fprintf(stderr, "%s\n", errMsg);
     exit(EXIT_FAILURE);
@@ -32,40 +91,36 @@ void printInfo(Hashptr hptr) {
     if (hptr == NULL) {
         return;
     }
-    printf("load factor: %0.2f\tlen: %d\tcap: %d\n", hptr->lfactor, hptr->len,
-           hptr->cap);
-    for (int i = 0; i < hptr->cap; i++) {
+    printf("load factor: %0.2f\tlen: %zu\tcap: %zu\n", hptr->lfactor,
+           hptr->len, hptr->cap);
+    for (size_t i = 0; i < hptr->cap; i++) {
         if (hptr->array[i].state == legitimate) {
-            printf("%d  %d\n", i, hptr->array[i].el);
+            printf("%zu  %d\n", i, hptr->array[i].el);
         } else {
-            printf("%d  %s\n", i, 0);
+            printf("%zu  -\n", i);
         }
     }
 }
 
 // 取素数
-bool isPrime(int16_t digit) {
+bool isPrime(size_t digit) {
     // 素数是指，大于1的任意自然数，除了可以被1和本身整除的数
     // 所以2是最小的素数
     if (digit <= 1) {
         return false;
     }
-    int i = 2;
-    for (; i < digit; i++) {
+    // 只需要试除到平方根，表很大的时候也很快
+    for (size_t i = 2; i * i <= digit; i++) {
         // 可以被整除，不是素数
         if (digit % i == 0) {
-            break;
+            return false;
         }
     }
-    // 循环自然结束，说明是素数
-    if (i == digit) {
-        return true;
-    }
-    return false;
+    return true;
 }
 
 // 一种获取比非素数大的最小素数的垃圾算法
-uint16_t upToPrime(int16_t num) {
+size_t upToPrime(size_t num) {
     while (true) {
         if (!isPrime(num)) {
             ++num;
@@ -76,27 +131,120 @@ uint16_t upToPrime(int16_t num) {
     return num;
 }
 
-uint16_t hashfunc(Hashptr hptr, uint16_t key) {
-    return key % hptr->cap;
+// 不小于num的最小的2的幂
+size_t upToPow2(size_t num) {
+    size_t cap = 1;
+    while (cap < num) {
+        cap <<= 1;
+    }
+    return cap;
+}
+
+// murmur3的64位终结函数，输入的每一位都会影响输出的每一位
+uint64_t fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+// Lemire的快速取模，a % d = ((M * a) 的低64位 * d) 的高64位
+// 其中M = 2^64 / d 向上取整，要求a和d都小于2^32
+uint64_t fastmodM(uint32_t d) {
+    return UINT64_MAX / d + 1;
+}
+
+uint32_t fastmod(uint32_t a, uint64_t M, uint32_t d) {
+    uint64_t low = M * a;
+    return (uint32_t)(((__uint128_t)low * d) >> 64);
+}
+
+// 根据模式和容量算好取下标需要的常量
+void setIndex(Hashptr hptr) {
+    hptr->mask = hptr->cap - 1;
+    hptr->fastM = hptr->mode == primeFastmod ? fastmodM(hptr->cap) : 0;
+}
+
+size_t hashfunc(Hashptr hptr, int32_t key) {
+    uint32_t k = (uint32_t)key ^ (uint32_t)hptr->seed;
+    switch (hptr->mode) {
+        case powerOfTwo:
+            return fmix64(k) & hptr->mask;
+        case primeFastmod:
+            return fastmod(k, hptr->fastM, hptr->cap);
+        default:
+            return k % hptr->cap;
+    }
+}
+
+// 布隆过滤器用的哈希值，和取下标用的哈希值种子不同，两者互不相关
+uint64_t bloomHash(Hashptr hptr, int32_t key) {
+    return fmix64((uint32_t)key ^ ~hptr->seed);
+}
+
+// 按当前容量能放的键数分配空的布隆过滤器
+void newBloom(Hashptr hptr) {
+    bloomDestroy(&hptr->bloom);
+    if (bloomInit(&hptr->bloom, (size_t)(hptr->cap * LOAD_FACTOR_MAX) + 1,
+                  hptr->bloombits) != 0) {
+        errExit("out of memory");
+    }
+}
+
+// 按表中现有的键重建布隆过滤器，删掉的键的位也就清掉了
+void rebuildBloom(Hashptr hptr) {
+    newBloom(hptr);
+    for (size_t i = 0; i < hptr->cap; i++) {
+        if (hptr->array[i].state == legitimate) {
+            bloomAdd(&hptr->bloom, bloomHash(hptr, hptr->array[i].el));
+        }
+    }
+}
+
+// 打开或者关闭查找前面的布隆过滤器，bitsPerKey为0表示关闭
+// 不存在的键要一直探测到empty，负载因子高、墓碑多的时候探测序列很长，
+// 过滤器挡掉的查找只访问一个缓存行
+void setBloom(Hashptr hptr, size_t bitsPerKey) {
+    bloomDestroy(&hptr->bloom);
+    hptr->bloombits = bitsPerKey;
+    if (bitsPerKey != 0) {
+        rebuildBloom(hptr);
+    }
+}
+
+// 探测序列的第i个位置，pos是第i-1个位置
+size_t nextPos(Hashptr hptr, size_t pos, size_t i) {
+    if (hptr->mode == powerOfTwo) {
+        // 三角数探测，hash_pos + i(i+1)/2，容量是2的幂时能走遍所有位置
+        return (pos + i) & hptr->mask;
+    }
+    // 平方探测法，hash_pos + i*i，每次加2i-1，不需要取模
+    // 容量是素数并且负载因子小于0.5时一定能找到空位
+    pos += 2 * i - 1;
+    while (pos >= hptr->cap) {
+        pos -= hptr->cap;
+    }
+    return pos;
 }
 
 // 如果找到就返回该key所在的散列表项的索引，找不到返回
 // 返回的情况还有一个，那就是新插入的key已经存在，那么也会返回
 // 该函数的调用者会判断表项的状态来决定具体怎么做
-uint16_t find(Hashptr hptr, uint16_t key) {
-    uint16_t pos = hashfunc(hptr, key);
+size_t find(Hashptr hptr, int32_t key) {
+    size_t pos = hashfunc(hptr, key);
     // hash_pos用于调试
-    uint16_t hash_pos = pos;
-    uint16_t i = 0;
+    size_t hash_pos = pos;
+    size_t i = 0;
     while (hptr->array[pos].state != empty && hptr->array[pos].el != key) {
         // 线性探测法
         // ++pos;
-        uint16_t pre_pos = pos;
-        // 平方探测法
-        pos = 1 << ++i - 1;
-        pos = pos % hptr->cap;
-        printf("key[%d] hash pos[%d] next detected pos[%d]\n", key, hash_pos,
-               pos);
+        pos = nextPos(hptr, pos, ++i);
+        if (trace) {
+            printf("key[%d] hash pos[%zu] next detected pos[%zu]\n", key,
+                   hash_pos, pos);
+        }
         // 当i递增的次数达到表的大小时不在探测
         if (i >= hptr->cap - 1) {
             break;
@@ -105,105 +253,1163 @@ uint16_t find(Hashptr hptr, uint16_t key) {
     return pos;
 }
 
-void inithash(Hashptr hptr, uint16_t initcap) {
+// key是否在表中，过滤器确定不在的键不需要探测
+bool contains(Hashptr hptr, int32_t key) {
+    if (hptr->bloombits != 0 &&
+        !bloomMayContain(&hptr->bloom, bloomHash(hptr, key))) {
+        return false;
+    }
+    Itemptr item = &hptr->array[find(hptr, key)];
+    return item->state == legitimate && item->el == key;
+}
+
+void inithash(Hashptr hptr, size_t initcap) {
     hptr->lfactor = 0.0;
     hptr->len = 0;
-    // 取素数
-    hptr->cap = upToPrime(initcap);
+    hptr->deleted = 0;
+    if (hptr->mode == powerOfTwo) {
+        hptr->cap = upToPow2(initcap);
+    } else {
+        // 取素数
+        hptr->cap = upToPrime(initcap);
+        if (hptr->cap > UINT32_MAX) {
+            errExit("capacity is too large for prime mode");
+        }
+    }
+    setIndex(hptr);
     hptr->array = malloc(sizeof(Item) * hptr->cap);
+    hptr->map = NULL;
+    hptr->mapsize = 0;
     if (hptr->array == NULL) {
         errExit("out of memory");
     }
     memset(hptr->array, 0, sizeof(Item) * hptr->cap);
     // 初始化数组的每个项，都设置为empty
-    for (int i = 0; i < hptr->cap; i++) {
+    for (size_t i = 0; i < hptr->cap; i++) {
         hptr->array[i].state = empty;
     }
 }
 
-void insertIntoArray(Hashptr hptr, uint16_t key) {
-    uint16_t i = find(hptr, key);
+void insertIntoArray(Hashptr hptr, int32_t key) {
+    size_t i = find(hptr, key);
     // 只要不是legitimate状态就可以插入这个元素
     // 即使是deleted也无关紧要，deleted存在的初衷是为了保证表的完整性
     // 可以防止删除元素之后查找失效的问题。用新的元素覆盖掉已经删除元素
     // 的数据并不影响后面的查找
     if (hptr->array[i].state != legitimate) {
+        if (hptr->array[i].state == deleted) {
+            --hptr->deleted;
+        }
         hptr->array[i].el = key;
         hptr->array[i].state = legitimate;
+        if (hptr->bloombits != 0) {
+            bloomAdd(&hptr->bloom, bloomHash(hptr, key));
+        }
         // 更新负载因子和长度
         ++hptr->len;
         hptr->lfactor = (float)hptr->len / (float)hptr->cap;
     }
 }
 
+// 把元素迁移到容量为newcap的新数组，墓碑丢掉，扩容和缩容都用它
+void resizehash(Hashptr hptr, size_t newcap) {
+#ifdef HASHSTATS
+    double t0 = hashStatsNow();
+#endif
+    size_t oldcap = hptr->cap;
+    // 取出旧数组
+    Itemptr oldArray = hptr->array;
+    // 重新初始化哈希表，过滤器按新容量重建，迁移的时候重新放进去
+    inithash(hptr, newcap);
+    if (hptr->bloombits != 0) {
+        newBloom(hptr);
+    }
+    // 迁移数组元素
+    for (size_t i = 0; i < oldcap; i++) {
+        if (oldArray[i].state == legitimate) {
+            insertIntoArray(hptr, oldArray[i].el);
+        }
+    }
+    // 释放旧数组数据，大数组是单独mmap的，free的时候直接还给系统
+    free(oldArray);
+#ifdef HASHSTATS
+    hashCountersAdd(&hptr->counters, t0);
+#endif
+}
+
+// 原地清理墓碑，不需要另外分配一个数组
+/*
+    1. 墓碑全部改成empty，元素全部改成moving
+    2. 从头扫描，每个moving的元素沿着自己的探测序列找第一个不是legitimate
+       的位置p，p一定不会在元素当前位置的后面：
+         p就是当前位置：原地不动，改成legitimate
+         p是empty：搬过去，当前位置变成empty
+         p是moving：两个元素交换，当前位置换来的元素接着处理
+    legitimate的槽不会再变，所以每个元素探测序列上它前面的槽最后都是
+    legitimate，查找不会提前停下。每次交换都多放好一个元素，总共O(cap)
+*/
+void purgeTombstones(Hashptr hptr) {
+    if (trace) {
+        printf("purge %zu tombstones...\n", hptr->deleted);
+    }
+#ifdef HASHSTATS
+    double t0 = hashStatsNow();
+#endif
+    Itemptr a = hptr->array;
+    for (size_t j = 0; j < hptr->cap; j++) {
+        if (a[j].state == deleted) {
+            a[j].state = empty;
+        } else if (a[j].state == legitimate) {
+            a[j].state = moving;
+        }
+    }
+    for (size_t j = 0; j < hptr->cap; j++) {
+        while (a[j].state == moving) {
+            size_t pos = hashfunc(hptr, a[j].el);
+            size_t i = 0;
+            while (a[pos].state == legitimate && i < hptr->cap) {
+                pos = nextPos(hptr, pos, ++i);
+            }
+            if (pos == j) {
+                a[j].state = legitimate;
+            } else if (a[pos].state == empty) {
+                a[pos].el = a[j].el;
+                a[pos].state = legitimate;
+                a[j].state = empty;
+            } else {
+                int32_t el = a[pos].el;
+                a[pos].el = a[j].el;
+                a[pos].state = legitimate;
+                a[j].el = el;
+            }
+        }
+    }
+    hptr->deleted = 0;
+    // 墓碑清掉了，过滤器里删掉的键也一起清掉
+    if (hptr->bloombits != 0) {
+        rebuildBloom(hptr);
+    }
+#ifdef HASHSTATS
+    hashCountersAdd(&hptr->counters, t0);
+#endif
+}
+
 // 扩容哈希表
+// 平方探测要求被占用的槽（元素加墓碑）少于一半，所以墓碑也要算上。
+// 元素本身不多、主要是墓碑的时候原地清理墓碑就够了
 void growhash(Hashptr hptr) {
-    if (hptr->lfactor >= LOAD_FACTOR_MAX) {
-        printf("grow...\n");
-        uint16_t oldcap = hptr->cap;
+    if ((float)(hptr->len + hptr->deleted) / (float)hptr->cap >=
+        LOAD_FACTOR_MAX) {
+        if (hptr->lfactor < LOAD_FACTOR_MAX / 2) {
+            purgeTombstones(hptr);
+            return;
+        }
+        if (trace) {
+            printf("grow...\n");
+        }
         // 扩容了两倍
-        uint16_t doublecap = oldcap + oldcap;
-        // 取出旧数组
-        Itemptr oldArray = hptr->array;
-        // 重新初始化哈希表
-        inithash(hptr, doublecap);
-        // 迁移数组元素
-        for (int i = 0; i < oldcap; i++) {
-            if (oldArray[i].state == legitimate) {
-                insertIntoArray(hptr, oldArray[i].el);
+        resizehash(hptr, hptr->cap + hptr->cap);
+    }
+}
+
+// 删除之后检查要不要缩容或者清理墓碑
+// 缩容以后的负载因子在LOAD_FACTOR_MIN和LOAD_FACTOR_MAX中间，
+// 两边都留有余地，在阈值附近插入删除不会反复扩容缩容
+void shrinkhash(Hashptr hptr) {
+    if (hptr->lfactor < LOAD_FACTOR_MIN && hptr->cap > hptr->mincap) {
+        size_t newcap =
+            (size_t)(hptr->len / ((LOAD_FACTOR_MIN + LOAD_FACTOR_MAX) / 2));
+        if (newcap < hptr->mincap) {
+            newcap = hptr->mincap;
+        }
+        if (newcap < hptr->cap) {
+            if (trace) {
+                printf("shrink...\n");
             }
+            resizehash(hptr, newcap);
+            return;
         }
-        // 释放旧数组数据
-        free(oldArray);
+    }
+    if (hptr->deleted > hptr->cap * TOMBSTONE_MAX) {
+        purgeTombstones(hptr);
     }
 }
 
-void insert(Hashptr hptr, uint16_t key) {
+void insert(Hashptr hptr, int32_t key) {
     if (hptr == NULL) {
         errExit("need to init before insert");
     }
+    if (hptr->map != NULL) {
+        errExit("snapshot table is read-only");
+    }
     // 忽略array的检查
     growhash(hptr);
     insertIntoArray(hptr, key);
+    // 反复删除又插入新键的时候过滤器里删掉的键越积越多，
+    // 放进去的键超过预计个数的两倍就重建
+    if (hptr->bloombits != 0 && hptr->bloom.added > hptr->bloom.capacity * 2) {
+        rebuildBloom(hptr);
+    }
 }
 
-void erase(Hashptr hptr, uint16_t key) {
+void erase(Hashptr hptr, int32_t key) {
     if (hptr == NULL) {
         errExit("need to init before erase");
     }
+    if (hptr->map != NULL) {
+        errExit("snapshot table is read-only");
+    }
     // 忽略array的检查
-    uint16_t i = find(hptr, key);
+    if (hptr->bloombits != 0 &&
+        !bloomMayContain(&hptr->bloom, bloomHash(hptr, key))) {
+        if (trace) {
+            printf("key[%d] does not exits\n", key);
+        }
+        return;
+    }
+    size_t i = find(hptr, key);
     if (hptr->array[i].state != legitimate) {
-        printf("key[%d] does not exits\n", key);
+        if (trace) {
+            printf("key[%d] does not exits\n", key);
+        }
         return;
     }
     // 懒惰删除
     // 不清空数据，只是标记这个元素呈删除状态
     hptr->array[i].state = deleted;
+    ++hptr->deleted;
     // 更新当前元素个数
     --hptr->len;
     // 更新负载因子
     hptr->lfactor = (float)hptr->len / (float)hptr->cap;
-    printf("deleted key: %d\n", key);
+    if (trace) {
+        printf("deleted key: %d\n", key);
+    }
+    shrinkhash(hptr);
 }
 
-Hashptr init(uint16_t initcap) {
+// 用指定的容量模式初始化哈希表
+Hashptr initWithMode(size_t initcap, enum indexMode mode) {
     Hashptr hptr = malloc(sizeof(Hash));
     if (hptr == NULL) {
         errExit("out of memory");
     }
     memset(hptr, 0, sizeof(Hash));
+    hptr->mode = mode;
     inithash(hptr, initcap);
+    hptr->mincap = hptr->cap;
+    return hptr;
+}
+
+Hashptr init(size_t initcap) {
+    return initWithMode(initcap, primeFastmod);
+}
+
+#ifdef HASHSTATS
+// 统计每个元素的探测长度：从初始位置沿着探测序列走到元素所在的位置
+// 一共访问了几个槽位。deleted状态的槽位就是墓碑
+HashStats hashStats(Hashptr hptr) {
+    HashStats st;
+    hashStatsInit(&st, &hptr->counters);
+    for (size_t j = 0; j < hptr->cap; j++) {
+        if (hptr->array[j].state == deleted) {
+            ++st.tombstones;
+        }
+        if (hptr->array[j].state != legitimate) {
+            continue;
+        }
+        size_t pos = hashfunc(hptr, hptr->array[j].el);
+        size_t i = 0;
+        while (pos != j && i < hptr->cap) {
+            pos = nextPos(hptr, pos, ++i);
+        }
+        hashStatsAdd(&st, i + 1);
+    }
+    st.len = hptr->len;
+    st.cap = hptr->cap;
+    st.bytes = sizeof(Hash) + hptr->cap * sizeof(Item) +
+               bloomBytes(&hptr->bloom);
+    return st;
+}
+#endif
+
+// 释放哈希表，快照表只需要解除映射
+void destroy(Hashptr hptr) {
+    bloomDestroy(&hptr->bloom);
+    if (hptr->map != NULL) {
+        munmap(hptr->map, hptr->mapsize);
+    } else {
+        free(hptr->array);
+    }
+    free(hptr);
+}
+
+// 按哈希值高位分区的集合，批量操作在线程池上按分区并行
+/*
+    模型
+        键按 fmix64(key ^ seed) 的最高bits位分到 2^bits 个分区，每个分区是一张
+        独立的powerOfTwo模式的哈希表。分区内取下标用的是哈希值的低位，
+        和分区号用的高位互不相关，所以每个分区里的键仍然是均匀分布的
+
+        PartSet
+        +--------+     +--------+--------+-----+--------+
+        | parts  |---->| Hash 0 | Hash 1 | ... | Hash P |
+        | bits   |     +--------+--------+-----+--------+
+        +--------+
+
+        两个用同样bits和seed建出来的集合，同一个键一定落在同号的分区里，
+        所以并、交、差可以每个分区单独做：一个线程领一个分区，只读两个输入
+        的第p个分区，只写输出的第p个分区，不需要任何锁。
+        输出分区按结果大小的上界预先分配好，做的过程中不会扩容
+
+    bulkInsert
+        1. 把输入切成和线程数一样多的段，每段统计落到每个分区的键数
+        2. 串行算前缀和，得到每段每个分区在临时数组里的起始位置
+        3. 每段把键分散到临时数组，同一个分区的键排在一起
+        4. 每个分区先按已有的加新来的键数预先扩容，再逐个插入
+*/
+
+#define PART_BITS 6  // 默认分区数 2^6
+
+// 简单的线程池，只支持parallelFor：把ntasks个任务分给所有线程，等全部做完
+typedef struct threadPool {
+    pthread_t* tids;
+    int nthreads;              // 工作线程数，调用parallelFor的线程也会干活
+    pthread_mutex_t lock;
+    pthread_cond_t start;      // 有新的一批任务
+    pthread_cond_t finish;     // 一批任务全部做完
+    void (*fn)(void* ctx, size_t task);
+    void* ctx;
+    size_t ntasks;
+    atomic_size_t next;        // 下一个要领取的任务
+    size_t running;            // 还在干这一批任务的工作线程数
+    uint64_t generation;       // 第几批任务，工作线程靠它判断有没有新任务
+    bool stop;
+} ThreadPool;
+
+// 不停地领任务直到领完
+void runTasks(ThreadPool* pool) {
+    for (;;) {
+        size_t task = atomic_fetch_add(&pool->next, 1);
+        if (task >= pool->ntasks) {
+            return;
+        }
+        pool->fn(pool->ctx, task);
+    }
+}
+
+void* poolWorker(void* p) {
+    ThreadPool* pool = p;
+    uint64_t seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->stop && pool->generation == seen) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->stop) {
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+        runTasks(pool);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0) {
+            pthread_cond_signal(&pool->finish);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// 创建有nthreads个线程干活的线程池，其中一个是调用parallelFor的线程
+ThreadPool* newThreadPool(int nthreads) {
+    ThreadPool* pool = calloc(1, sizeof(ThreadPool));
+    if (pool == NULL || nthreads < 1) {
+        errExit("bad thread pool");
+    }
+    pool->nthreads = nthreads - 1;
+    pool->tids = malloc(sizeof(pthread_t) * nthreads);
+    if (pool->tids == NULL) {
+        errExit("out of memory");
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->finish, NULL);
+    for (int i = 0; i < pool->nthreads; i++) {
+        if (pthread_create(&pool->tids[i], NULL, poolWorker, pool) != 0) {
+            errExit("pthread_create failed");
+        }
+    }
+    return pool;
+}
+
+void destroyThreadPool(ThreadPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->nthreads; i++) {
+        pthread_join(pool->tids[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->finish);
+    free(pool->tids);
+    free(pool);
+}
+
+// 对0到ntasks-1的每个task调用fn(ctx, task)，全部做完才返回
+void parallelFor(ThreadPool* pool, size_t ntasks,
+                 void (*fn)(void* ctx, size_t task), void* ctx) {
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->ntasks = ntasks;
+    atomic_store(&pool->next, 0);
+    pool->running = pool->nthreads;
+    ++pool->generation;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    runTasks(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running > 0) {
+        pthread_cond_wait(&pool->finish, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+typedef struct partSet {
+    Hashptr* parts;  // 2^bits个分区
+    int bits;        // 分区号的位数
+    uint64_t seed;   // 所有分区共用的哈希种子
+} PartSet;
+
+// key所在的分区
+size_t partOf(const PartSet* s, int32_t key) {
+    return s->bits ? fmix64((uint32_t)key ^ s->seed) >> (64 - s->bits) : 0;
+}
+
+// 能放下n个键不触发扩容的容量
+size_t capFor(size_t n) {
+    size_t cap = (size_t)(n / LOAD_FACTOR_MAX) + 1;
+    return cap < 16 ? 16 : cap;
+}
+
+// 创建分区集合，expected是预计的元素个数，按它预先分配每个分区
+PartSet* initPartSet(int bits, size_t expected) {
+    if (bits < 0 || bits > 16) {
+        errExit("bad partition bits");
+    }
+    PartSet* s = malloc(sizeof(PartSet));
+    size_t nparts = (size_t)1 << bits;
+    if (s == NULL || (s->parts = malloc(sizeof(Hashptr) * nparts)) == NULL) {
+        errExit("out of memory");
+    }
+    s->bits = bits;
+    s->seed = 0;
+    for (size_t p = 0; p < nparts; p++) {
+        s->parts[p] = initWithMode(capFor(expected >> bits), powerOfTwo);
+        s->parts[p]->seed = s->seed;
+    }
+    return s;
+}
+
+void destroyPartSet(PartSet* s) {
+    for (size_t p = 0; p < (size_t)1 << s->bits; p++) {
+        destroy(s->parts[p]);
+    }
+    free(s->parts);
+    free(s);
+}
+
+size_t partSetLen(const PartSet* s) {
+    size_t len = 0;
+    for (size_t p = 0; p < (size_t)1 << s->bits; p++) {
+        len += s->parts[p]->len;
+    }
+    return len;
+}
+
+bool partSetContains(const PartSet* s, int32_t key) {
+    return contains(s->parts[partOf(s, key)], key);
+}
+
+// 预先扩容，让分区再放n个键不会触发扩容
+void reservePart(Hashptr hptr, size_t n) {
+    size_t need = hptr->len + hptr->deleted + n;
+    if ((float)need / (float)hptr->cap >= LOAD_FACTOR_MAX) {
+        resizehash(hptr, capFor(hptr->len + n));
+    }
+}
+
+// bulkInsert的共享状态
+typedef struct bulkCtx {
+    PartSet* s;
+    const int32_t* keys;
+    size_t n;
+    size_t nchunks;   // 输入分成的段数
+    size_t* counts;   // counts[c * nparts + p]：第c段落到分区p的键数，
+                      // 前缀和以后是它在tmp里的起始位置
+    size_t* starts;   // starts[p]：分区p在tmp里的起始位置，多一个哨兵
+    int32_t* tmp;     // 按分区排好的键
+} BulkCtx;
+
+void chunkRange(const BulkCtx* c, size_t chunk, size_t* from, size_t* to) {
+    *from = c->n * chunk / c->nchunks;
+    *to = c->n * (chunk + 1) / c->nchunks;
+}
+
+void countTask(void* ctx, size_t chunk) {
+    BulkCtx* c = ctx;
+    size_t from, to;
+    chunkRange(c, chunk, &from, &to);
+    size_t* cnt = c->counts + chunk * ((size_t)1 << c->s->bits);
+    for (size_t i = from; i < to; i++) {
+        ++cnt[partOf(c->s, c->keys[i])];
+    }
+}
+
+void scatterTask(void* ctx, size_t chunk) {
+    BulkCtx* c = ctx;
+    size_t from, to;
+    chunkRange(c, chunk, &from, &to);
+    size_t* pos = c->counts + chunk * ((size_t)1 << c->s->bits);
+    for (size_t i = from; i < to; i++) {
+        c->tmp[pos[partOf(c->s, c->keys[i])]++] = c->keys[i];
+    }
+}
+
+void insertTask(void* ctx, size_t p) {
+    BulkCtx* c = ctx;
+    Hashptr part = c->s->parts[p];
+    reservePart(part, c->starts[p + 1] - c->starts[p]);
+    for (size_t i = c->starts[p]; i < c->starts[p + 1]; i++) {
+        insert(part, c->tmp[i]);
+    }
+}
+
+// 批量插入n个键，重复的键只插入一次
+void bulkInsert(ThreadPool* pool, PartSet* s, const int32_t* keys, size_t n) {
+    size_t nparts = (size_t)1 << s->bits;
+    BulkCtx c = {s, keys, n, pool->nthreads + 1, NULL, NULL, NULL};
+    c.counts = calloc(c.nchunks * nparts, sizeof(size_t));
+    c.starts = malloc((nparts + 1) * sizeof(size_t));
+    c.tmp = malloc((n + 1) * sizeof(int32_t));
+    if (c.counts == NULL || c.starts == NULL || c.tmp == NULL) {
+        errExit("out of memory");
+    }
+    parallelFor(pool, c.nchunks, countTask, &c);
+    // 分区号在外层，同一个分区的所有段连在一起
+    size_t sum = 0;
+    for (size_t p = 0; p < nparts; p++) {
+        c.starts[p] = sum;
+        for (size_t k = 0; k < c.nchunks; k++) {
+            size_t cnt = c.counts[k * nparts + p];
+            c.counts[k * nparts + p] = sum;
+            sum += cnt;
+        }
+    }
+    c.starts[nparts] = sum;
+    parallelFor(pool, c.nchunks, scatterTask, &c);
+    parallelFor(pool, nparts, insertTask, &c);
+    free(c.tmp);
+    free(c.starts);
+    free(c.counts);
+}
+
+// 两个集合之间的运算
+enum setOp { opUnion, opIntersect, opDifference };
+
+typedef struct setOpCtx {
+    const PartSet* a;
+    const PartSet* b;
+    PartSet* out;
+    enum setOp op;
+} SetOpCtx;
+
+// 把from中的键插入to，other不为NULL时只插入在other中存在（want为true）
+// 或者不存在（want为false）的键
+void mergePart(Hashptr to, Hashptr from, Hashptr other, bool want) {
+    for (size_t i = 0; i < from->cap; i++) {
+        if (from->array[i].state != legitimate) {
+            continue;
+        }
+        int32_t key = from->array[i].el;
+        if (other == NULL || contains(other, key) == want) {
+            insertIntoArray(to, key);
+        }
+    }
+}
+
+void setOpTask(void* ctx, size_t p) {
+    SetOpCtx* c = ctx;
+    Hashptr a = c->a->parts[p], b = c->b->parts[p];
+    Hashptr out;
+    switch (c->op) {
+        case opUnion:
+            out = initWithMode(capFor(a->len + b->len), powerOfTwo);
+            out->seed = c->a->seed;
+            mergePart(out, a, NULL, false);
+            mergePart(out, b, NULL, false);
+            break;
+        case opIntersect:
+            // 遍历小的那个，去大的那个里面查
+            if (a->len > b->len) {
+                Hashptr t = a;
+                a = b;
+                b = t;
+            }
+            out = initWithMode(capFor(a->len), powerOfTwo);
+            out->seed = c->a->seed;
+            mergePart(out, a, b, true);
+            break;
+        default:
+            out = initWithMode(capFor(a->len), powerOfTwo);
+            out->seed = c->a->seed;
+            mergePart(out, a, b, false);
+            break;
+    }
+    c->out->parts[p] = out;
+}
+
+// 按分区并行做集合运算，返回新的集合，a和b的分区方式必须一样
+PartSet* partSetOp(ThreadPool* pool, const PartSet* a, const PartSet* b,
+                   enum setOp op) {
+    if (a->bits != b->bits || a->seed != b->seed) {
+        errExit("partition layout mismatch");
+    }
+    size_t nparts = (size_t)1 << a->bits;
+    PartSet* out = malloc(sizeof(PartSet));
+    if (out == NULL ||
+        (out->parts = malloc(sizeof(Hashptr) * nparts)) == NULL) {
+        errExit("out of memory");
+    }
+    out->bits = a->bits;
+    out->seed = a->seed;
+    SetOpCtx c = {a, b, out, op};
+    parallelFor(pool, nparts, setOpTask, &c);
+    return out;
+}
+
+PartSet* partSetUnion(ThreadPool* pool, const PartSet* a, const PartSet* b) {
+    return partSetOp(pool, a, b, opUnion);
+}
+
+PartSet* partSetIntersect(ThreadPool* pool, const PartSet* a,
+                          const PartSet* b) {
+    return partSetOp(pool, a, b, opIntersect);
+}
+
+PartSet* partSetDifference(ThreadPool* pool, const PartSet* a,
+                           const PartSet* b) {
+    return partSetOp(pool, a, b, opDifference);
+}
+
+// 槽数组的校验和
+uint64_t checksum(const Itemptr array, size_t cap, uint64_t seed) {
+    return wyhash(array, cap * sizeof(Item), seed);
+}
+
+// 把哈希表保存成快照，成功返回0，失败返回-1
+// 先写到path.tmp，写完并且落盘以后再改名，中途崩溃不会留下半个文件
+int saveSnapshot(Hashptr hptr, const char* path) {
+    SnapHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SNAP_MAGIC, sizeof(hdr.magic));
+    hdr.version = SNAP_VERSION;
+    hdr.itemsize = sizeof(Item);
+    hdr.cap = hptr->cap;
+    hdr.len = hptr->len;
+    hdr.seed = hptr->seed;
+    hdr.mode = hptr->mode;
+    hdr.checksum = checksum(hptr->array, hptr->cap, hptr->seed);
+
+    char tmp[4096];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+        fprintf(stderr, "snapshot path is too long\n");
+        return -1;
+    }
+    FILE* fp = fopen(tmp, "wb");
+    if (fp == NULL) {
+        perror(tmp);
+        return -1;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        fwrite(hptr->array, sizeof(Item), hptr->cap, fp) != hptr->cap ||
+        fflush(fp) != 0 || fsync(fileno(fp)) != 0) {
+        perror(tmp);
+        fclose(fp);
+        unlink(tmp);
+        return -1;
+    }
+    if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+        perror(path);
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// 把快照mmap成一个只读的哈希表，数据不复制也不重新哈希
+// verify为true时检查校验和，需要把整个文件读一遍
+// 文件不存在或者格式不对返回NULL，调用者可以退回到重新插入
+Hashptr loadSnapshot(const char* path, bool verify) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapHeader)) {
+        fprintf(stderr, "%s: not a snapshot\n", path);
+        close(fd);
+        return NULL;
+    }
+    size_t size = st.st_size;
+    void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    // 映射建立以后文件描述符就不需要了
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path);
+        return NULL;
+    }
+
+    const SnapHeader* hdr = map;
+    const char* err = NULL;
+    if (memcmp(hdr->magic, SNAP_MAGIC, sizeof(hdr->magic)) != 0) {
+        err = "bad magic";
+    } else if (hdr->version != SNAP_VERSION) {
+        err = "unsupported version";
+    } else if (hdr->itemsize != sizeof(Item)) {
+        err = "item layout mismatch";
+    } else if (hdr->mode > primeModulo) {
+        err = "unknown index mode";
+    } else if (hdr->cap == 0 || hdr->len >= hdr->cap ||
+               (hdr->mode == powerOfTwo && (hdr->cap & (hdr->cap - 1))) ||
+               (hdr->mode != powerOfTwo && hdr->cap > UINT32_MAX) ||
+               hdr->cap > (size - sizeof(SnapHeader)) / sizeof(Item) ||
+               size != sizeof(SnapHeader) + hdr->cap * sizeof(Item)) {
+        err = "bad size";
+    }
+    Itemptr array = (Itemptr)(hdr + 1);
+    if (err == NULL && verify &&
+        checksum(array, hdr->cap, hdr->seed) != hdr->checksum) {
+        err = "checksum mismatch";
+    }
+    if (err != NULL) {
+        fprintf(stderr, "%s: %s\n", path, err);
+        munmap(map, size);
+        return NULL;
+    }
+
+    Hashptr hptr = malloc(sizeof(Hash));
+    if (hptr == NULL) {
+        errExit("out of memory");
+    }
+    hptr->array = array;
+    hptr->cap = hdr->cap;
+    hptr->len = hdr->len;
+    // 快照表是只读的，不会插入删除，墓碑个数和缩容下限都用不到
+    hptr->deleted = 0;
+    hptr->mincap = hdr->cap;
+    hptr->seed = hdr->seed;
+    hptr->mode = hdr->mode;
+    setIndex(hptr);
+    hptr->lfactor = (float)hptr->len / (float)hptr->cap;
+    hptr->map = map;
+    hptr->mapsize = size;
+    // 过滤器不存进快照，需要的话打开以后再setBloom
+    hptr->bloombits = 0;
+    memset(&hptr->bloom, 0, sizeof(Bloom));
+#ifdef HASHSTATS
+    hptr->counters = (HashCounters){0, 0.0};
+#endif
     return hptr;
 }
 
-int main(void) {
+double nowSec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// 对比两种冷启动：逐个插入重建整个表，或者mmap快照
+// 快照写完以后让内核丢掉文件的页缓存，mmap之后的查找要真的从磁盘读
+void benchSnapshot(size_t n, const char* path) {
+    trace = 0;
+    size_t q = 1000000;  // 启动以后的查找次数
+    // 用一个奇数乘法生成n个不同的键
+    int32_t* keys = malloc(n * sizeof(int32_t));
+    int32_t* queries = malloc(q * sizeof(int32_t));
+    if (keys == NULL || queries == NULL) {
+        errExit("out of memory");
+    }
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = (int32_t)((uint32_t)i * 2654435761u);
+    }
+    uint64_t x = 88172645463325252ULL;
+    for (size_t i = 0; i < q; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        queries[i] = keys[x % n];
+    }
+
+    double t0 = nowSec();
+    Hashptr hptr = init(11);
+    for (size_t i = 0; i < n; i++) {
+        insert(hptr, keys[i]);
+    }
+    double t1 = nowSec();
+    size_t found = 0;
+    for (size_t i = 0; i < q; i++) {
+        found += contains(hptr, queries[i]);
+    }
+    double t2 = nowSec();
+    printf("keys: %zu cap: %zu file MB: %.1f\n", hptr->len, hptr->cap,
+           (sizeof(SnapHeader) + hptr->cap * sizeof(Item)) / 1048576.0);
+    printf("%-14s %12s %12s %10s\n", "start", "startup s", "1e6 finds s",
+           "found");
+    printf("%-14s %12.3f %12.3f %10zu\n", "rebuild", t1 - t0, t2 - t1, found);
+
+    double t3 = nowSec();
+    if (saveSnapshot(hptr, path) != 0) {
+        errExit("save snapshot failed");
+    }
+    double t4 = nowSec();
+    destroy(hptr);
+
+    for (int verify = 0; verify <= 1; verify++) {
+        int fd = open(path, O_RDONLY);
+        if (fd >= 0) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+        t0 = nowSec();
+        hptr = loadSnapshot(path, verify);
+        if (hptr == NULL) {
+            errExit("load snapshot failed");
+        }
+        t1 = nowSec();
+        found = 0;
+        for (size_t i = 0; i < q; i++) {
+            found += contains(hptr, queries[i]);
+        }
+        t2 = nowSec();
+        printf("%-14s %12.3f %12.3f %10zu\n",
+               verify ? "mmap+checksum" : "mmap", t1 - t0, t2 - t1, found);
+        destroy(hptr);
+    }
+    printf("save: %.3fs\n", t4 - t3);
+    unlink(path);
+    free(queries);
+    free(keys);
+}
+
+// 对比三种容量模式在顺序、等间距、随机三种键上的插入和查找速度
+// primeModulo就是以前每次都用%取模的实现
+void benchIndex(size_t n) {
+    trace = 0;
+    int32_t* keys = malloc(n * sizeof(int32_t));
+    int32_t* misses = malloc(n * sizeof(int32_t));
+    if (keys == NULL || misses == NULL) {
+        errExit("out of memory");
+    }
+    const char* workloads[] = {"seq", "stride", "random"};
+    const char* modes[] = {"fastmod", "pow2", "modulo"};
+
+    printf("%-8s %-8s %10s %10s %10s %10s\n", "keys", "mode", "cap",
+           "insert ns", "hit ns", "miss ns");
+    for (int w = 0; w < 3; w++) {
+        uint64_t x = 88172645463325252ULL;
+        for (size_t i = 0; i < n; i++) {
+            if (w == 0) {
+                keys[i] = (int32_t)i;
+                misses[i] = (int32_t)(n + i);
+            } else if (w == 1) {
+                // 等间距的键，间隔是2的幂，不打散直接用掩码取下标的话会大量冲突
+                keys[i] = (int32_t)(i * 256);
+                misses[i] = (int32_t)(i * 256 + 1);
+            } else {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                keys[i] = (int32_t)x;
+                misses[i] = (int32_t)(x >> 32);
+            }
+        }
+        for (int m = primeFastmod; m <= primeModulo; m++) {
+            Hashptr hptr = initWithMode(11, m);
+            double t0 = nowSec();
+            for (size_t i = 0; i < n; i++) {
+                insert(hptr, keys[i]);
+            }
+            double t1 = nowSec();
+            size_t found = 0;
+            for (size_t i = 0; i < n; i++) {
+                found += contains(hptr, keys[i]);
+            }
+            double t2 = nowSec();
+            for (size_t i = 0; i < n; i++) {
+                found += contains(hptr, misses[i]);
+            }
+            double t3 = nowSec();
+            if (found < hptr->len) {
+                errExit("lost keys");
+            }
+            printf("%-8s %-8s %10zu %10.1f %10.1f %10.1f\n", workloads[w],
+                   modes[m], hptr->cap, (t1 - t0) / n * 1e9,
+                   (t2 - t1) / n * 1e9, (t3 - t2) / n * 1e9);
+            destroy(hptr);
+        }
+    }
+    free(misses);
+    free(keys);
+}
+
+// 当前进程的常驻内存（字节），读取失败返回0
+size_t rssBytes(void) {
+    long pages = 0, resident = 0;
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(fp);
+    return (size_t)resident * 4096;
+}
+
+// 负载尖峰：插入n个键再删掉99%，看缩容以后内存有没有还给系统；
+// 然后在剩下的规模上反复插入新键、删除旧键，墓碑靠原地清理回收
+void benchSpike(size_t n) {
+    trace = 0;
+    size_t rss0 = rssBytes();
+    Hashptr hptr = init(11);
+    for (size_t i = 0; i < n; i++) {
+        insert(hptr, (int32_t)((uint32_t)i * 2654435761u));
+    }
+    size_t peak = rssBytes();
+    size_t peakcap = hptr->cap;
+    double t0 = nowSec();
+    for (size_t i = 0; i < n; i++) {
+        if (i % 100 != 0) {
+            erase(hptr, (int32_t)((uint32_t)i * 2654435761u));
+        }
+    }
+    double t1 = nowSec();
+    printf("%-8s %10s %10s %10s\n", "phase", "cap", "rss MB", "seconds");
+    printf("%-8s %10zu %10.1f %10.3f\n", "peak", peakcap,
+           (peak - rss0) / 1048576.0, 0.0);
+    printf("%-8s %10zu %10.1f %10.3f\n", "erased", hptr->cap,
+           (rssBytes() - rss0) / 1048576.0, t1 - t0);
+
+    // 滑动窗口：每次插入一个新键，删除窗口最老的键，元素个数不变
+    size_t live = (n + 99) / 100;
+    for (size_t i = 0; i < n; i++) {
+        insert(hptr, (int32_t)((uint32_t)(n + i) * 2654435761u));
+        size_t old = i < live ? i * 100 : n + i - live;
+        erase(hptr, (int32_t)((uint32_t)old * 2654435761u));
+    }
+    double t2 = nowSec();
+    printf("%-8s %10zu %10.1f %10.3f\n", "churn", hptr->cap,
+           (rssBytes() - rss0) / 1048576.0, t2 - t1);
+    printf("len: %zu tombstones: %zu\n", hptr->len, hptr->deleted);
+    destroy(hptr);
+}
+
+// 布隆过滤器：同一张表分别不带和带过滤器，按不同的未命中比例查找
+// 删掉一部分键留下墓碑，不存在的键的探测序列更长
+void benchBloom(size_t n) {
+    trace = 0;
+    size_t q = 10000000;  // 查找次数
+    int32_t* queries = malloc(q * sizeof(int32_t));
+    if (queries == NULL) {
+        errExit("out of memory");
+    }
+    Hashptr hptr = init(11);
+    for (size_t i = 0; i < n; i++) {
+        insert(hptr, (int32_t)((uint32_t)i * 2654435761u));
+    }
+    for (size_t i = 0; i < n; i += 10) {
+        erase(hptr, (int32_t)((uint32_t)i * 2654435761u));
+    }
+    setBloom(hptr, BLOOM_BITS_PER_KEY);
+    // 实测误判率，不存在的键是n到2n乘同一个常数
+    size_t passed = 0;
+    for (size_t i = 0; i < n; i++) {
+        int32_t key = (int32_t)((uint32_t)(n + i) * 2654435761u);
+        passed += bloomMayContain(&hptr->bloom, bloomHash(hptr, key));
+    }
+    printf("keys: %zu cap: %zu tombstones: %zu bloom: %.1f MB %.1f bits/key "
+           "fpr: %.4f%% (estimated %.4f%%)\n",
+           hptr->len, hptr->cap, hptr->deleted,
+           bloomBytes(&hptr->bloom) / 1048576.0,
+           bloomBytes(&hptr->bloom) * 8.0 / hptr->len, passed * 100.0 / n,
+           bloomFpr(&hptr->bloom) * 100);
+    printf("%-8s %12s %12s %10s\n", "miss%", "plain Mops", "bloom Mops",
+           "found");
+    int misses[] = {0, 30, 50, 70, 90, 100};
+    for (size_t m = 0; m < sizeof(misses) / sizeof(misses[0]); m++) {
+        uint64_t x = 88172645463325252ULL;
+        for (size_t i = 0; i < q; i++) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            // 存在的键下标不是10的倍数
+            size_t k = (x >> 8) % n | 1;
+            if ((int)(x % 100) < misses[m]) {
+                k += n;
+            }
+            queries[i] = (int32_t)((uint32_t)k * 2654435761u);
+        }
+        double mops[2];
+        size_t found = 0;
+        for (int b = 0; b < 2; b++) {
+            setBloom(hptr, b ? BLOOM_BITS_PER_KEY : 0);
+            found = 0;
+            double t0 = nowSec();
+            for (size_t i = 0; i < q; i++) {
+                found += contains(hptr, queries[i]);
+            }
+            mops[b] = q / (nowSec() - t0) / 1e6;
+        }
+        printf("%-8d %12.2f %12.2f %10zu\n", misses[m], mops[0], mops[1],
+               found);
+    }
+    destroy(hptr);
+    free(queries);
+}
+
+// 批量集合运算：a和b各n个随机键，一半相同
+// 对照组是一张普通的表逐个insert和contains，然后按线程数对比分区并行的版本
+void benchSetOps(size_t n) {
+    trace = 0;
+    int32_t* a = malloc(n * sizeof(int32_t));
+    int32_t* b = malloc(n * sizeof(int32_t));
+    if (a == NULL || b == NULL) {
+        errExit("out of memory");
+    }
+    uint64_t x = 88172645463325252ULL;
+    for (size_t i = 0; i < n; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        a[i] = (int32_t)x;
+        b[i] = i % 2 ? a[i] : (int32_t)(x >> 32);
+    }
+
+    double t0 = nowSec();
+    Hashptr ha = init(11), hb = init(11);
+    for (size_t i = 0; i < n; i++) {
+        insert(ha, a[i]);
+        insert(hb, b[i]);
+    }
+    double t1 = nowSec();
+    Hashptr hu = init(11), hi = init(11), hd = init(11);
+    for (size_t i = 0; i < n; i++) {
+        insert(hu, a[i]);
+        insert(hu, b[i]);
+    }
+    double t2 = nowSec();
+    for (size_t i = 0; i < n; i++) {
+        if (contains(hb, a[i])) {
+            insert(hi, a[i]);
+        }
+    }
+    double t3 = nowSec();
+    for (size_t i = 0; i < n; i++) {
+        if (!contains(hb, a[i])) {
+            insert(hd, a[i]);
+        }
+    }
+    double t4 = nowSec();
+    printf("keys: %zu union: %zu intersect: %zu difference: %zu cpus: %ld\n",
+           n, hu->len, hi->len, hd->len, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-10s %10s %10s %10s %10s\n", "threads", "insert s", "union s",
+           "intersect", "diff s");
+    printf("%-10s %10.3f %10.3f %10.3f %10.3f\n", "one-by-one", t1 - t0,
+           t2 - t1, t3 - t2, t4 - t3);
+
+    int threads[] = {1, 2, 4, 8, 16};
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+        ThreadPool* pool = newThreadPool(threads[t]);
+        double s0 = nowSec();
+        PartSet* pa = initPartSet(PART_BITS, 0);
+        PartSet* pb = initPartSet(PART_BITS, 0);
+        bulkInsert(pool, pa, a, n);
+        bulkInsert(pool, pb, b, n);
+        double s1 = nowSec();
+        PartSet* pu = partSetUnion(pool, pa, pb);
+        double s2 = nowSec();
+        PartSet* pi = partSetIntersect(pool, pa, pb);
+        double s3 = nowSec();
+        PartSet* pd = partSetDifference(pool, pa, pb);
+        double s4 = nowSec();
+        if (partSetLen(pa) != ha->len || partSetLen(pu) != hu->len ||
+            partSetLen(pi) != hi->len || partSetLen(pd) != hd->len) {
+            errExit("set operation result mismatch");
+        }
+        printf("%-10d %10.3f %10.3f %10.3f %10.3f\n", threads[t], s1 - s0,
+               s2 - s1, s3 - s2, s4 - s3);
+        destroyPartSet(pa);
+        destroyPartSet(pb);
+        destroyPartSet(pu);
+        destroyPartSet(pi);
+        destroyPartSet(pd);
+        destroyThreadPool(pool);
+    }
+    destroy(ha);
+    destroy(hb);
+    destroy(hu);
+    destroy(hi);
+    destroy(hd);
+    free(b);
+    free(a);
+}
+
+// 用法：不带参数运行演示
+//      `bench [n] [path]` 对比重建和mmap快照的冷启动，默认5*10^7个键
+//      `index [n]` 对比三种容量模式，默认10^7个键
+//      `spike [n]` 插入以后删掉99%再反复增删，看缩容和墓碑清理，默认10^7个键
+//      `bloom [n]` 对比有没有布隆过滤器时不同未命中比例的查找，默认10^7个键
+//      `setops [n]` 对比逐个操作和分区并行的批量并交差，默认10^7个键
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        benchSnapshot(argc > 2 ? strtoull(argv[2], NULL, 10) : 50000000,
+                      argc > 3 ? argv[3] : "oahash.snap");
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "setops") == 0) {
+        benchSetOps(argc > 2 ? strtoull(argv[2], NULL, 10) : 10000000);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "bloom") == 0) {
+        benchBloom(argc > 2 ? strtoull(argv[2], NULL, 10) : 10000000);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "spike") == 0) {
+        benchSpike(argc > 2 ? strtoull(argv[2], NULL, 10) : 10000000);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "index") == 0) {
+        benchIndex(argc > 2 ? strtoull(argv[2], NULL, 10) : 10000000);
+        return 0;
+    }
+
     int arr[9] = {47, 7, 29, 11, 9, 87, 54, 20, 30};
     Hashptr hptr = init(11);
     for (int i = 0; i < 9; i++) {
         insert(hptr, arr[i]);
     }
     printInfo(hptr);
+#ifdef HASHSTATS
+    HashStats st = hashStats(hptr);
+    hashStatsPrint(&st);
+#endif
     // erase(hptr, 47);
     // printInfo(hptr);
 }
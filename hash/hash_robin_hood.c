@@ -0,0 +1,353 @@
+// 开放定址法实现哈希表（Robin Hood 线性探测）
+/*
+    Robin Hood 探测
+        每个槽位记录元素离它的初始位置有多远（探测距离psl，1表示就在初始位置，
+        0表示槽位为空）。插入的时候如果当前元素的psl比槽位上元素的psl大，
+        就把槽位抢过来，让被挤出去的元素继续往后找位置（劫富济贫）。
+        这样所有元素的探测距离都比较平均，方差很小
+
+    查找
+        从初始位置开始线性探测，如果探测到的距离已经超过了槽位上元素的psl，
+        说明key不可能在更后面，提前结束
+
+    删除（向后移位）
+        删除元素之后把后面psl大于1的元素依次往前挪一格并减小psl，直到遇到空槽
+        或者psl为1的元素。不需要deleted状态，表中不会留下墓碑，
+        元素个数低于容量的LOAD_FACTOR_MIN时缩容
+
+           i     el   psl             删除k1之后
+          +----+----+----+           +----+----+----+
+        0 | k0 |  1 |                | k0 |  1 |
+          +----+----+----+           +----+----+----+
+        1 | k1 |  1 |   <-- 删除      | k2 |  1 |
+          +----+----+----+           +----+----+----+
+        2 | k2 |  2 |                | k3 |  2 |
+          +----+----+----+           +----+----+----+
+        3 | k3 |  3 |                |    |  0 |
+          +----+----+----+           +----+----+----+
+*/
+
+#include <memory.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hashstats.h"
+
+#define LOAD_FACTOR_MAX 0.85
+#define LOAD_FACTOR_MIN 0.2  // 低于这个负载因子时缩容
+
+typedef struct item {
+    int32_t el;    // 元素
+    uint32_t psl;  // 探测距离，0表示当前项为空
+} Item, *Itemptr;
+
+typedef struct hash {
+    Itemptr array;  // 存储元素的数组
+    float lfactor;  // 负载因子
+    size_t cap;     // 表的容量，2的幂
+    size_t len;     // 表的当前元素个数
+    size_t mincap;  // 缩容的下限，就是初始容量
+#ifdef HASHSTATS
+    HashCounters counters;  // 扩容次数和用时
+#endif
+} Hash, *Hashptr;
+
+// 探测距离的统计
+typedef struct probeStats {
+    uint32_t max;     // 最大探测距离
+    double mean;      // 平均探测距离
+    double variance;  // 探测距离的方差
+} ProbeStats;
+
+void errExit(const char* errMsg) {
+    fprintf(stderr, "%s\n", errMsg);
+    exit(EXIT_FAILURE);
+}
+
+void printInfo(Hashptr hptr) {
+    if (hptr == NULL) {
+        return;
+    }
+    printf("load factor: %0.2f\tlen: %zu\tcap: %zu\n", hptr->lfactor,
+           hptr->len, hptr->cap);
+    for (size_t i = 0; i < hptr->cap; i++) {
+        if (hptr->array[i].psl != 0) {
+            printf("%zu  %d  psl: %u\n", i, hptr->array[i].el,
+                   hptr->array[i].psl);
+        } else {
+            printf("%zu  -\n", i);
+        }
+    }
+}
+
+size_t hashfunc(Hashptr hptr, int32_t key) {
+    uint64_t h = (uint64_t)(uint32_t)key * 0x9E3779B97F4A7C15ULL;
+    return (h ^ (h >> 32)) & (hptr->cap - 1);
+}
+
+// 如果找到就返回该key所在的槽位下标，找不到返回-1
+int64_t find(Hashptr hptr, int32_t key) {
+    size_t mask = hptr->cap - 1;
+    size_t pos = hashfunc(hptr, key);
+    // 当前探测的距离
+    for (uint32_t psl = 1;; psl++) {
+        Itemptr it = &hptr->array[pos];
+        // 空槽，或者槽位上的元素离家更近，key不可能在后面
+        if (it->psl < psl) {
+            return -1;
+        }
+        if (it->psl == psl && it->el == key) {
+            return (int64_t)pos;
+        }
+        pos = (pos + 1) & mask;
+    }
+}
+
+// 向上取2的幂
+size_t upToPow2(size_t num) {
+    size_t cap = 8;
+    while (cap < num) {
+        cap <<= 1;
+    }
+    return cap;
+}
+
+void inithash(Hashptr hptr, size_t initcap) {
+    hptr->lfactor = 0.0;
+    hptr->len = 0;
+    hptr->cap = upToPow2(initcap);
+    // psl为0表示空槽，所以全部清零就是初始化
+    hptr->array = calloc(hptr->cap, sizeof(Item));
+    if (hptr->array == NULL) {
+        errExit("out of memory");
+    }
+}
+
+// 调用者保证key不存在并且有空闲槽位
+void insertIntoArray(Hashptr hptr, int32_t key) {
+    size_t mask = hptr->cap - 1;
+    size_t pos = hashfunc(hptr, key);
+    Item cur = {key, 1};
+
+    while (hptr->array[pos].psl != 0) {
+        // 劫富济贫：当前元素离家更远，抢占这个槽位，被抢的元素继续往后找
+        if (hptr->array[pos].psl < cur.psl) {
+            Item tmp = hptr->array[pos];
+            hptr->array[pos] = cur;
+            cur = tmp;
+        }
+        ++cur.psl;
+        pos = (pos + 1) & mask;
+    }
+    hptr->array[pos] = cur;
+    // 更新负载因子和长度
+    ++hptr->len;
+    hptr->lfactor = (float)hptr->len / (float)hptr->cap;
+}
+
+// 扩容哈希表
+// 把元素迁移到容量为newcap的新数组，扩容和缩容都用它
+void resizehash(Hashptr hptr, size_t newcap) {
+#ifdef HASHSTATS
+    double t0 = hashStatsNow();
+#endif
+    size_t oldcap = hptr->cap;
+    Itemptr oldArray = hptr->array;
+    inithash(hptr, newcap);
+    // 迁移数组元素
+    for (size_t i = 0; i < oldcap; i++) {
+        if (oldArray[i].psl != 0) {
+            insertIntoArray(hptr, oldArray[i].el);
+        }
+    }
+    // 释放旧数组数据
+    free(oldArray);
+#ifdef HASHSTATS
+    hashCountersAdd(&hptr->counters, t0);
+#endif
+}
+
+void growhash(Hashptr hptr) {
+    if ((float)(hptr->len + 1) / (float)hptr->cap > LOAD_FACTOR_MAX) {
+        // 扩容了两倍
+        resizehash(hptr, hptr->cap * 2);
+    }
+}
+
+// 负载因子低于LOAD_FACTOR_MIN时缩容，新容量让负载因子回到两个阈值中间，
+// 在阈值附近反复插入删除不会来回扩容缩容
+void shrinkhash(Hashptr hptr) {
+    if (hptr->lfactor >= LOAD_FACTOR_MIN || hptr->cap <= hptr->mincap) {
+        return;
+    }
+    size_t newcap = upToPow2(
+        (size_t)(hptr->len / ((LOAD_FACTOR_MIN + LOAD_FACTOR_MAX) / 2)));
+    if (newcap < hptr->mincap) {
+        newcap = hptr->mincap;
+    }
+    if (newcap < hptr->cap) {
+        resizehash(hptr, newcap);
+    }
+}
+
+void insert(Hashptr hptr, int32_t key) {
+    if (hptr == NULL) {
+        errExit("need to init before insert");
+    }
+    if (find(hptr, key) >= 0) {
+        return;
+    }
+    growhash(hptr);
+    insertIntoArray(hptr, key);
+}
+
+// 删除之后把后面的元素往前挪，不留下墓碑
+void erase(Hashptr hptr, int32_t key) {
+    if (hptr == NULL) {
+        errExit("need to init before erase");
+    }
+    int64_t found = find(hptr, key);
+    if (found < 0) {
+        return;
+    }
+    size_t mask = hptr->cap - 1;
+    size_t pos = (size_t)found;
+    size_t next = (pos + 1) & mask;
+    // 后面的元素不在初始位置（psl大于1），往前挪一格
+    while (hptr->array[next].psl > 1) {
+        hptr->array[pos] = hptr->array[next];
+        --hptr->array[pos].psl;
+        pos = next;
+        next = (next + 1) & mask;
+    }
+    hptr->array[pos].psl = 0;
+    // 更新当前元素个数和负载因子
+    --hptr->len;
+    hptr->lfactor = (float)hptr->len / (float)hptr->cap;
+    shrinkhash(hptr);
+}
+
+// 统计所有元素的最大、平均探测距离和方差
+ProbeStats probeStats(Hashptr hptr) {
+    ProbeStats st = {0, 0.0, 0.0};
+    if (hptr == NULL || hptr->len == 0) {
+        return st;
+    }
+    double sum = 0.0, sq = 0.0;
+    for (size_t i = 0; i < hptr->cap; i++) {
+        uint32_t psl = hptr->array[i].psl;
+        if (psl != 0) {
+            if (psl > st.max) {
+                st.max = psl;
+            }
+            sum += psl;
+            sq += (double)psl * psl;
+        }
+    }
+    st.mean = sum / hptr->len;
+    st.variance = sq / hptr->len - st.mean * st.mean;
+    return st;
+}
+
+#ifdef HASHSTATS
+// 探测长度就是每个元素的psl，向后移位删除不会留下墓碑
+HashStats hashStats(Hashptr hptr) {
+    HashStats st;
+    hashStatsInit(&st, &hptr->counters);
+    for (size_t i = 0; i < hptr->cap; i++) {
+        if (hptr->array[i].psl != 0) {
+            hashStatsAdd(&st, hptr->array[i].psl);
+        }
+    }
+    st.len = hptr->len;
+    st.cap = hptr->cap;
+    st.bytes = sizeof(Hash) + hptr->cap * sizeof(Item);
+    return st;
+}
+#endif
+
+Hashptr init(size_t initcap) {
+    Hashptr hptr = malloc(sizeof(Hash));
+    if (hptr == NULL) {
+        errExit("out of memory");
+    }
+    memset(hptr, 0, sizeof(Hash));
+    inithash(hptr, initcap);
+    hptr->mincap = hptr->cap;
+    return hptr;
+}
+
+void destroy(Hashptr hptr) {
+    if (hptr == NULL) {
+        return;
+    }
+    free(hptr->array);
+    free(hptr);
+}
+
+// xorshift伪随机数
+uint32_t nextRand(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (uint32_t)(*state >> 16);
+}
+
+// 模拟会话id的反复插入和删除：表里始终保持live个元素，每轮删掉最老的一个
+// 再插入一个新的，打印探测距离的变化
+void benchChurn(size_t live, size_t rounds) {
+    Hashptr hptr = init(live);
+    int32_t* ring = malloc(sizeof(int32_t) * live);
+    if (ring == NULL) {
+        errExit("out of memory");
+    }
+    uint64_t seed = 88172645463325252ULL;
+    for (size_t i = 0; i < live; i++) {
+        ring[i] = (int32_t)nextRand(&seed);
+        insert(hptr, ring[i]);
+    }
+    printf("%-12s %-10s %-8s %-8s %-8s\n", "ops", "load", "max", "mean",
+           "variance");
+    for (size_t r = 0; r <= rounds; r++) {
+        if (r % (rounds / 10 ? rounds / 10 : 1) == 0) {
+            ProbeStats st = probeStats(hptr);
+            printf("%-12zu %-10.3f %-8u %-8.3f %-8.3f\n", r, hptr->lfactor,
+                   st.max, st.mean, st.variance);
+        }
+        size_t slot = r % live;
+        erase(hptr, ring[slot]);
+        ring[slot] = (int32_t)nextRand(&seed);
+        insert(hptr, ring[slot]);
+    }
+    free(ring);
+    destroy(hptr);
+}
+
+// 用法：不带参数运行演示，`bench [live] [rounds]` 跑反复增删的测试
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        benchChurn(argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000,
+                   argc > 3 ? strtoull(argv[3], NULL, 10) : 10000000);
+        return 0;
+    }
+
+    int arr[9] = {47, 7, 29, 11, 9, 87, 54, 20, 30};
+    Hashptr hptr = init(11);
+    for (int i = 0; i < 9; i++) {
+        insert(hptr, arr[i]);
+    }
+    printInfo(hptr);
+    erase(hptr, 47);
+    printInfo(hptr);
+    ProbeStats st = probeStats(hptr);
+    printf("max psl: %u\tmean psl: %0.2f\n", st.max, st.mean);
+#ifdef HASHSTATS
+    HashStats hs = hashStats(hptr);
+    hashStatsPrint(&hs);
+#endif
+    destroy(hptr);
+    return 0;
+}
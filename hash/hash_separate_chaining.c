@@ -4,277 +4,551 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
 
-#define LOADFACTOR 0.75  // 出发扩容的最大负载因子
-#define MAXHASHSIZE 128  // 哈希表最大长度
-
-// 链表结点
-typedef struct node {
-    struct node* next;
-    const char* key;    // hash元素的键
-    const char* value;  // hash元素的值
-} Node, *Nodeptr;
-
-// 哈希表数据单元
-typedef struct hashEl {
-    Nodeptr h;    // 链表的头结点，定位一个指针
-    uint8_t len;  // 当前链表的结点长度，（为了测试用的，看看链表有多少个节点）
-} HashEl, *HashElptr;
-
-// 哈希表结构
-typedef struct hash {
-    HashElptr* array;             // 哈希表数组
-    float lfactor;                // 负载因子
-    uint8_t cap;                  // 当前哈希表容量
-    uint8_t len;                  // 当前哈希表长度
-    uint8_t helper[MAXHASHSIZE];  // 辅助数组，用于计算负载因子
-} Hash, *Hashptr;
-
-void errExit(const char* errMsg) {
-    fprintf(stderr, "%s\n", errMsg);
-    exit(EXIT_FAILURE);
+#include "chainmap.h"
+
+double nowSec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
-void isNull(Hashptr hptr, const char* key) {
-    // 判断hash结构是否已经初始化
-    if (hptr == NULL) {
-        errExit("hptr is NULL");
+// 当前进程的常驻内存（字节），读取失败返回0
+size_t rssBytes(void) {
+    long pages = 0, resident = 0;
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (fp == NULL) {
+        return 0;
     }
-
-    // 判断键是否为空
-    if (key == NULL) {
-        errExit("key if NULL");
+    if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) {
+        resident = 0;
     }
+    fclose(fp);
+    return (size_t)resident * 4096;
 }
 
-void printInfo(Hashptr hptr) {
-    if (hptr == NULL) {
-        errExit("hptr is NULL");
+// 基准测试：插入n个键，再全部查找一遍，统计吞吐量和每个键值对的内存
+// 键统一放在一块连续内存中，每个键固定KEYWIDTH个字节
+#define KEYWIDTH 24
+void benchFill(size_t n) {
+    char* keys = malloc(n * KEYWIDTH);
+    if (keys == NULL) {
+        errExit("out of memory");
+    }
+    for (size_t i = 0; i < n; i++) {
+        snprintf(keys + i * KEYWIDTH, KEYWIDTH, "key-%zu", i);
     }
 
-    printf(
-        "----------------------------------------------------------------------"
-        "----------------------------\n");
-    printf("cap: %d | len: %d load-factor: %f\n", hptr->cap, hptr->len,
-           hptr->lfactor);
-    printf("table item: \n");
-    for (int i = 0; i < hptr->cap; i++) {
-        printf("%-10d\t", i);
+    size_t rss0 = rssBytes();
+    Hashptr hptr = initHashTable(1024);
+    double t0 = nowSec();
+    for (size_t i = 0; i < n; i++) {
+        insert(hptr, keys + i * KEYWIDTH, keys + i * KEYWIDTH);
     }
-    printf("\n");
-    printf("next: \n");
-    for (int i = 0; i < hptr->cap; i++) {
-        printf("0x%p\t", hptr->array[i]->h->next);
+    double t1 = nowSec();
+    size_t found = 0;
+    for (size_t i = 0; i < n; i++) {
+        found += findNode(hptr, keys + i * KEYWIDTH) != NULL;
     }
-    printf("\n");
+    double t2 = nowSec();
+    size_t rss1 = rssBytes();
+
+    printf("keys: %zu found: %zu cap: %zu load-factor: %f\n", n, found,
+           hptr->cap, hptr->lfactor);
+    printf("insert: %.3fs %.2f Mops/s\n", t1 - t0, n / (t1 - t0) / 1e6);
+    printf("lookup: %.3fs %.2f Mops/s\n", t2 - t1, n / (t2 - t1) / 1e6);
+    printf("bytes/entry: table %.1f rss %.1f\n",
+           (double)tableBytes(hptr) / n, (double)(rss1 - rss0) / n);
+#ifdef HASHSTATS
+    HashStats st = hashStats(hptr);
+    hashStatsPrint(&st);
+#endif
+    destroyHash(hptr);
+    free(keys);
 }
 
-void printKeyValue(Hashptr hptr) {
-    if (hptr == NULL) {
-        errExit("hptr is NULL");
+// 结点分配测试：分别用malloc和slab分配结点，插入n个键再销毁，
+// 统计malloc次数、常驻内存和耗时。每种模式在单独的子进程里跑，
+// 避免前一次释放的内存影响后一次的RSS
+void benchAlloc(size_t n) {
+    char* keys = malloc(n * KEYWIDTH);
+    if (keys == NULL) {
+        errExit("out of memory");
+    }
+    for (size_t i = 0; i < n; i++) {
+        snprintf(keys + i * KEYWIDTH, KEYWIDTH, "key-%zu", i);
     }
 
-    for (int i = 0; i < hptr->cap; i++) {
-        HashElptr item = hptr->array[i];
-        printf("index: %d len: %d  ", i, item->len);
-        for (Nodeptr tmp = item->h->next; tmp != NULL; tmp = tmp->next) {
-            printf("`%s|%s` ", tmp->key, tmp->value);
+    printf("%-8s %12s %12s %12s %12s\n", "nodes", "mallocs", "rss MB",
+           "fill s", "destroy s");
+    for (int useSlab = 0; useSlab <= 1; useSlab++) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            errExit("fork failed");
+        }
+        if (pid == 0) {
+            size_t rss0 = rssBytes();
+            Hashptr hptr = initHashTable(1024);
+            slabInit(&hptr->nodes, sizeof(Node), useSlab);
+            double t0 = nowSec();
+            for (size_t i = 0; i < n; i++) {
+                insert(hptr, keys + i * KEYWIDTH, keys + i * KEYWIDTH);
+            }
+            double t1 = nowSec();
+            size_t rss1 = rssBytes();
+            size_t allocs = hptr->allocs + hptr->nodes.allocs;
+            destroyHash(hptr);
+            double t2 = nowSec();
+            printf("%-8s %12zu %12.1f %12.3f %12.3f\n",
+                   useSlab ? "slab" : "malloc", allocs,
+                   (rss1 - rss0) / 1048576.0, t1 - t0, t2 - t1);
+            exit(EXIT_SUCCESS);
         }
-        printf("\n");
+        waitpid(pid, NULL, 0);
     }
+    free(keys);
 }
 
-// 哈希函数
-uint8_t hashFunc(const char* key, Hashptr hptr) {
-    isNull(hptr, key);
-
-    uint32_t len = 0;
+/*
+    哈希分布测试
+        对比三种哈希函数：
+            length  hash_separate_chaining.c 原来的算法，只用了key的长度
+            shift5  本文件原来的算法，左移5位累加（跳过了第一个字符）
+            wyhash  现在的算法
+        每种语料生成n个互不相同的键，放进n个桶里（负载因子1.0），统计：
+            empty   空桶比例，理想值约为 1/e = 0.368
+            maxlen  最长的链表
+            quality sum(len*(len+1)/2) / 理想随机分布的期望值，越接近1越好
+            coll64  完整64位哈希值冲突的键的个数
+            ns/key  计算一个哈希值的时间
+*/
+
+#define DISTWIDTH 48
+
+uint64_t lengthHash(const char* key) {
+    uint64_t len = 0;
     while (*key++ != '\0') {
-        //++len;
-        len = (len << 5) + *key;
+        ++len;
     }
-    // 得到的返回值最大不超过hptr->cap - 1
-    return len % hptr->cap;
+    return len;
 }
 
-void initTableItem(Hashptr hptr, uint8_t initcap) {
-    // 创建哈希表
-    hptr->array = malloc(sizeof(HashEl) * initcap);
-    if (hptr->array == NULL) {
-        errExit("out of memory");
+uint64_t shift5Hash(const char* key) {
+    uint64_t len = 0;
+    while (*key++ != '\0') {
+        len = (len << 5) + *key;
     }
+    return len;
+}
 
-    // 初始化各项参数
-    hptr->lfactor = 0.0;
-    hptr->len = 0;
-    hptr->cap = initcap;
-    // hptr->helper = malloc(sizeof(uint8_t) * MAXHASHSIZE);
-    memset(hptr->helper, 0, sizeof(uint8_t) * MAXHASHSIZE);
+// xorshift伪随机数
+uint64_t nextRand(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
 
-    // 初始化哈希表项
-    for (int i = 0; i < hptr->cap; i++) {
-        hptr->array[i] = malloc(sizeof(HashEl));
-        if (hptr->array[i] == NULL) {
-            errExit("out of memory");
-        }
-        hptr->array[i]->len = 0;
-        hptr->array[i]->h = malloc(sizeof(Node));
-        if (hptr->array[i]->h == NULL) {
-            errExit("out of memory");
+// 按语料类型生成第i个键
+void makeKey(char* buf, const char* corpus, size_t i, uint64_t* seed) {
+    static const char* syllables[] = {"ka", "to", "ri", "mon", "sel", "da",
+                                      "ve", "lun", "par", "is", "qu", "ent",
+                                      "or", "bi", "na", "xe"};
+    if (strcmp(corpus, "ids") == 0) {
+        snprintf(buf, DISTWIDTH, "user:%zu", i);
+    } else if (strcmp(corpus, "urls") == 0) {
+        snprintf(buf, DISTWIDTH, "https://example.com/p/%zu/item?id=%zu",
+                 i % 1000, i);
+    } else if (strcmp(corpus, "uuids") == 0) {
+        uint64_t a = nextRand(seed), b = nextRand(seed);
+        snprintf(buf, DISTWIDTH, "%08x-%04x-%04x-%04x-%012llx",
+                 (unsigned)(a >> 32), (unsigned)(a >> 16) & 0xffff,
+                 (unsigned)a & 0xffff, (unsigned)(b >> 48),
+                 (unsigned long long)(b & 0xffffffffffffULL));
+    } else if (strcmp(corpus, "ipv4") == 0) {
+        snprintf(buf, DISTWIDTH, "10.%zu.%zu.%zu", (i >> 16) & 0xff,
+                 (i >> 8) & 0xff, i & 0xff);
+        if (i >> 24) {
+            snprintf(buf, DISTWIDTH, "%zu.%zu.%zu.%zu", (i >> 24) & 0xff,
+                     (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff);
         }
-        memset(hptr->array[i]->h, 0, sizeof(Node));
-        hptr->array[i]->h->next = NULL;
-        hptr->array[i]->h->key = NULL;
-        hptr->array[i]->h->value = NULL;
+    } else {
+        // 把i按16进制拆成音节拼成单词，每个i对应唯一的单词
+        char* p = buf;
+        size_t v = i;
+        do {
+            p += sprintf(p, "%s", syllables[v & 15]);
+            v >>= 4;
+        } while (v != 0);
     }
 }
 
-// 初始化哈希表
-Hashptr initHashTable(int initcap) {
-    // 创建哈希结构
-    Hashptr hptr = malloc(sizeof(Hash));
-    if (hptr == NULL) {
-        errExit("out of memory");
-    }
-    // 初始化各项参数
-    initTableItem(hptr, initcap);
-
-    return hptr;
+int cmpU64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
 }
 
-// 查找结点
-Nodeptr findNode(Hashptr hptr, const char* key) {
-    Nodeptr tmp = NULL;
-    int i = hashFunc(key, hptr);
+void benchDist(size_t n) {
+    const char* corpora[] = {"ids", "urls", "uuids", "ipv4", "words"};
+    const char* names[] = {"length", "shift5", "wyhash"};
+    uint64_t (*funcs[])(const char*) = {lengthHash, shift5Hash, hashKey};
 
-    tmp = hptr->array[i]->h->next;
-    while (tmp != NULL && (strcmp(tmp->key, key) != 0)) {
-        tmp = tmp->next;
+    char* keys = malloc(n * DISTWIDTH);
+    uint64_t* hashes = malloc(sizeof(uint64_t) * n);
+    size_t* counts = malloc(sizeof(size_t) * n);
+    if (keys == NULL || hashes == NULL || counts == NULL) {
+        errExit("out of memory");
     }
+    printf("keys: %zu buckets: %zu\n", n, n);
+    printf("%-6s %-6s %8s %8s %9s %8s %8s\n", "corpus", "hash", "empty",
+           "maxlen", "quality", "coll64", "ns/key");
+    for (size_t c = 0; c < sizeof(corpora) / sizeof(corpora[0]); c++) {
+        uint64_t seed = 88172645463325252ULL;
+        for (size_t i = 0; i < n; i++) {
+            makeKey(keys + i * DISTWIDTH, corpora[c], i, &seed);
+        }
+        for (size_t f = 0; f < sizeof(funcs) / sizeof(funcs[0]); f++) {
+            double t0 = nowSec();
+            for (size_t i = 0; i < n; i++) {
+                hashes[i] = funcs[f](keys + i * DISTWIDTH);
+            }
+            double t1 = nowSec();
 
-    return tmp;
-}
+            memset(counts, 0, sizeof(size_t) * n);
+            for (size_t i = 0; i < n; i++) {
+                ++counts[hashes[i] % n];
+            }
+            size_t empty = 0, maxlen = 0;
+            double sum = 0.0;
+            for (size_t i = 0; i < n; i++) {
+                empty += counts[i] == 0;
+                maxlen = counts[i] > maxlen ? counts[i] : maxlen;
+                sum += counts[i] * (counts[i] + 1.0) / 2.0;
+            }
+            double expect = (n / 2.0) * (n + 2.0 * n - 1) / n;
 
-// 将元素结点添加到对应的链表头部当中
-void addNodeToList(Hashptr hptr, const char* key, const char* value) {
-    uint8_t i = hashFunc(key, hptr);
-    Nodeptr head = hptr->array[i]->h;
+            qsort(hashes, n, sizeof(uint64_t), cmpU64);
+            size_t coll = 0;
+            for (size_t i = 1; i < n; i++) {
+                coll += hashes[i] == hashes[i - 1];
+            }
+            printf("%-6s %-6s %8.3f %8zu %9.3f %8zu %8.1f\n", corpora[c],
+                   names[f], (double)empty / n, maxlen, sum / expect, coll,
+                   (t1 - t0) / n * 1e9);
+        }
+    }
+    free(keys);
+    free(hashes);
+    free(counts);
+}
 
-    // 构建新节点
-    Nodeptr newNode = malloc(sizeof(Node));
-    if (newNode == NULL) {
+// 对比逐个findNode和不同批大小的findMany
+// 表要比最后一级缓存大得多，查找顺序是随机的，每次访问都是cache miss
+void benchBatch(size_t n) {
+    size_t q = 10000000;  // 查找次数
+    char* keys = malloc(n * KEYWIDTH);
+    const char** queries = malloc(q * sizeof(const char*));
+    Nodeptr* out = malloc(q * sizeof(Nodeptr));
+    if (keys == NULL || queries == NULL || out == NULL) {
         errExit("out of memory");
     }
-    newNode->key = key;
-    newNode->value = value;
-    // 插入链表头部
-    newNode->next = head->next;
-    head->next = newNode;
-    // 如果有需要就更新负载因子
-    if (!hptr->helper[i]) {
-        // 更新哈希表长度
-        ++hptr->len;
-        // 更新负载因子的值
-        // 强制转成浮点类型，否则无法计算出浮点数
-        hptr->lfactor = (float)hptr->len / (float)hptr->cap;
-        hptr->helper[i] = 1;
-        // printf("%f / %f = %f\n", (float)hptr->len,
-        // (float)hptr->cap,hptr->lfactor);
-    }
-    // 更新链表长度
-    ++hptr->array[i]->len;
-}
+    for (size_t i = 0; i < n; i++) {
+        snprintf(keys + i * KEYWIDTH, KEYWIDTH, "key-%zu", i);
+    }
+    Hashptr hptr = initHashTable(1024);
+    for (size_t i = 0; i < n; i++) {
+        insert(hptr, keys + i * KEYWIDTH, keys + i * KEYWIDTH);
+    }
+    // 插入完以后把扩容迁移做完，不要算到查找里
+    rehashStep(hptr, (int)hptr->oldcap);
+
+    // 十分之一的查找是不存在的键
+    uint64_t seed = 88172645463325252ULL;
+    for (size_t i = 0; i < q; i++) {
+        size_t k = nextRand(&seed) % n;
+        queries[i] = i % 10 == 9 ? "missing-key" : keys + k * KEYWIDTH;
+    }
 
-// 简单扩容两倍
-// 扩容之后需要重新哈希分布，然后拷贝数据到新的哈希表上，释放掉原来的数据
-// 并且重新计算负载因子，如果负载因子还是比原来的大，那么加入随机数，再次
-// 重复以上步骤（重新计算还是先不搞了，it`s too troublesome）
-Hashptr growHash(Hashptr hptr) {
-    if (hptr->lfactor >= LOADFACTOR) {
-        uint8_t oldcap = hptr->cap;
-        HashElptr* old = hptr->array;
-        // 扩容两倍
-        uint8_t doublecap = hptr->cap + hptr->cap;
-        // 重新初始化各项参数
-        initTableItem(hptr, doublecap);
-        // 插入数据后自动哈希，计算负载因子
-        for (int i = 0; i < oldcap; i++) {
-            Nodeptr tmp = old[i]->h->next;
-            // 释放掉旧的头节点
-            free(old[i]->h);
-            while (tmp != NULL) {
-                // 插入旧数据
-                addNodeToList(hptr, tmp->key, tmp->value);
-                // 移动指针到下一个
-                Nodeptr oldNode = tmp;
-                tmp = tmp->next;
-                // 释放旧节点
-                free(oldNode);
+    printf("keys: %zu table MB: %.1f lookups: %zu\n", n,
+           tableBytes(hptr) / 1048576.0, q);
+    printf("%-10s %10s %10s %10s\n", "batch", "seconds", "Mops/s", "found");
+    size_t batches[] = {1, 4, 8, 16, 32, 64, 256};
+    for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+        size_t found = 0;
+        double t0 = nowSec();
+        if (batches[b] == 1) {
+            for (size_t i = 0; i < q; i++) {
+                out[i] = findNode(hptr, queries[i]);
+            }
+        } else {
+            for (size_t i = 0; i < q; i += batches[b]) {
+                size_t m = q - i < batches[b] ? q - i : batches[b];
+                findMany(hptr, queries + i, m, out + i);
             }
         }
-        // 释放掉旧表数据
-        free(old);
+        double t1 = nowSec();
+        for (size_t i = 0; i < q; i++) {
+            found += out[i] != NULL;
+        }
+        char name[16] = "findNode";
+        if (batches[b] != 1) {
+            snprintf(name, sizeof(name), "%zu", batches[b]);
+        }
+        printf("%-10s %10.3f %10.2f %10zu\n", name, t1 - t0,
+               q / (t1 - t0) / 1e6, found);
     }
-
-    return hptr;
+    destroyHash(hptr);
+    free(out);
+    free(queries);
+    free(keys);
 }
 
-void insert(Hashptr hptr, const char* key, const char* value) {
-    if (hptr == NULL) {
-        errExit("hptr is null");
+// 对比引用调用者字符串和自己保存字符串两种模式
+// owning模式下键值都用同一个栈上的缓冲区生成，插完马上被覆盖
+// 之后反复更新和删除一半的键，检查字符串区会被压缩并且内容没有坏
+void benchOwned(size_t n) {
+    char key[64], value[64];
+
+    printf("%-8s %12s %12s %12s %12s\n", "mode", "rss MB", "strs MB",
+           "fill s", "churn s");
+    for (int owning = 0; owning <= 1; owning++) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            errExit("fork failed");
+        }
+        if (pid == 0) {
+            size_t rss0 = rssBytes();
+            // 引用模式下调用者要自己保留所有字符串
+            char* keys = NULL;
+            if (!owning) {
+                keys = malloc(n * KEYWIDTH * 2);
+                if (keys == NULL) {
+                    errExit("out of memory");
+                }
+            }
+            Hashptr hptr = owning ? initOwnedHashTable(1024) : initHashTable(1024);
+            double t0 = nowSec();
+            for (size_t i = 0; i < n; i++) {
+                char* k = owning ? key : keys + i * KEYWIDTH * 2;
+                char* v = owning ? value : k + KEYWIDTH;
+                // 一半是可以放进结点的短键，一半是长键
+                snprintf(k, KEYWIDTH, i & 1 ? "user:%zu" : "session:%016zu", i);
+                snprintf(v, KEYWIDTH, "v%zu", i);
+                insert(hptr, k, v);
+            }
+            double t1 = nowSec();
+            size_t rss1 = rssBytes();
+            size_t strs = hptr->strs.bytes;
+            double t2 = t1;
+            if (owning) {
+                // 反复更新所有值，再删除一半的键
+                for (int round = 0; round < 4; round++) {
+                    for (size_t i = 0; i < n; i++) {
+                        snprintf(key, sizeof(key),
+                                 i & 1 ? "user:%zu" : "session:%016zu", i);
+                        snprintf(value, sizeof(value), "v%zu-%d", i, round);
+                        insert(hptr, key, value);
+                    }
+                }
+                for (size_t i = 0; i < n; i += 2) {
+                    snprintf(key, sizeof(key), "session:%016zu", i);
+                    erase(hptr, key);
+                }
+                t2 = nowSec();
+                for (size_t i = 0; i < n; i++) {
+                    snprintf(key, sizeof(key),
+                             i & 1 ? "user:%zu" : "session:%016zu", i);
+                    snprintf(value, sizeof(value), "v%zu-3", i);
+                    Nodeptr node = findNode(hptr, key);
+                    if ((i & 1) != (node != NULL) ||
+                        (node != NULL && strcmp(node->value, value) != 0)) {
+                        errExit("owned table is corrupted");
+                    }
+                }
+                strs = hptr->strs.bytes;
+            }
+            printf("%-8s %12.1f %12.1f %12.3f %12.3f\n",
+                   owning ? "owned" : "borrowed", (rss1 - rss0) / 1048576.0,
+                   strs / 1048576.0, t1 - t0, t2 - t1);
+            destroyHash(hptr);
+            free(keys);
+            exit(EXIT_SUCCESS);
+        }
+        waitpid(pid, NULL, 0);
     }
+}
 
-    if (key == NULL || value == NULL) {
-        errExit("key or value is null");
-    }
-    printf("insert %s|%s\n", key, value);
-    Nodeptr tmp = findNode(hptr, key);
-    // 如果key不存在，那么就插入键值对
-    if (tmp == NULL) {
-        // 首先需要处理是否需要扩容
-        growHash(hptr);
-        // 插入新的键值对
-        addNodeToList(hptr, key, value);
-    } else {  // 如果键已经存在，那么就更新键值
-        // 默认传进来的是字符串字面量，分配在静态储存区的数组
-        tmp->value = value;
+// 负载尖峰：插入n个键以后删掉99%，看内存能不能还给系统
+// 三种配置各在一个子进程里跑：不缩容、一次性缩容、渐进式缩容，
+// 记录删除的总时间和单次删除的最大延迟
+void benchShrink(size_t n) {
+    char key[32];
+    const char* names[] = {"none", "oneshot", "incremental"};
+
+    printf("%-12s %10s %10s %10s %10s %10s %12s\n", "shrink", "peak MB",
+           "after MB", "cap", "table MB", "erase s", "max erase us");
+    for (int mode = 0; mode < 3; mode++) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            errExit("fork failed");
+        }
+        if (pid == 0) {
+            size_t rss0 = rssBytes();
+            Hashptr hptr = initHashTable(1024);
+            if (mode == 0) {
+                setShrinkPolicy(hptr, 0.0, 1024);
+            }
+            hptr->rehashstep = mode == 1 ? 0 : REHASHSTEP;
+            // 短键直接存在结点里，值用字面量，调用者不需要保留字符串
+            for (size_t i = 0; i < n; i++) {
+                snprintf(key, sizeof(key), "k%zu", i);
+                insert(hptr, key, "v");
+            }
+            size_t peak = rssBytes();
+            double worst = 0.0;
+            double t0 = nowSec();
+            for (size_t i = 0; i < n; i++) {
+                if (i % 100 == 0) {
+                    continue;
+                }
+                snprintf(key, sizeof(key), "k%zu", i);
+                double t1 = nowSec();
+                erase(hptr, key);
+                double dt = nowSec() - t1;
+                if (dt > worst) {
+                    worst = dt;
+                }
+            }
+            double t2 = nowSec();
+            // 剩下的键查一遍，顺便推进没迁移完的部分
+            for (size_t i = 0; i < n; i += 100) {
+                snprintf(key, sizeof(key), "k%zu", i);
+                if (findNode(hptr, key) == NULL) {
+                    errExit("key lost after shrink");
+                }
+            }
+            printf("%-12s %10.1f %10.1f %10zu %10.1f %10.3f %12.1f\n",
+                   names[mode], (peak - rss0) / 1048576.0,
+                   (rssBytes() - rss0) / 1048576.0, hptr->cap,
+                   tableBytes(hptr) / 1048576.0, t2 - t0, worst * 1e6);
+            destroyHash(hptr);
+            exit(EXIT_SUCCESS);
+        }
+        waitpid(pid, NULL, 0);
     }
 }
 
-// 删除键值对
-void erase(Hashptr hptr, const char* key) {
-    isNull(hptr, key);
-
-    // 找到就删除该节点，反之什么都不做
-    HashElptr item = hptr->array[hashFunc(key, hptr)];
-    Nodeptr tmp = item->h;
-    if (tmp != NULL) {
-        // 查找当前给定的key所属的节点的前一个结点
-        while (tmp->next != NULL) {
-            if ((tmp->next->key != NULL) && !strcmp(key, tmp->next->key)) {
-                break;
-            }
-            tmp = tmp->next;
+// 布隆过滤器：同一张表分别不带和带过滤器，按不同的未命中比例查找，
+// 统计吞吐量、实测和估算的误判率、过滤器每个键占的位数
+void benchBloom(size_t n) {
+    size_t q = 10000000;  // 查找次数
+    char* keys = malloc(n * KEYWIDTH);
+    char* missing = malloc(n * KEYWIDTH);
+    const char** queries = malloc(q * sizeof(const char*));
+    if (keys == NULL || missing == NULL || queries == NULL) {
+        errExit("out of memory");
+    }
+    for (size_t i = 0; i < n; i++) {
+        snprintf(keys + i * KEYWIDTH, KEYWIDTH, "key-%zu", i);
+        snprintf(missing + i * KEYWIDTH, KEYWIDTH, "miss-%zu", i);
+    }
+    Hashptr hptr = initHashTable(1024);
+    for (size_t i = 0; i < n; i++) {
+        insert(hptr, keys + i * KEYWIDTH, keys + i * KEYWIDTH);
+    }
+    rehashStep(hptr, (int)hptr->oldcap);
+
+    setBloom(hptr, BLOOM_BITS_PER_KEY);
+    // 实测误判率：不存在的键有多少被过滤器放过去了
+    size_t passed = 0;
+    for (size_t i = 0; i < n; i++) {
+        const char* k = missing + i * KEYWIDTH;
+        passed += bloomCheck(hptr, hashKey(k));
+    }
+    printf("keys: %zu lookups: %zu bloom: %.1f MB %.1f bits/key "
+           "fpr: %.4f%% (estimated %.4f%%)\n",
+           n, q, bloomBytes(&hptr->bloom) / 1048576.0,
+           bloomBytes(&hptr->bloom) * 8.0 / hptr->len, passed * 100.0 / n,
+           bloomFpr(&hptr->bloom) * 100);
+    printf("%-8s %12s %12s %10s\n", "miss%", "plain Mops", "bloom Mops",
+           "found");
+    int misses[] = {0, 30, 50, 70, 90, 100};
+    for (size_t m = 0; m < sizeof(misses) / sizeof(misses[0]); m++) {
+        uint64_t seed = 88172645463325252ULL;
+        for (size_t i = 0; i < q; i++) {
+            uint64_t r = nextRand(&seed);
+            const char* base =
+                (int)(r % 100) < misses[m] ? missing : keys;
+            queries[i] = base + (r >> 8) % n * KEYWIDTH;
         }
-        // 找到就删除节点
-        if (tmp->next != NULL) {
-            Nodeptr node = tmp->next;
-            tmp->next = node->next;
-            printf("delete key: %s\n", node->key);
-            if (item->len != 0) {
-                // 递减链表的节点数量
-                --item->len;
-            } else {
-                errExit("the length of linked list is 0");
+        double mops[2];
+        size_t found = 0;
+        for (int b = 0; b < 2; b++) {
+            setBloom(hptr, b ? BLOOM_BITS_PER_KEY : 0);
+            found = 0;
+            double t0 = nowSec();
+            for (size_t i = 0; i < q; i++) {
+                found += findNode(hptr, queries[i]) != NULL;
             }
-            free(node);
+            mops[b] = q / (nowSec() - t0) / 1e6;
         }
+        printf("%-8d %12.2f %12.2f %10zu\n", misses[m], mops[0], mops[1],
+               found);
     }
+    destroyHash(hptr);
+    free(queries);
+    free(missing);
+    free(keys);
 }
 
-int main(void) {
+// 用法：不带参数运行演示
+//      `bench [n]` 跑基准测试，默认填充10^8个键
+//      `dist [n]`  跑哈希分布测试，默认10^6个键
+//      `alloc [n]` 对比malloc和slab分配结点，默认10^7个键
+//      `owned [n]` 对比引用和复制键值两种模式，默认10^6个键
+//      `batch [n]` 对比逐个查找和批量查找，默认4*10^6个键
+//      `shrink [n]` 插入后删掉99%，对比几种缩容方式的内存，默认10^7个键
+//      `bloom [n]` 对比有没有布隆过滤器时不同未命中比例的查找，默认10^6个键
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        benchFill(argc > 2 ? strtoull(argv[2], NULL, 10) : 100000000);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "dist") == 0) {
+        benchDist(argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "alloc") == 0) {
+        benchAlloc(argc > 2 ? strtoull(argv[2], NULL, 10) : 10000000);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "batch") == 0) {
+        benchBatch(argc > 2 ? strtoull(argv[2], NULL, 10) : 4000000);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "bloom") == 0) {
+        benchBloom(argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "shrink") == 0) {
+        benchShrink(argc > 2 ? strtoull(argv[2], NULL, 10) : 10000000);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "owned") == 0) {
+        benchOwned(argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000);
+        return 0;
+    }
+
     // 初始化
     Hashptr hptr = initHashTable(5);
+    hptr->trace = 1;
     printf("the status of init: \n");
     printInfo(hptr);
 
@@ -302,6 +576,10 @@ int main(void) {
     //     exit(EXIT_FAILURE);
     // }
     printKeyValue(hptr);
+#ifdef HASHSTATS
+    HashStats st = hashStats(hptr);
+    hashStatsPrint(&st);
+#endif
     return 0;
 
     erase(hptr, "key-1");
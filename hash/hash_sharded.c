@@ -0,0 +1,697 @@
+// 无共享的分片哈希表，每个工作线程独占一个分片
+/*
+    模型
+        键按哈希值的高32位分到nshards个分片，每个分片是一张普通的分离链接
+        哈希表（chainmap.h），只有拥有它的工作线程会访问，
+        不需要任何锁
+
+        工作线程i要访问分片j的时候，把请求放进 i->j 的请求队列，线程j处理完
+        以后把结果放进 j->i 的应答队列。每一对线程之间各有一个请求队列和
+        一个应答队列，都是单生产者单消费者（SPSC）的环形队列
+
+            线程0                       线程1
+          +---------+  请求 0->1      +---------+
+          | 分片0   | --------------> | 分片1   |
+          |         | <-------------- |         |
+          +---------+  应答 1->0      +---------+
+
+    批量
+        提交的请求先攒在本地的缓冲区里，每个目标攒够SHARDBATCH个或者flush的
+        时候一次写进队列，只发布一次tail，对方也是一次读完所有的请求，
+        一次发布head，跨核的缓存行传递按批摊薄
+
+    不会死锁
+        队列满的时候一边等一边处理自己收到的请求和应答（shardServe）。
+        处理请求之前先看应答队列还有多少空位，最多只取这么多个请求，
+        所以回应答的时候永远不会阻塞
+
+    接口（都只能在shardRun启动的工作线程里调用）
+        同步：shardGet、shardPut、shardErase，本地分片直接操作，
+              远程分片提交以后一边服务别人一边等结果
+        异步：shardSubmit提交，shardFlush把缓冲区发出去，
+              shardPoll取回已经完成的结果，结果里带提交时的tag
+        工作函数返回以后线程继续服务别人，直到所有线程的工作函数都返回
+
+    表不复制键值，键和值的字符串在表中期间必须一直有效
+*/
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chainmap.h"
+
+#define SHARDQUEUE 1024  // 每个队列的容量，2的幂
+#define SHARDBATCH 32    // 每个目标攒够这么多个请求就发出去
+#define MAXSHARDS 64     // 最多的分片数，也就是工作线程数
+#define CACHELINE 64
+
+// 请求的类型
+enum shardOp { shardOpGet, shardOpPut, shardOpErase };
+
+typedef struct shardReq {
+    const char* key;
+    const char* value;  // put的值
+    uint32_t tag;       // 提交时给的tag，原样带回应答里
+    uint8_t op;         // enum shardOp
+} ShardReq;
+
+// 请求的结果
+typedef struct shardResult {
+    const char* value;  // get找到的值，找不到是NULL
+    uint32_t tag;
+    uint8_t op;
+} ShardResult;
+
+// 单生产者单消费者环形队列，head只有消费者写，tail只有生产者写
+// 两边各自缓存对方的位置，只有缓存的值不够用的时候才去读对方的缓存行
+#define SPSC_QUEUE(name, type)                                               \
+    typedef struct name {                                                    \
+        _Alignas(CACHELINE) _Atomic size_t head;                            \
+        size_t tailCache; /* 消费者看到的tail */                            \
+        _Alignas(CACHELINE) _Atomic size_t tail;                            \
+        size_t headCache; /* 生产者看到的head */                            \
+        _Alignas(CACHELINE) type items[SHARDQUEUE];                         \
+    } name;
+
+SPSC_QUEUE(ReqQueue, ShardReq)
+SPSC_QUEUE(RespQueue, ShardResult)
+
+// 生产者这边还能写几个
+#define SPSC_FREE(q)                                                   \
+    (SHARDQUEUE - (atomic_load_explicit(&(q)->tail, memory_order_relaxed) - \
+                   (q)->headCache))
+
+typedef struct shardedMap ShardedMap;
+
+// 每个工作线程的上下文
+// 按缓存行对齐，相邻线程的上下文不会共享缓存行
+typedef struct shardCtx {
+    _Alignas(CACHELINE) ShardedMap* map;
+    int id;                        // 线程编号，也是它拥有的分片编号
+    ShardReq out[MAXSHARDS][SHARDBATCH];  // 发往每个分片还没发出去的请求
+    int nout[MAXSHARDS];
+    ShardResult* done;             // 已经完成还没被shardPoll取走的结果
+    size_t ndone;
+    size_t donecap;
+    size_t pending;                // 已经提交还没收到结果的请求数
+    ShardResult syncResult;        // 同步调用的结果
+    int syncWaiting;               // 同步调用还在等结果
+    size_t served;                 // 替别的线程处理的请求数
+} ShardCtx;
+
+struct shardedMap {
+    int nshards;
+    Hashptr shards[MAXSHARDS];
+    ReqQueue* req;    // req[from * nshards + to]
+    RespQueue* resp;  // resp[from * nshards + to]，from是处理请求的线程
+    ShardCtx* ctxs;
+    _Atomic int finished;  // 工作函数已经返回的线程数
+};
+
+#define SYNCTAG UINT32_MAX  // 同步调用用的tag
+
+// 创建有nshards个分片的表，每个分片的初始容量是initcap
+ShardedMap* initShardedMap(int nshards, size_t initcap) {
+    if (nshards < 1 || nshards > MAXSHARDS) {
+        errExit("bad shard count");
+    }
+    ShardedMap* m = calloc(1, sizeof(ShardedMap));
+    if (m == NULL) {
+        errExit("out of memory");
+    }
+    m->nshards = nshards;
+    for (int i = 0; i < nshards; i++) {
+        m->shards[i] = initHashTable(initcap);
+    }
+    size_t pairs = (size_t)nshards * nshards;
+    m->req = aligned_alloc(CACHELINE, sizeof(ReqQueue) * pairs);
+    m->resp = aligned_alloc(CACHELINE, sizeof(RespQueue) * pairs);
+    m->ctxs = aligned_alloc(CACHELINE, sizeof(ShardCtx) * nshards);
+    if (m->req == NULL || m->resp == NULL || m->ctxs == NULL) {
+        errExit("out of memory");
+    }
+    memset(m->req, 0, sizeof(ReqQueue) * pairs);
+    memset(m->resp, 0, sizeof(RespQueue) * pairs);
+    memset(m->ctxs, 0, sizeof(ShardCtx) * nshards);
+    for (int i = 0; i < nshards; i++) {
+        m->ctxs[i].map = m;
+        m->ctxs[i].id = i;
+    }
+    return m;
+}
+
+void destroyShardedMap(ShardedMap* m) {
+    for (int i = 0; i < m->nshards; i++) {
+        destroyHash(m->shards[i]);
+        free(m->ctxs[i].done);
+    }
+    free(m->req);
+    free(m->resp);
+    free(m->ctxs);
+    free(m);
+}
+
+// 哈希值所在的分片，分片用高32位，分片内的桶用的是低位
+int shardOf(ShardedMap* m, uint64_t hash) {
+    return (int)(((hash >> 32) * (uint64_t)m->nshards) >> 32);
+}
+
+// 在自己的分片上执行一个请求
+ShardResult execute(Hashptr shard, const ShardReq* r) {
+    ShardResult res = {NULL, r->tag, r->op};
+    switch (r->op) {
+        case shardOpGet: {
+            Nodeptr node = findNode(shard, r->key);
+            res.value = node != NULL ? node->value : NULL;
+            break;
+        }
+        case shardOpPut:
+            insert(shard, r->key, r->value);
+            break;
+        default:
+            erase(shard, r->key);
+            break;
+    }
+    return res;
+}
+
+// 收到一个结果
+void complete(ShardCtx* ctx, ShardResult res) {
+    --ctx->pending;
+    if (res.tag == SYNCTAG && ctx->syncWaiting) {
+        ctx->syncResult = res;
+        ctx->syncWaiting = 0;
+        return;
+    }
+    if (ctx->ndone == ctx->donecap) {
+        ctx->donecap = ctx->donecap ? ctx->donecap * 2 : 256;
+        ctx->done = realloc(ctx->done, sizeof(ShardResult) * ctx->donecap);
+        if (ctx->done == NULL) {
+            errExit("out of memory");
+        }
+    }
+    ctx->done[ctx->ndone++] = res;
+}
+
+// 处理别的线程发来的请求，收回自己请求的结果，返回做了多少事
+size_t shardServe(ShardCtx* ctx) {
+    ShardedMap* m = ctx->map;
+    Hashptr shard = m->shards[ctx->id];
+    size_t work = 0;
+    for (int from = 0; from < m->nshards; from++) {
+        // 别的线程发给我的请求，应答写回 我->from
+        ReqQueue* rq = &m->req[from * m->nshards + ctx->id];
+        RespQueue* aq = &m->resp[ctx->id * m->nshards + from];
+        size_t head = atomic_load_explicit(&rq->head, memory_order_relaxed);
+        if (rq->tailCache == head) {
+            rq->tailCache =
+                atomic_load_explicit(&rq->tail, memory_order_acquire);
+        }
+        size_t n = rq->tailCache - head;
+        if (n > 0) {
+            if (SPSC_FREE(aq) < n) {
+                aq->headCache = atomic_load_explicit(&aq->head,
+                                                     memory_order_acquire);
+            }
+            size_t space = SPSC_FREE(aq);
+            n = n < space ? n : space;
+            size_t tail = atomic_load_explicit(&aq->tail, memory_order_relaxed);
+            for (size_t i = 0; i < n; i++) {
+                const ShardReq* r = &rq->items[(head + i) & (SHARDQUEUE - 1)];
+                aq->items[(tail + i) & (SHARDQUEUE - 1)] = execute(shard, r);
+            }
+            atomic_store_explicit(&rq->head, head + n, memory_order_release);
+            atomic_store_explicit(&aq->tail, tail + n, memory_order_release);
+            ctx->served += n;
+            work += n;
+        }
+
+        // 我发给别的线程的请求的结果，在 from->我 的应答队列里
+        RespQueue* bq = &m->resp[from * m->nshards + ctx->id];
+        head = atomic_load_explicit(&bq->head, memory_order_relaxed);
+        if (bq->tailCache == head) {
+            bq->tailCache =
+                atomic_load_explicit(&bq->tail, memory_order_acquire);
+        }
+        n = bq->tailCache - head;
+        for (size_t i = 0; i < n; i++) {
+            complete(ctx, bq->items[(head + i) & (SHARDQUEUE - 1)]);
+        }
+        if (n > 0) {
+            atomic_store_explicit(&bq->head, head + n, memory_order_release);
+            work += n;
+        }
+    }
+    return work;
+}
+
+// 没事可做的时候让出CPU，线程比核多的时候对方才能运行
+void shardIdle(ShardCtx* ctx) {
+    if (shardServe(ctx) == 0) {
+        sched_yield();
+    }
+}
+
+// 把发往分片to的缓冲区写进队列，队列满了就一边服务一边等
+void flushTo(ShardCtx* ctx, int to) {
+    ShardedMap* m = ctx->map;
+    ReqQueue* q = &m->req[ctx->id * m->nshards + to];
+    int n = ctx->nout[to];
+    while (SPSC_FREE(q) < (size_t)n) {
+        q->headCache = atomic_load_explicit(&q->head, memory_order_acquire);
+        if (SPSC_FREE(q) < (size_t)n) {
+            shardIdle(ctx);
+        }
+    }
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    for (int i = 0; i < n; i++) {
+        q->items[(tail + i) & (SHARDQUEUE - 1)] = ctx->out[to][i];
+    }
+    atomic_store_explicit(&q->tail, tail + n, memory_order_release);
+    ctx->nout[to] = 0;
+}
+
+// 把所有缓冲区里的请求发出去
+void shardFlush(ShardCtx* ctx) {
+    for (int to = 0; to < ctx->map->nshards; to++) {
+        if (ctx->nout[to] > 0) {
+            flushTo(ctx, to);
+        }
+    }
+}
+
+// 异步提交一个请求，本地分片直接执行，结果和远程的一样从shardPoll取
+// tag由调用者决定，UINT32_MAX留给同步调用
+void shardSubmit(ShardCtx* ctx, enum shardOp op, const char* key,
+                 const char* value, uint32_t tag) {
+    if (key == NULL || tag == SYNCTAG) {
+        errExit("key is NULL or tag is reserved");
+    }
+    ShardReq r = {key, value, tag, (uint8_t)op};
+    int to = shardOf(ctx->map, hashKey(key));
+    ++ctx->pending;
+    if (to == ctx->id) {
+        complete(ctx, execute(ctx->map->shards[to], &r));
+        return;
+    }
+    ctx->out[to][ctx->nout[to]++] = r;
+    if (ctx->nout[to] == SHARDBATCH) {
+        flushTo(ctx, to);
+    }
+}
+
+// 取回最多max个已经完成的结果，返回取到的个数
+// 没有完成的结果时顺便处理一轮别的线程的请求
+size_t shardPoll(ShardCtx* ctx, ShardResult* out, size_t max) {
+    if (ctx->ndone == 0) {
+        shardServe(ctx);
+    }
+    size_t n = ctx->ndone < max ? ctx->ndone : max;
+    memcpy(out, ctx->done, sizeof(ShardResult) * n);
+    memmove(ctx->done, ctx->done + n, sizeof(ShardResult) * (ctx->ndone - n));
+    ctx->ndone -= n;
+    return n;
+}
+
+// 同步执行一个请求
+ShardResult shardCall(ShardCtx* ctx, enum shardOp op, const char* key,
+                      const char* value) {
+    if (key == NULL) {
+        errExit("key is NULL");
+    }
+    ShardReq r = {key, value, SYNCTAG, (uint8_t)op};
+    int to = shardOf(ctx->map, hashKey(key));
+    if (to == ctx->id) {
+        return execute(ctx->map->shards[to], &r);
+    }
+    // 同一个目标之前异步提交的请求要先发出去，保证按提交顺序执行
+    ctx->out[to][ctx->nout[to]++] = r;
+    ++ctx->pending;
+    ctx->syncWaiting = 1;
+    flushTo(ctx, to);
+    while (ctx->syncWaiting) {
+        shardIdle(ctx);
+    }
+    return ctx->syncResult;
+}
+
+const char* shardGet(ShardCtx* ctx, const char* key) {
+    return shardCall(ctx, shardOpGet, key, NULL).value;
+}
+
+void shardPut(ShardCtx* ctx, const char* key, const char* value) {
+    if (value == NULL) {
+        errExit("value is NULL");
+    }
+    shardCall(ctx, shardOpPut, key, value);
+}
+
+void shardErase(ShardCtx* ctx, const char* key) {
+    shardCall(ctx, shardOpErase, key, NULL);
+}
+
+typedef struct shardRunArg {
+    ShardCtx* ctx;
+    void (*fn)(ShardCtx* ctx, void* arg);
+    void* arg;
+} ShardRunArg;
+
+void* shardWorker(void* p) {
+    ShardRunArg* a = p;
+    ShardCtx* ctx = a->ctx;
+    a->fn(ctx, a->arg);
+    // 把剩下的请求发出去并等所有结果回来，没被取走的结果丢掉
+    shardFlush(ctx);
+    while (ctx->pending > 0) {
+        shardIdle(ctx);
+    }
+    ctx->ndone = 0;
+    atomic_fetch_add(&ctx->map->finished, 1);
+    // 别的线程可能还要访问自己的分片
+    while (atomic_load(&ctx->map->finished) < ctx->map->nshards) {
+        shardIdle(ctx);
+    }
+    return NULL;
+}
+
+// 启动nshards个工作线程，每个都运行fn(ctx, arg)，全部结束以后返回
+void shardRun(ShardedMap* m, void (*fn)(ShardCtx* ctx, void* arg),
+              void* arg) {
+    pthread_t tids[MAXSHARDS];
+    ShardRunArg args[MAXSHARDS];
+    atomic_store(&m->finished, 0);
+    for (int i = 0; i < m->nshards; i++) {
+        args[i] = (ShardRunArg){&m->ctxs[i], fn, arg};
+        if (pthread_create(&tids[i], NULL, shardWorker, &args[i]) != 0) {
+            errExit("pthread_create failed");
+        }
+    }
+    for (int i = 0; i < m->nshards; i++) {
+        pthread_join(tids[i], NULL);
+    }
+}
+
+// 所有分片的元素个数，只能在shardRun之外调用
+size_t shardedLen(ShardedMap* m) {
+    size_t len = 0;
+    for (int i = 0; i < m->nshards; i++) {
+        len += m->shards[i]->len;
+    }
+    return len;
+}
+
+// 吞吐量测试
+/*
+    nkeys个键先插入，之后每个线程做ops次操作，readPct%是查找，其余是更新
+        global    一张表一把全局锁
+        striped   STRIPES张表，按哈希值选表，每张表一把锁
+        sync      分片表，每个操作同步等结果
+        async     分片表，每个线程同时有最多ASYNCWINDOW个请求在路上
+*/
+#define STRIPES 64
+#define ASYNCWINDOW 256
+#define KEYWIDTH 24  // 每个键固定的字节数
+
+double nowSec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// xorshift伪随机数
+uint64_t nextRand(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+typedef struct lockedTable {
+    _Alignas(CACHELINE) pthread_mutex_t lock;
+    Hashptr hptr;
+} LockedTable;
+
+typedef struct shardBench {
+    const char* keys;  // 每个键KEYWIDTH个字节
+    size_t nkeys;
+    size_t ops;
+    int readPct;
+    LockedTable* tables;  // global和striped用，global只有一张
+    int ntables;
+    int async;
+    int nthreads;
+    size_t hits[MAXSHARDS];
+} ShardBench;
+
+// 第i个线程第j次操作的键和类型
+const char* benchKey(ShardBench* b, uint64_t* seed, int* isRead) {
+    uint64_t r = nextRand(seed);
+    *isRead = (int)(r % 100) < b->readPct;
+    return b->keys + (r >> 8) % b->nkeys * KEYWIDTH;
+}
+
+typedef struct lockedArg {
+    ShardBench* b;
+    int id;
+} LockedArg;
+
+void* lockedWorker(void* p) {
+    LockedArg* a = p;
+    ShardBench* b = a->b;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL * (a->id + 1);
+    size_t hits = 0;
+    for (size_t i = 0; i < b->ops; i++) {
+        int isRead;
+        const char* key = benchKey(b, &seed, &isRead);
+        LockedTable* t = &b->tables[b->ntables == 1
+                                        ? 0
+                                        : hashKey(key) >> 32 & (STRIPES - 1)];
+        pthread_mutex_lock(&t->lock);
+        if (isRead) {
+            hits += findNode(t->hptr, key) != NULL;
+        } else {
+            insert(t->hptr, key, key);
+        }
+        pthread_mutex_unlock(&t->lock);
+    }
+    b->hits[a->id] = hits;
+    return NULL;
+}
+
+double benchLocked(ShardBench* b, int ntables) {
+    LockedTable* tables =
+        aligned_alloc(CACHELINE, sizeof(LockedTable) * ntables);
+    if (tables == NULL) {
+        errExit("out of memory");
+    }
+    for (int i = 0; i < ntables; i++) {
+        pthread_mutex_init(&tables[i].lock, NULL);
+        tables[i].hptr = initHashTable(1024);
+    }
+    for (size_t i = 0; i < b->nkeys; i++) {
+        const char* key = b->keys + i * KEYWIDTH;
+        int t = ntables == 1 ? 0 : hashKey(key) >> 32 & (STRIPES - 1);
+        insert(tables[t].hptr, key, key);
+    }
+    b->tables = tables;
+    b->ntables = ntables;
+    pthread_t tids[MAXSHARDS];
+    LockedArg args[MAXSHARDS];
+    double t0 = nowSec();
+    for (int i = 0; i < b->nthreads; i++) {
+        args[i] = (LockedArg){b, i};
+        pthread_create(&tids[i], NULL, lockedWorker, &args[i]);
+    }
+    for (int i = 0; i < b->nthreads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    double t1 = nowSec();
+    for (int i = 0; i < ntables; i++) {
+        pthread_mutex_destroy(&tables[i].lock);
+        destroyHash(tables[i].hptr);
+    }
+    free(tables);
+    return b->nthreads * b->ops / (t1 - t0) / 1e6;
+}
+
+// 每个线程把属于自己分片的键插进去
+void shardFill(ShardCtx* ctx, void* p) {
+    ShardBench* b = p;
+    for (size_t i = 0; i < b->nkeys; i++) {
+        const char* key = b->keys + i * KEYWIDTH;
+        if (shardOf(ctx->map, hashKey(key)) == ctx->id) {
+            shardPut(ctx, key, key);
+        }
+    }
+}
+
+void shardBenchWorker(ShardCtx* ctx, void* p) {
+    ShardBench* b = p;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL * (ctx->id + 1);
+    size_t hits = 0;
+    if (!b->async) {
+        for (size_t i = 0; i < b->ops; i++) {
+            int isRead;
+            const char* key = benchKey(b, &seed, &isRead);
+            if (isRead) {
+                hits += shardGet(ctx, key) != NULL;
+            } else {
+                shardPut(ctx, key, key);
+            }
+        }
+    } else {
+        ShardResult res[ASYNCWINDOW];
+        size_t submitted = 0, completed = 0;
+        while (completed < b->ops) {
+            while (submitted < b->ops && submitted - completed < ASYNCWINDOW) {
+                int isRead;
+                const char* key = benchKey(b, &seed, &isRead);
+                shardSubmit(ctx, isRead ? shardOpGet : shardOpPut, key, key,
+                            (uint32_t)submitted++);
+            }
+            shardFlush(ctx);
+            size_t n = shardPoll(ctx, res, ASYNCWINDOW);
+            for (size_t i = 0; i < n; i++) {
+                hits += res[i].op == shardOpGet && res[i].value != NULL;
+            }
+            completed += n;
+            if (n == 0) {
+                sched_yield();
+            }
+        }
+    }
+    b->hits[ctx->id] = hits;
+}
+
+double benchSharded(ShardBench* b, int async) {
+    ShardedMap* m = initShardedMap(b->nthreads, 1024);
+    shardRun(m, shardFill, b);
+    if (shardedLen(m) != b->nkeys) {
+        errExit("shard fill mismatch");
+    }
+    b->async = async;
+    double t0 = nowSec();
+    shardRun(m, shardBenchWorker, b);
+    double t1 = nowSec();
+    destroyShardedMap(m);
+    return b->nthreads * b->ops / (t1 - t0) / 1e6;
+}
+
+void benchShards(size_t nkeys, size_t ops) {
+    char* keys = malloc(nkeys * KEYWIDTH);
+    if (keys == NULL) {
+        errExit("out of memory");
+    }
+    for (size_t i = 0; i < nkeys; i++) {
+        snprintf(keys + i * KEYWIDTH, KEYWIDTH, "key-%zu", i);
+    }
+    ShardBench b = {keys, nkeys, ops, 90, NULL, 0, 0, 1, {0}};
+    printf("keys: %zu ops/thread: %zu read: %d%% cpus: %ld\n", nkeys, ops,
+           b.readPct, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-8s %10s %10s %10s %10s  (Mops/s)\n", "threads", "global",
+           "striped", "sync", "async");
+    int threads[] = {1, 2, 4, 8, 16};
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+        b.nthreads = threads[t];
+        double global = benchLocked(&b, 1);
+        double striped = benchLocked(&b, STRIPES);
+        double sync = benchSharded(&b, 0);
+        double async = benchSharded(&b, 1);
+        printf("%-8d %10.2f %10.2f %10.2f %10.2f\n", threads[t], global,
+               striped, sync, async);
+    }
+    free(keys);
+}
+
+// 演示：每个线程写自己的8个键，键会落到各个分片上
+// 第二轮同步读回自己的键并删掉一个，再异步读所有线程的键
+typedef struct demoArg {
+    char keys[MAXSHARDS][8][16];
+    size_t found[MAXSHARDS];   // 异步读到的键数
+    size_t errors[MAXSHARDS];
+} DemoArg;
+
+void demoPut(ShardCtx* ctx, void* p) {
+    DemoArg* d = p;
+    for (int i = 0; i < 8; i++) {
+        snprintf(d->keys[ctx->id][i], 16, "t%d-k%d", ctx->id, i);
+        shardPut(ctx, d->keys[ctx->id][i], d->keys[ctx->id][i]);
+    }
+}
+
+void demoGet(ShardCtx* ctx, void* p) {
+    DemoArg* d = p;
+    int n = ctx->map->nshards;
+    for (int i = 0; i < 8; i++) {
+        const char* v = shardGet(ctx, d->keys[ctx->id][i]);
+        if (v == NULL || strcmp(v, d->keys[ctx->id][i]) != 0) {
+            ++d->errors[ctx->id];
+        }
+    }
+    shardErase(ctx, d->keys[ctx->id][7]);
+    if (shardGet(ctx, d->keys[ctx->id][7]) != NULL) {
+        ++d->errors[ctx->id];
+    }
+    // 别的线程可能还没删它的第8个键，只读前7个
+    for (int t = 0; t < n; t++) {
+        for (int i = 0; i < 7; i++) {
+            shardSubmit(ctx, shardOpGet, d->keys[t][i], NULL,
+                        (uint32_t)(t * 8 + i));
+        }
+    }
+    shardFlush(ctx);
+    ShardResult res[64];
+    size_t got = 0;
+    while (got < (size_t)n * 7) {
+        size_t k = shardPoll(ctx, res, 64);
+        for (size_t j = 0; j < k; j++) {
+            const char* want = d->keys[res[j].tag / 8][res[j].tag % 8];
+            if (res[j].value == NULL || strcmp(res[j].value, want) != 0) {
+                ++d->errors[ctx->id];
+            } else {
+                ++d->found[ctx->id];
+            }
+        }
+        got += k;
+        if (k == 0) {
+            sched_yield();
+        }
+    }
+}
+
+// 用法：不带参数运行演示
+//      `bench [keys] [ops]` 对比全局锁、分段锁、同步和异步分片的吞吐量，
+//                           默认10^6个键，每个线程10^6次操作
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        benchShards(argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000,
+                    argc > 3 ? strtoull(argv[3], NULL, 10) : 1000000);
+        return 0;
+    }
+
+    int nshards = 4;
+    ShardedMap* m = initShardedMap(nshards, 16);
+    DemoArg* d = calloc(1, sizeof(DemoArg));
+    if (d == NULL) {
+        errExit("out of memory");
+    }
+    shardRun(m, demoPut, d);
+    shardRun(m, demoGet, d);
+    size_t errors = 0;
+    for (int i = 0; i < nshards; i++) {
+        printf("shard %d: len %zu served %zu async found %zu\n", i,
+               m->shards[i]->len, m->ctxs[i].served, d->found[i]);
+        errors += d->errors[i];
+    }
+    printf("len: %zu errors: %zu\n", shardedLen(m), errors);
+    free(d);
+    destroyShardedMap(m);
+    return 0;
+}
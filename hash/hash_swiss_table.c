@@ -0,0 +1,512 @@
+// 开放定址法实现哈希表（Swiss table 风格）
+/*
+    模型
+        键和状态分开存放，ctrl数组每个槽位只占一个字节：
+            0x80        empty，当前项可用
+            0xFE        deleted，已被删除（懒惰删除），可用
+            0x00~0x7F   legitimate，当前项已被占用，低7位保存键的哈希值的低7位
+
+        每16个槽位为一组，查找时用SSE2一次比较一组的16个ctrl字节，
+        只有ctrl字节相等的槽位才会去读keys数组比较键
+
+               group 0                         group 1
+        ctrl  +----+----+----+-----+----+     +----+----+-----+
+              | 12 | 80 | 7F | ... | FE |     | 80 | 33 | ... |
+              +----+----+----+-----+----+     +----+----+-----+
+        keys  | k0 |    | k2 | ... |    |     |    | k17| ... |
+              +----+----+----+-----+----+     +----+----+-----+
+
+        哈希值的高位决定从哪一组开始探测，组之间按三角数序列探测
+        （1，2，3...组的步长），容量是2的幂时可以遍历所有组
+*/
+
+#include <memory.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "hashstats.h"
+
+#define LOAD_FACTOR_MAX 0.875  // 默认的最大负载因子
+#define LOAD_FACTOR_MIN 0.2    // 元素个数低于容量的这个比例时缩容
+#define TOMBSTONE_MAX 0.25     // deleted超过容量的这个比例时原地清理
+#define GROUPSIZE 16           // 每组的槽位数量
+
+#define CTRL_EMPTY ((int8_t)0x80)
+#define CTRL_DELETED ((int8_t)0xFE)
+#define CTRL_MOVING ((int8_t)0xFF)  // 原地清理时还没放好的元素，只在清理中出现
+
+typedef struct hash {
+    int8_t* ctrl;    // 控制字节数组
+    int32_t* keys;   // 存储元素的数组
+    float lfactor;   // 负载因子，包括已删除的槽位
+    float maxload;   // 触发扩容的负载因子
+    size_t cap;      // 表的容量，GROUPSIZE的整数倍并且是2的幂
+    size_t len;      // 表的当前元素个数
+    size_t deleted;  // 标记为deleted的槽位个数
+    size_t mincap;   // 缩容的下限，就是初始容量
+#ifdef HASHSTATS
+    HashCounters counters;  // 扩容次数和用时
+#endif
+} Hash, *Hashptr;
+
+void errExit(const char* errMsg) {
+    fprintf(stderr, "%s\n", errMsg);
+    exit(EXIT_FAILURE);
+}
+
+void printInfo(Hashptr hptr) {
+    if (hptr == NULL) {
+        return;
+    }
+    printf("load factor: %0.2f\tlen: %zu\tdeleted: %zu\tcap: %zu\n",
+           hptr->lfactor, hptr->len, hptr->deleted, hptr->cap);
+    for (size_t i = 0; i < hptr->cap; i++) {
+        if (hptr->ctrl[i] >= 0) {
+            printf("%zu  %d  ctrl[%02x]\n", i, hptr->keys[i],
+                   (uint8_t)hptr->ctrl[i]);
+        }
+    }
+}
+
+// 整数键的哈希函数，乘法之后把高位混合到低位
+uint64_t hashfunc(int32_t key) {
+    uint64_t h = (uint64_t)(uint32_t)key * 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 32);
+}
+
+// 哈希值的低7位存到ctrl字节里
+int8_t h2(uint64_t hash) {
+    return (int8_t)(hash & 0x7F);
+}
+
+// 返回一组ctrl字节中等于tag的槽位掩码，第i位为1表示第i个槽位匹配
+uint32_t matchGroup(const int8_t* group, int8_t tag) {
+#ifdef __SSE2__
+    __m128i ctrl = _mm_load_si128((const __m128i*)group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(tag)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < GROUPSIZE; i++) {
+        mask |= (uint32_t)(group[i] == tag) << i;
+    }
+    return mask;
+#endif
+}
+
+// 返回一组ctrl字节中empty或deleted的槽位掩码（最高位为1）
+uint32_t matchFree(const int8_t* group) {
+#ifdef __SSE2__
+    return _mm_movemask_epi8(_mm_load_si128((const __m128i*)group));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < GROUPSIZE; i++) {
+        mask |= (uint32_t)(group[i] < 0) << i;
+    }
+    return mask;
+#endif
+}
+
+// 如果找到就返回该key所在的槽位下标，找不到返回-1
+// 一组中只要出现empty就说明key不可能在后面的组里，探测结束
+int64_t find(Hashptr hptr, int32_t key) {
+    uint64_t hash = hashfunc(key);
+    int8_t tag = h2(hash);
+    size_t groupmask = hptr->cap / GROUPSIZE - 1;
+    size_t g = (hash >> 7) & groupmask;
+
+    for (size_t step = 1; step <= groupmask + 1; step++) {
+        const int8_t* group = hptr->ctrl + g * GROUPSIZE;
+        for (uint32_t m = matchGroup(group, tag); m != 0; m &= m - 1) {
+            size_t i = g * GROUPSIZE + __builtin_ctz(m);
+            if (hptr->keys[i] == key) {
+                return (int64_t)i;
+            }
+        }
+        if (matchGroup(group, CTRL_EMPTY) != 0) {
+            break;
+        }
+        g = (g + step) & groupmask;
+    }
+    return -1;
+}
+
+// 沿着key的探测序列找第一个empty或deleted的槽位
+size_t findFree(Hashptr hptr, uint64_t hash) {
+    size_t groupmask = hptr->cap / GROUPSIZE - 1;
+    size_t g = (hash >> 7) & groupmask;
+
+    for (size_t step = 1;; step++) {
+        uint32_t m = matchFree(hptr->ctrl + g * GROUPSIZE);
+        if (m != 0) {
+            return g * GROUPSIZE + __builtin_ctz(m);
+        }
+        g = (g + step) & groupmask;
+    }
+}
+
+// 向上取GROUPSIZE整数倍的2的幂
+size_t upToPow2(size_t num) {
+    size_t cap = GROUPSIZE;
+    while (cap < num) {
+        cap <<= 1;
+    }
+    return cap;
+}
+
+void inithash(Hashptr hptr, size_t initcap) {
+    hptr->lfactor = 0.0;
+    hptr->len = 0;
+    hptr->deleted = 0;
+    hptr->cap = upToPow2(initcap);
+    // ctrl按16字节对齐，才能用_mm_load_si128整组读取
+    hptr->ctrl = aligned_alloc(GROUPSIZE, hptr->cap);
+    hptr->keys = malloc(sizeof(int32_t) * hptr->cap);
+    if (hptr->ctrl == NULL || hptr->keys == NULL) {
+        errExit("out of memory");
+    }
+    // 初始化数组的每个项，都设置为empty
+    memset(hptr->ctrl, CTRL_EMPTY, hptr->cap);
+}
+
+// 调用者保证key不存在并且有空闲槽位
+void insertIntoArray(Hashptr hptr, int32_t key) {
+    uint64_t hash = hashfunc(key);
+    size_t i = findFree(hptr, hash);
+    // deleted槽位被重新使用，不再算作deleted
+    if (hptr->ctrl[i] == CTRL_DELETED) {
+        --hptr->deleted;
+    }
+    hptr->ctrl[i] = h2(hash);
+    hptr->keys[i] = key;
+    // 更新负载因子和长度
+    ++hptr->len;
+    hptr->lfactor = (float)(hptr->len + hptr->deleted) / (float)hptr->cap;
+}
+
+// 把元素迁移到容量为newcap的新数组，deleted丢掉，扩容和缩容都用它
+void resizehash(Hashptr hptr, size_t newcap) {
+#ifdef HASHSTATS
+    double t0 = hashStatsNow();
+#endif
+    size_t oldcap = hptr->cap;
+    // 取出旧数组
+    int8_t* oldCtrl = hptr->ctrl;
+    int32_t* oldKeys = hptr->keys;
+    // 重新初始化哈希表
+    inithash(hptr, newcap);
+    // 迁移数组元素
+    for (size_t i = 0; i < oldcap; i++) {
+        if (oldCtrl[i] >= 0) {
+            insertIntoArray(hptr, oldKeys[i]);
+        }
+    }
+    // 释放旧数组数据
+    free(oldCtrl);
+    free(oldKeys);
+#ifdef HASHSTATS
+    hashCountersAdd(&hptr->counters, t0);
+#endif
+}
+
+// 原地清理deleted，不需要另外分配数组
+/*
+    先把deleted都改成empty，元素都改成CTRL_MOVING，然后逐个重新放置：
+    CTRL_MOVING的最高位也是1，findFree会把它当成空闲槽位，
+    找到的位置和元素在同一组就原地不动，是empty就搬过去，
+    是另一个还没放好的元素就交换，换过来的元素接着处理。
+    放好的元素不会再动，所以每个元素探测序列上前面的组都是满的，查找不会提前停下
+*/
+void purgeTombstones(Hashptr hptr) {
+#ifdef HASHSTATS
+    double t0 = hashStatsNow();
+#endif
+    for (size_t i = 0; i < hptr->cap; i++) {
+        if (hptr->ctrl[i] == CTRL_DELETED) {
+            hptr->ctrl[i] = CTRL_EMPTY;
+        } else if (hptr->ctrl[i] >= 0) {
+            hptr->ctrl[i] = CTRL_MOVING;
+        }
+    }
+    for (size_t j = 0; j < hptr->cap; j++) {
+        while (hptr->ctrl[j] == CTRL_MOVING) {
+            uint64_t hash = hashfunc(hptr->keys[j]);
+            size_t i = findFree(hptr, hash);
+            if (i / GROUPSIZE == j / GROUPSIZE) {
+                hptr->ctrl[j] = h2(hash);
+            } else if (hptr->ctrl[i] == CTRL_EMPTY) {
+                hptr->keys[i] = hptr->keys[j];
+                hptr->ctrl[i] = h2(hash);
+                hptr->ctrl[j] = CTRL_EMPTY;
+            } else {
+                int32_t key = hptr->keys[i];
+                hptr->keys[i] = hptr->keys[j];
+                hptr->ctrl[i] = h2(hash);
+                hptr->keys[j] = key;
+            }
+        }
+    }
+    hptr->deleted = 0;
+    hptr->lfactor = (float)hptr->len / (float)hptr->cap;
+#ifdef HASHSTATS
+    hashCountersAdd(&hptr->counters, t0);
+#endif
+}
+
+// 扩容哈希表
+// deleted也占着槽位，所以负载因子把它们也算上。如果大部分是deleted，
+// 那么原地清理掉它们就够了，不需要扩容
+void growhash(Hashptr hptr) {
+    if ((float)(hptr->len + hptr->deleted + 1) / (float)hptr->cap >
+        hptr->maxload) {
+        if ((float)(hptr->len + 1) / (float)hptr->cap > hptr->maxload / 2) {
+            resizehash(hptr, hptr->cap * 2);
+        } else {
+            purgeTombstones(hptr);
+        }
+    }
+}
+
+// 删除之后检查要不要缩容或者清理deleted
+// 缩容到负载因子在LOAD_FACTOR_MIN和maxload中间，留出滞回的余地，
+// 在阈值附近反复插入删除不会来回扩容缩容
+void shrinkhash(Hashptr hptr) {
+    if ((float)hptr->len / (float)hptr->cap < LOAD_FACTOR_MIN &&
+        hptr->cap > hptr->mincap) {
+        size_t newcap = upToPow2(
+            (size_t)(hptr->len / ((LOAD_FACTOR_MIN + hptr->maxload) / 2)));
+        if (newcap < hptr->mincap) {
+            newcap = hptr->mincap;
+        }
+        if (newcap < hptr->cap) {
+            resizehash(hptr, newcap);
+            return;
+        }
+    }
+    if (hptr->deleted > hptr->cap * TOMBSTONE_MAX) {
+        purgeTombstones(hptr);
+    }
+}
+
+void insert(Hashptr hptr, int32_t key) {
+    if (hptr == NULL) {
+        errExit("need to init before insert");
+    }
+    // 已经存在就什么都不做
+    if (find(hptr, key) >= 0) {
+        return;
+    }
+    growhash(hptr);
+    insertIntoArray(hptr, key);
+}
+
+void erase(Hashptr hptr, int32_t key) {
+    if (hptr == NULL) {
+        errExit("need to init before erase");
+    }
+    int64_t i = find(hptr, key);
+    if (i < 0) {
+        return;
+    }
+    // 懒惰删除
+    // 不清空数据，只是标记这个槽位呈删除状态，保证后面的探测不会中断
+    hptr->ctrl[i] = CTRL_DELETED;
+    --hptr->len;
+    ++hptr->deleted;
+    shrinkhash(hptr);
+}
+
+Hashptr init(size_t initcap) {
+    Hashptr hptr = malloc(sizeof(Hash));
+    if (hptr == NULL) {
+        errExit("out of memory");
+    }
+    memset(hptr, 0, sizeof(Hash));
+    hptr->maxload = LOAD_FACTOR_MAX;
+    inithash(hptr, initcap);
+    hptr->mincap = hptr->cap;
+    return hptr;
+}
+
+void destroy(Hashptr hptr) {
+    free(hptr->ctrl);
+    free(hptr->keys);
+    free(hptr);
+}
+
+#ifdef HASHSTATS
+// 统计每个元素的探测长度：从初始组走到元素所在的组一共探测了几组
+HashStats hashStats(Hashptr hptr) {
+    HashStats st;
+    hashStatsInit(&st, &hptr->counters);
+    size_t groupmask = hptr->cap / GROUPSIZE - 1;
+    for (size_t i = 0; i < hptr->cap; i++) {
+        if (hptr->ctrl[i] < 0) {
+            continue;
+        }
+        size_t g = (hashfunc(hptr->keys[i]) >> 7) & groupmask;
+        size_t n = 1;
+        while (g != i / GROUPSIZE) {
+            g = (g + n) & groupmask;
+            ++n;
+        }
+        hashStatsAdd(&st, n);
+    }
+    st.tombstones = hptr->deleted;
+    st.len = hptr->len;
+    st.cap = hptr->cap;
+    st.bytes = sizeof(Hash) + hptr->cap * (1 + sizeof(int32_t));
+    return st;
+}
+#endif
+
+/*
+    基准测试
+        对照组使用hash_open_address_linear_detected.c的Item布局：
+        键和4字节的状态枚举放在一起，逐个槽位线性探测（去掉了printf）
+*/
+
+enum kindOfState { legitimate, empty, deleted };
+
+typedef struct item {
+    int32_t el;
+    enum kindOfState state;
+} Item, *Itemptr;
+
+double nowSec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int64_t refFind(Itemptr array, size_t cap, int32_t key) {
+    size_t pos = hashfunc(key) & (cap - 1);
+    while (array[pos].state != empty) {
+        if (array[pos].state == legitimate && array[pos].el == key) {
+            return (int64_t)pos;
+        }
+        pos = (pos + 1) & (cap - 1);
+    }
+    return -1;
+}
+
+void refInsert(Itemptr array, size_t cap, int32_t key) {
+    size_t pos = hashfunc(key) & (cap - 1);
+    while (array[pos].state == legitimate) {
+        pos = (pos + 1) & (cap - 1);
+    }
+    array[pos].el = key;
+    array[pos].state = legitimate;
+}
+
+// xorshift伪随机数
+uint32_t nextRand(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (uint32_t)(*state >> 16);
+}
+
+// 固定容量cap，按不同的负载因子填充，分别测试命中和未命中的查找
+void bench(size_t cap) {
+    const float loads[] = {0.45, 0.5, 0.625, 0.75, 0.875};
+    cap = upToPow2(cap);
+    int32_t* keys = malloc(sizeof(int32_t) * cap);
+    Itemptr ref = malloc(sizeof(Item) * cap);
+    if (keys == NULL || ref == NULL) {
+        errExit("out of memory");
+    }
+    uint64_t seed = 88172645463325252ULL;
+    for (size_t i = 0; i < cap; i++) {
+        keys[i] = (int32_t)nextRand(&seed);
+    }
+
+    printf("cap: %zu\n", cap);
+    printf("%-6s %-8s %12s %12s %12s %12s\n", "load", "table", "insert ns",
+           "hit ns", "miss ns", "bytes/slot");
+    for (size_t l = 0; l < sizeof(loads) / sizeof(loads[0]); l++) {
+        size_t n = (size_t)(cap * loads[l]);
+        int64_t sink = 0;
+
+        // Swiss table，容量固定不扩容
+        Hashptr hptr = init(cap);
+        hptr->maxload = 1.0;
+        double t0 = nowSec();
+        for (size_t i = 0; i < n; i++) {
+            insert(hptr, keys[i]);
+        }
+        double t1 = nowSec();
+        for (size_t i = 0; i < n; i++) {
+            sink += find(hptr, keys[i]);
+        }
+        double t2 = nowSec();
+        for (size_t i = 0; i < n; i++) {
+            sink += find(hptr, ~keys[i]);
+        }
+        double t3 = nowSec();
+        printf("%-6.3f %-8s %12.1f %12.1f %12.1f %12.1f\n", loads[l], "swiss",
+               (t1 - t0) / n * 1e9, (t2 - t1) / n * 1e9, (t3 - t2) / n * 1e9,
+               (double)(sizeof(int8_t) + sizeof(int32_t)));
+        destroy(hptr);
+
+        // 对照组
+        for (size_t i = 0; i < cap; i++) {
+            ref[i].state = empty;
+        }
+        t0 = nowSec();
+        for (size_t i = 0; i < n; i++) {
+            if (refFind(ref, cap, keys[i]) < 0) {
+                refInsert(ref, cap, keys[i]);
+            }
+        }
+        t1 = nowSec();
+        for (size_t i = 0; i < n; i++) {
+            sink += refFind(ref, cap, keys[i]);
+        }
+        t2 = nowSec();
+        for (size_t i = 0; i < n; i++) {
+            sink += refFind(ref, cap, ~keys[i]);
+        }
+        t3 = nowSec();
+        printf("%-6.3f %-8s %12.1f %12.1f %12.1f %12.1f\n", loads[l], "item",
+               (t1 - t0) / n * 1e9, (t2 - t1) / n * 1e9, (t3 - t2) / n * 1e9,
+               (double)sizeof(Item));
+        if (sink == 42) {
+            printf("\n");
+        }
+    }
+    free(keys);
+    free(ref);
+}
+
+// 用法：不带参数运行演示，`bench [cap]` 跑基准测试，默认容量2^22
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench(argc > 2 ? strtoull(argv[2], NULL, 10) : (1 << 22));
+        return 0;
+    }
+
+    int arr[9] = {47, 7, 29, 11, 9, 87, 54, 20, 30};
+    Hashptr hptr = init(11);
+    for (int i = 0; i < 9; i++) {
+        insert(hptr, arr[i]);
+    }
+    printInfo(hptr);
+    erase(hptr, 47);
+    erase(hptr, 9);
+    printInfo(hptr);
+    printf("find 47: %lld\tfind 29: %lld\n", (long long)find(hptr, 47),
+           (long long)find(hptr, 29));
+#ifdef HASHSTATS
+    HashStats st = hashStats(hptr);
+    hashStatsPrint(&st);
+#endif
+    destroy(hptr);
+    return 0;
+}
@@ -0,0 +1,87 @@
+// 哈希表的统计信息
+/*
+    每个哈希表提供一个 HashStats hashStats(表指针) 函数，返回：
+        链长（分离链接法）或者探测长度（开放定址法）的直方图和最大值，
+        墓碑个数，扩容次数和扩容累计用时，分配的字节数
+
+    编译时定义HASHSTATS才会有这些代码，扩容的计数和计时也只在这时候才做，
+    不定义的话表的结构体和热路径和原来完全一样
+        gcc -DHASHSTATS hash/hash_robin_hood.c
+
+    直方图的第i格是长度为i的链或者探测次数为i的元素个数，
+    最后一格是长度大于等于HASHSTATS_BINS-1的个数
+*/
+
+#ifndef HASHSTATS_H
+#define HASHSTATS_H
+
+#ifdef HASHSTATS
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define HASHSTATS_BINS 16  // 直方图的格数
+
+typedef struct hashStats {
+    size_t hist[HASHSTATS_BINS];  // 链长或者探测长度的直方图
+    size_t maxlen;                // 最长的链或者最大的探测长度
+    size_t tombstones;            // 墓碑个数，没有墓碑的表是0
+    size_t resizes;               // 扩容次数
+    double resizeSec;             // 扩容累计用时
+    size_t bytes;                 // 表分配的总字节数
+    size_t len;                   // 元素个数
+    size_t cap;                   // 容量，桶数或者槽数
+} HashStats;
+
+// 扩容的计数器，放在哈希表的结构体里
+typedef struct hashCounters {
+    size_t resizes;
+    double resizeSec;
+} HashCounters;
+
+static inline double hashStatsNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// 一次扩容结束，t0是扩容开始的时间
+static inline void hashCountersAdd(HashCounters* c, double t0) {
+    ++c->resizes;
+    c->resizeSec += hashStatsNow() - t0;
+}
+
+static inline void hashStatsInit(HashStats* st, const HashCounters* c) {
+    memset(st, 0, sizeof(*st));
+    if (c != NULL) {
+        st->resizes = c->resizes;
+        st->resizeSec = c->resizeSec;
+    }
+}
+
+// 把一条链的长度或者一个元素的探测长度记到直方图里
+static inline void hashStatsAdd(HashStats* st, size_t n) {
+    st->hist[n < HASHSTATS_BINS ? n : HASHSTATS_BINS - 1]++;
+    if (n > st->maxlen) {
+        st->maxlen = n;
+    }
+}
+
+static inline void hashStatsPrint(const HashStats* st) {
+    printf("len: %zu cap: %zu bytes: %zu tombstones: %zu max: %zu\n",
+           st->len, st->cap, st->bytes, st->tombstones, st->maxlen);
+    printf("resizes: %zu resize time: %.6fs\n", st->resizes, st->resizeSec);
+    printf("histogram:");
+    for (int i = 0; i < HASHSTATS_BINS; i++) {
+        if (st->hist[i] != 0) {
+            printf(" %d%s:%zu", i, i == HASHSTATS_BINS - 1 ? "+" : "",
+                   st->hist[i]);
+        }
+    }
+    printf("\n");
+}
+
+#endif
+
+#endif
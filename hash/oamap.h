@@ -0,0 +1,270 @@
+// 用宏实例化的泛型开放寻址哈希表
+/*
+    用法
+        OAMAP_DEFINE(OrderMap, int64_t, Order, oamapHashInt, OAMAP_EQ)
+
+        生成类型OrderMap和下面这些函数，哈希函数和比较函数都是直接调用的，
+        编译器可以把它们内联进来，热路径上没有函数指针
+            int     OrderMapInit(OrderMap* m, size_t initcap)
+            Order*  OrderMapFind(const OrderMap* m, int64_t key)
+            int     OrderMapPut(OrderMap* m, int64_t key, Order value)
+            int     OrderMapErase(OrderMap* m, int64_t key)
+            int     OrderMapReserve(OrderMap* m, size_t n)
+            void    OrderMapDestroy(OrderMap* m)
+            HashStats OrderMapStats(const OrderMap* m)  定义了HASHSTATS时才有
+
+    模型
+        键和值放在同一个槽里，找到键以后值就在同一条缓存行上。
+        槽的状态单独放在一个字节数组里，和槽数组一次malloc出来
+
+    slots--->+-----+-------+-----+-------+-----+-------+
+             | key | value | key | value | ... | value |
+             +-----+-------+-----+-------+-----+-------+
+    states-->| 1 | 0 | 2 | ... |
+             +---+---+---+-----+
+
+        容量是2的幂，哈希值和cap-1按位与得到下标，冲突时线性探测。
+        删除只把状态改成OAMAP_DELETED，已用的槽（元素加墓碑）超过
+        OAMAP_MAXLOAD时扩容，扩容的时候顺便清掉墓碑。
+        删除以后元素少于容量的OAMAP_MINLOAD就缩容，墓碑超过OAMAP_MAXTOMB
+        就按原来的大小重建一遍；缩容不会小于Init时的容量
+*/
+
+#ifndef OAMAP_H
+#define OAMAP_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hashstats.h"
+
+#define OAMAP_MAXLOAD 0.75  // 元素加墓碑占容量的最大比例
+#define OAMAP_MINLOAD 0.15  // 元素占容量的比例低于它时缩容
+#define OAMAP_MAXTOMB 0.25  // 墓碑占容量的比例超过它时重建
+#define OAMAP_MINCAP 8      // 最小容量
+
+#define OAMAP_EMPTY 0    // 槽可用
+#define OAMAP_FULL 1     // 槽被占用
+#define OAMAP_DELETED 2  // 槽被删除，查找时要跳过
+
+// 默认的比较函数，适用于整数和指针
+#define OAMAP_EQ(a, b) ((a) == (b))
+
+// murmur3的64位终结函数，整数键直接用它作为哈希值
+static inline uint64_t oamapMix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+#define oamapHashInt(k) oamapMix64((uint64_t)(k))
+
+// 宏里面不能写#ifdef，统计相关的代码在这里按HASHSTATS展开成代码或者空
+#ifdef HASHSTATS
+#define OAMAP_COUNTERS HashCounters counters; /* 扩容次数和用时 */
+#define OAMAP_RESIZE_BEGIN double oamapT0 = hashStatsNow();
+#define OAMAP_RESIZE_END(m) hashCountersAdd(&(m)->counters, oamapT0);
+// 探测长度是元素离初始位置的距离加一，墓碑数是used - len
+#define OAMAP_DEFINE_STATS(name, hashfn)                                       \
+    static inline HashStats name##Stats(const name* m) {                       \
+        HashStats st;                                                          \
+        hashStatsInit(&st, &m->counters);                                      \
+        for (size_t j = 0; j < m->cap; j++) {                                  \
+            if (m->states[j] == OAMAP_FULL) {                                  \
+                size_t home = hashfn(m->slots[j].key) & (m->cap - 1);          \
+                hashStatsAdd(&st, ((j - home) & (m->cap - 1)) + 1);            \
+            }                                                                  \
+        }                                                                      \
+        st.tombstones = m->used - m->len;                                      \
+        st.len = m->len;                                                       \
+        st.cap = m->cap;                                                       \
+        st.bytes = sizeof(name) + m->cap * (sizeof(name##Slot) + 1);           \
+        return st;                                                             \
+    }
+#else
+#define OAMAP_COUNTERS
+#define OAMAP_RESIZE_BEGIN
+#define OAMAP_RESIZE_END(m)
+#define OAMAP_DEFINE_STATS(name, hashfn)
+#endif
+
+// 生成一个键类型为K、值类型为V的哈希表，hashfn(key)返回64位哈希值，
+// eqfn(a, b)返回两个键是否相等，两者都可以是函数或者函数式的宏
+#define OAMAP_DEFINE(name, K, V, hashfn, eqfn)                                 \
+    typedef struct name##Slot {                                                \
+        K key;                                                                 \
+        V value;                                                               \
+    } name##Slot;                                                              \
+                                                                               \
+    typedef struct name {                                                      \
+        name##Slot* slots; /* 槽数组 */                                        \
+        uint8_t* states;   /* 每个槽的状态 */                                  \
+        size_t cap;        /* 容量，2的幂 */                                   \
+        size_t len;        /* 元素个数 */                                      \
+        size_t used;       /* 元素加墓碑的个数 */                              \
+        size_t mincap;     /* 缩容的下限 */                                    \
+        OAMAP_COUNTERS                                                         \
+    } name;                                                                    \
+                                                                               \
+    /* 分配cap个槽，状态全部是OAMAP_EMPTY，失败返回-1 */                      \
+    static inline int name##Alloc(name* m, size_t cap) {                       \
+        void* p = malloc(cap * (sizeof(name##Slot) + 1));                      \
+        if (p == NULL) {                                                       \
+            return -1;                                                         \
+        }                                                                      \
+        m->slots = p;                                                          \
+        m->states = (uint8_t*)(m->slots + cap);                                \
+        memset(m->states, OAMAP_EMPTY, cap);                                   \
+        m->cap = cap;                                                          \
+        m->len = m->used = 0;                                                  \
+        return 0;                                                              \
+    }                                                                          \
+                                                                               \
+    static inline int name##Init(name* m, size_t initcap) {                    \
+        memset(m, 0, sizeof(*m));                                              \
+        size_t cap = OAMAP_MINCAP;                                             \
+        while (cap < initcap) {                                                \
+            cap <<= 1;                                                         \
+        }                                                                      \
+        m->mincap = cap;                                                       \
+        return name##Alloc(m, cap);                                            \
+    }                                                                          \
+                                                                               \
+    static inline void name##Destroy(name* m) {                                \
+        free(m->slots);                                                        \
+        m->slots = NULL;                                                       \
+        m->states = NULL;                                                      \
+        m->cap = m->len = m->used = 0;                                         \
+    }                                                                          \
+                                                                               \
+    /* 查找key所在的槽，找不到返回-1 */                                       \
+    static inline int64_t name##Index(const name* m, K key) {                  \
+        size_t mask = m->cap - 1;                                              \
+        size_t i = hashfn(key) & mask;                                         \
+        while (m->states[i] != OAMAP_EMPTY) {                                  \
+            if (m->states[i] == OAMAP_FULL && eqfn(m->slots[i].key, key)) {    \
+                return (int64_t)i;                                             \
+            }                                                                  \
+            i = (i + 1) & mask;                                                \
+        }                                                                      \
+        return -1;                                                             \
+    }                                                                          \
+                                                                               \
+    /* 返回key对应的值的地址，可以直接修改，找不到返回NULL */                 \
+    static inline V* name##Find(const name* m, K key) {                        \
+        int64_t i = name##Index(m, key);                                       \
+        return i < 0 ? NULL : &m->slots[i].value;                              \
+    }                                                                          \
+                                                                               \
+    /* 重新分配newcap个槽，把元素搬过去，墓碑丢掉 */                          \
+    static inline int name##Resize(name* m, size_t newcap) {                   \
+        OAMAP_RESIZE_BEGIN                                                     \
+        name old = *m;                                                         \
+        if (name##Alloc(m, newcap) != 0) {                                     \
+            *m = old;                                                          \
+            return -1;                                                         \
+        }                                                                      \
+        size_t mask = newcap - 1;                                              \
+        for (size_t j = 0; j < old.cap; j++) {                                 \
+            if (old.states[j] != OAMAP_FULL) {                                 \
+                continue;                                                      \
+            }                                                                  \
+            size_t i = hashfn(old.slots[j].key) & mask;                        \
+            while (m->states[i] != OAMAP_EMPTY) {                              \
+                i = (i + 1) & mask;                                            \
+            }                                                                  \
+            m->slots[i] = old.slots[j];                                        \
+            m->states[i] = OAMAP_FULL;                                         \
+        }                                                                      \
+        m->len = m->used = old.len;                                            \
+        free(old.slots);                                                       \
+        OAMAP_RESIZE_END(m)                                                    \
+        return 0;                                                              \
+    }                                                                          \
+                                                                               \
+    /* 保证放下n个元素之前不需要扩容 */                                       \
+    static inline int name##Reserve(name* m, size_t n) {                       \
+        size_t cap = m->cap;                                                   \
+        while ((double)n > cap * OAMAP_MAXLOAD) {                              \
+            cap <<= 1;                                                         \
+        }                                                                      \
+        return cap == m->cap ? 0 : name##Resize(m, cap);                       \
+    }                                                                          \
+                                                                               \
+    /* 插入或者更新，新插入返回1，更新返回0，内存不够返回-1 */                \
+    static inline int name##Put(name* m, K key, V value) {                     \
+        if ((double)(m->used + 1) > m->cap * OAMAP_MAXLOAD) {                  \
+            /* 墓碑多的时候原地大小重建就够了 */                              \
+            size_t cap = (double)(m->len + 1) > m->cap * OAMAP_MAXLOAD / 2     \
+                             ? m->cap << 1                                     \
+                             : m->cap;                                         \
+            if (name##Resize(m, cap) != 0) {                                   \
+                return -1;                                                     \
+            }                                                                  \
+        }                                                                      \
+        size_t mask = m->cap - 1;                                              \
+        size_t i = hashfn(key) & mask;                                         \
+        size_t tomb = SIZE_MAX; /* 路上遇到的第一个墓碑 */                    \
+        while (m->states[i] != OAMAP_EMPTY) {                                  \
+            if (m->states[i] == OAMAP_FULL) {                                  \
+                if (eqfn(m->slots[i].key, key)) {                              \
+                    m->slots[i].value = value;                                 \
+                    return 0;                                                  \
+                }                                                              \
+            } else if (tomb == SIZE_MAX) {                                     \
+                tomb = i;                                                      \
+            }                                                                  \
+            i = (i + 1) & mask;                                                \
+        }                                                                      \
+        /* 优先复用墓碑，这样已用的槽数不会增加 */                            \
+        if (tomb != SIZE_MAX) {                                                \
+            i = tomb;                                                          \
+        } else {                                                               \
+            ++m->used;                                                         \
+        }                                                                      \
+        m->slots[i].key = key;                                                 \
+        m->slots[i].value = value;                                             \
+        m->states[i] = OAMAP_FULL;                                             \
+        ++m->len;                                                              \
+        return 1;                                                              \
+    }                                                                          \
+                                                                               \
+    /* 元素太少就缩容，新的负载因子落在OAMAP_MINLOAD和OAMAP_MAXLOAD中间；*/ \
+    /* 墓碑太多就原大小重建。内存不够的话保持原样，表仍然是正确的 */         \
+    static inline void name##Shrink(name* m) {                                 \
+        double mid = (OAMAP_MINLOAD + OAMAP_MAXLOAD) / 2;                      \
+        size_t cap = m->cap;                                                   \
+        while (cap > m->mincap && (double)m->len < cap / 2 * mid) {            \
+            cap >>= 1;                                                         \
+        }                                                                      \
+        if ((cap < m->cap && (double)m->len < m->cap * OAMAP_MINLOAD) ||       \
+            (double)(m->used - m->len) > m->cap * OAMAP_MAXTOMB) {             \
+            name##Resize(m, cap);                                              \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    /* 删除key，删除了返回1，不存在返回0 */                                   \
+    static inline int name##Erase(name* m, K key) {                            \
+        int64_t i = name##Index(m, key);                                       \
+        if (i < 0) {                                                           \
+            return 0;                                                          \
+        }                                                                      \
+        /* 下一个槽是空的话不需要墓碑，查找走到这里本来就会停 */              \
+        if (m->states[(i + 1) & (m->cap - 1)] == OAMAP_EMPTY) {                \
+            m->states[i] = OAMAP_EMPTY;                                        \
+            --m->used;                                                         \
+        } else {                                                               \
+            m->states[i] = OAMAP_DELETED;                                      \
+        }                                                                      \
+        --m->len;                                                              \
+        name##Shrink(m);                                                       \
+        return 1;                                                              \
+    }                                                                          \
+                                                                               \
+    OAMAP_DEFINE_STATS(name, hashfn)
+
+#endif
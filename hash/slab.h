@@ -0,0 +1,162 @@
+// 固定大小对象的slab分配器
+/*
+    模型
+        每次向系统申请一大块内存（slab），切成大小相同的对象依次分配出去。
+        释放的对象挂到空闲链表上，下次分配优先从空闲链表取。
+        所有slab串成一个链表，销毁的时候整块释放，不需要逐个对象free
+
+    slabs--->+------+-----+-----+-----+     +------+-----+-----+
+             | next | obj | obj | ... |---->| next | obj | ... |---->NULL
+             +------+-----+-----+-----+     +------+-----+-----+
+                             ^                 cur         end
+    freelist---------------->+
+
+        每个新的slab是上一个的两倍大，直到SLAB_MAXOBJS个对象，
+        这样小表不会浪费太多内存，大表的malloc次数也很少
+
+        perslab为0时退化成直接调用malloc/free，用来对比测试
+
+    逐个释放
+        slabReleaseOne每次只释放一个slab，几百MB的slab可以分几次还给系统，
+        不会让一次调用停顿太久
+*/
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define SLAB_MINOBJS 64     // 第一个slab的对象个数
+#define SLAB_MAXOBJS 65536  // 单个slab最多的对象个数
+
+typedef struct slabBlock {
+    struct slabBlock* next;  // 下一个slab
+    size_t size;             // 这个slab的字节数，包括头部
+} SlabBlock;
+
+typedef struct slab {
+    size_t objsize;   // 对象大小，按8字节对齐
+    size_t perslab;   // 下一个slab的对象个数，0表示直接用malloc
+    SlabBlock* head;  // 所有slab组成的链表
+    char* cur;        // 当前slab中还没分配出去的位置
+    char* end;        // 当前slab的结尾
+    void* freelist;   // 释放掉的对象组成的链表，对象的前8个字节存next
+    size_t allocs;    // 调用malloc的次数
+    size_t live;      // 正在使用的对象个数
+    size_t bytes;     // 向系统申请的总字节数
+} Slab;
+
+static inline void slabInit(Slab* s, size_t objsize, int useSlab) {
+    // 对象至少要能放下一个指针，用来串空闲链表
+    if (objsize < sizeof(void*)) {
+        objsize = sizeof(void*);
+    }
+    s->objsize = (objsize + 7) & ~(size_t)7;
+    s->perslab = useSlab ? SLAB_MINOBJS : 0;
+    s->head = NULL;
+    s->cur = s->end = NULL;
+    s->freelist = NULL;
+    s->allocs = 0;
+    s->live = 0;
+    s->bytes = 0;
+}
+
+static inline void* slabAlloc(Slab* s) {
+    ++s->live;
+    if (s->perslab == 0) {
+        ++s->allocs;
+        s->bytes += s->objsize;
+        return malloc(s->objsize);
+    }
+    // 优先复用释放掉的对象
+    if (s->freelist != NULL) {
+        void* obj = s->freelist;
+        s->freelist = *(void**)obj;
+        return obj;
+    }
+    // 当前slab用完了，申请一个新的
+    if (s->cur == s->end) {
+        SlabBlock* blk = malloc(sizeof(SlabBlock) + s->objsize * s->perslab);
+        if (blk == NULL) {
+            --s->live;
+            return NULL;
+        }
+        ++s->allocs;
+        blk->size = sizeof(SlabBlock) + s->objsize * s->perslab;
+        s->bytes += blk->size;
+        blk->next = s->head;
+        s->head = blk;
+        s->cur = (char*)(blk + 1);
+        s->end = s->cur + s->objsize * s->perslab;
+        if (s->perslab < SLAB_MAXOBJS) {
+            s->perslab *= 2;
+        }
+    }
+    void* obj = s->cur;
+    s->cur += s->objsize;
+    return obj;
+}
+
+static inline void slabFree(Slab* s, void* obj) {
+    --s->live;
+    if (s->perslab == 0) {
+        s->bytes -= s->objsize;
+        free(obj);
+        return;
+    }
+    *(void**)obj = s->freelist;
+    s->freelist = obj;
+}
+
+// 是否是直接使用malloc的模式，这种模式下销毁前需要逐个slabFree
+static inline int slabIsMalloc(const Slab* s) {
+    return s->perslab == 0;
+}
+
+// 释放所有slab，之前分配出去的对象全部失效
+static inline void slabDestroy(Slab* s) {
+    SlabBlock* blk = s->head;
+    while (blk != NULL) {
+        SlabBlock* next = blk->next;
+        free(blk);
+        blk = next;
+    }
+    s->head = NULL;
+    s->cur = s->end = NULL;
+    s->freelist = NULL;
+    s->live = 0;
+    s->bytes = 0;
+}
+
+// 释放一个slab，还有没释放的slab返回1，全部释放完以后和slabDestroy一样
+// 第一次调用以后就不能再分配，之前分配出去的对象全部失效。
+// slab在堆中间的时候free不会把内存还给系统，先把中间的整页还回去
+static inline int slabReleaseOne(Slab* s) {
+    s->cur = s->end = NULL;
+    s->freelist = NULL;
+    s->live = 0;
+    SlabBlock* blk = s->head;
+    if (blk == NULL) {
+        return 0;
+    }
+    s->head = blk->next;
+    s->bytes -= blk->size;
+#ifdef __linux__
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t from = ((uintptr_t)(blk + 1) + page - 1) & ~(page - 1);
+    uintptr_t to = ((uintptr_t)blk + blk->size) & ~(page - 1);
+    if (to > from) {
+        madvise((void*)from, to - from, MADV_DONTNEED);
+    }
+#endif
+    free(blk);
+    return s->head != NULL;
+}
+
+#endif
@@ -0,0 +1,96 @@
+// 带长度前缀的字符串区
+/*
+    模型
+        把字符串依次复制到一大块连续内存中，每个字符串前面带4个字节的长度，
+        后面带'\0'，返回的指针指向字符串本身，可以直接当C字符串用
+
+    head--->+------+-----+-------+-----+-------+-----+     +------+-----+
+            | next | len | bytes | len | bytes | ... |---->| next | ... |
+            +------+-----+-------+-----+-------+-----+     +------+-----+
+                                                  cur  end
+
+        字符串不能单独释放，strArenaDrop只记录死掉的字节数，
+        调用者在死掉的字节太多的时候把活着的字符串复制到新的区里再整体释放
+*/
+
+#ifndef STRARENA_H
+#define STRARENA_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STRARENA_CHUNK 65536  // 每块的最小字节数
+
+typedef struct strChunk {
+    struct strChunk* next;
+} StrChunk;
+
+typedef struct strArena {
+    StrChunk* head;  // 所有块组成的链表
+    char* cur;       // 当前块还没使用的位置
+    char* end;       // 当前块的结尾
+    size_t bytes;    // 所有块的总字节数
+    size_t used;     // 已经分配出去的字节数
+    size_t dead;     // 被丢弃的字节数
+} StrArena;
+
+static inline void strArenaInit(StrArena* a) {
+    a->head = NULL;
+    a->cur = a->end = NULL;
+    a->bytes = a->used = a->dead = 0;
+}
+
+// 一个长度为len的字符串占用的字节数，按4字节对齐，保证长度前缀对齐
+static inline size_t strArenaSize(uint32_t len) {
+    return (sizeof(uint32_t) + len + 1 + 3) & ~(size_t)3;
+}
+
+// 复制长度为len的字符串，失败返回NULL
+static inline const char* strArenaCopy(StrArena* a, const char* s,
+                                       uint32_t len) {
+    size_t need = strArenaSize(len);
+    if ((size_t)(a->end - a->cur) < need) {
+        size_t size = need > STRARENA_CHUNK ? need : STRARENA_CHUNK;
+        StrChunk* c = malloc(sizeof(StrChunk) + size);
+        if (c == NULL) {
+            return NULL;
+        }
+        c->next = a->head;
+        a->head = c;
+        a->cur = (char*)(c + 1);
+        a->end = a->cur + size;
+        a->bytes += size;
+    }
+    char* p = a->cur;
+    memcpy(p, &len, sizeof(uint32_t));
+    memcpy(p + sizeof(uint32_t), s, len);
+    p[sizeof(uint32_t) + len] = '\0';
+    a->cur += need;
+    a->used += need;
+    return p + sizeof(uint32_t);
+}
+
+// 字符串区里字符串的长度
+static inline uint32_t strArenaLen(const char* s) {
+    uint32_t len;
+    memcpy(&len, s - sizeof(uint32_t), sizeof(uint32_t));
+    return len;
+}
+
+// 丢弃一个字符串，只记录死掉的字节数
+static inline void strArenaDrop(StrArena* a, const char* s) {
+    a->dead += strArenaSize(strArenaLen(s));
+}
+
+static inline void strArenaDestroy(StrArena* a) {
+    StrChunk* c = a->head;
+    while (c != NULL) {
+        StrChunk* next = c->next;
+        free(c);
+        c = next;
+    }
+    strArenaInit(a);
+}
+
+#endif
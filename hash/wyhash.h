@@ -0,0 +1,100 @@
+// wyhash 字符串哈希函数
+/*
+    来自 Wang Yi 的 wyhash（final4 版本，unlicense 公有领域授权），
+    这里只保留了哈希字符串需要的部分。
+
+    每次读取8个字节，用64x64->128位乘法把高低位折叠混合，短键（<=16字节）
+    只需要一两次乘法，速度和质量都比逐个字符累加好得多。
+    按小端字节序读取，在大端机器上结果不同但分布一样好。
+*/
+
+#ifndef WYHASH_H
+#define WYHASH_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define WYHASH_SEED 0x9E3779B97F4A7C15ULL  // 默认种子
+
+static const uint64_t wyp[4] = {0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+                                0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL};
+
+// 128位乘法，低64位放到A，高64位放到B
+static inline void wymum(uint64_t* A, uint64_t* B) {
+    __uint128_t r = *A;
+    r *= *B;
+    *A = (uint64_t)r;
+    *B = (uint64_t)(r >> 64);
+}
+
+static inline uint64_t wymix(uint64_t A, uint64_t B) {
+    wymum(&A, &B);
+    return A ^ B;
+}
+
+// 不对齐读取，用memcpy让编译器生成一条普通的load指令
+static inline uint64_t wyr8(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t wyr4(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint64_t wyr3(const uint8_t* p, size_t k) {
+    return (((uint64_t)p[0]) << 16) | (((uint64_t)p[k >> 1]) << 8) | p[k - 1];
+}
+
+// 哈希长度为len的字节串
+static inline uint64_t wyhash(const void* key, size_t len, uint64_t seed) {
+    const uint8_t* p = (const uint8_t*)key;
+    uint64_t a, b;
+
+    seed ^= wymix(seed ^ wyp[0], wyp[1]);
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (wyr4(p) << 32) | wyr4(p + ((len >> 3) << 2));
+            b = (wyr4(p + len - 4) << 32) | wyr4(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = wyr3(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+                see1 = wymix(wyr8(p + 16) ^ wyp[2], wyr8(p + 24) ^ see1);
+                see2 = wymix(wyr8(p + 32) ^ wyp[3], wyr8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = wyr8(p + i - 16);
+        b = wyr8(p + i - 8);
+    }
+    a ^= wyp[1];
+    b ^= seed;
+    wymum(&a, &b);
+    return wymix(a ^ wyp[0] ^ len, b ^ wyp[1]);
+}
+
+// 哈希以'\0'结尾的字符串
+static inline uint64_t wyhashStr(const char* key) {
+    return wyhash(key, strlen(key), WYHASH_SEED);
+}
+
+#endif
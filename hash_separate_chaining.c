@@ -24,13 +24,19 @@
 
 #include <memory.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "hash/hashstats.h"
+#include "hash/slab.h"
+#include "hash/wyhash.h"
+
 // 链表节点
 typedef struct Node {
     const char* key;
     const char* value;
+    uint64_t hash;  // 键的完整哈希值，查找时先比较它再strcmp
     struct Node* next;
 } Node, *Nodeptr;
 
@@ -38,6 +44,7 @@ typedef struct Node {
 typedef struct hash {
     int cap;
     Nodeptr* bucket;
+    Slab nodes;  // 链表节点的分配器
 } Hash, *Hptr;
 
 void errExit(const char* errMsg) {
@@ -74,7 +81,7 @@ void printArray(Hptr hptr) {
     }
     printf("\n");
     for (int i = 0; i < hptr->cap; i++) {
-        printf("0x%p\t", hptr[i]);
+        printf("0x%p\t", (void*)hptr->bucket[i]);
     }
     printf(
         "\nnext: "
@@ -92,37 +99,37 @@ void printArray(Hptr hptr) {
 // 扩容
 void expanstion() {}
 
+// 计算key的64位哈希值
+// 以前只用了key的长度，长度相同的键全都挤在同一个链表里
+uint64_t hashKey(Hptr hptr, const char* key) {
+    isNull(hptr, key);
+
+    return wyhashStr(key);
+}
+
 // 散列函数
 // 散列函数的作用是把键转化为数组指针的下标
-// 不能直接用strlen函数或sizeof函数计算key的长度，因为参数是一个指针
 int hashFunc(const char* key, Hptr hptr) {
-    unsigned int len = 0;
-
-    isNull(hptr, key);
+    return hashKey(hptr, key) % hptr->cap;
+}
 
-    // 获取key的字符串长度
-    while (*key++ != '\0') {
-        ++len;
+// 根据已经算好的哈希值查找链表节点
+// 哈希值不相等的节点一定不是，只有哈希值相等才需要strcmp
+Nodeptr findByHash(Hptr hptr, const char* key, uint64_t hash) {
+    // 循环查找对应的链表
+    Nodeptr tmp = hptr->bucket[hash % hptr->cap]->next;
+    while (tmp != NULL && (tmp->hash != hash || strcmp(tmp->key, key) != 0)) {
+        tmp = tmp->next;
     }
 
-    return len % hptr->cap;
+    return tmp;
 }
 
 // 查找链表节点
 // 找到值和key相同的节点就返回当前节点的指针，并在插入函数更新它的值
 // 如果找不到就证明不存在，返回NULL，插入函数会在链表的头部插入新的节点
 Nodeptr find(Hptr hptr, const char* key) {
-    Nodeptr tmp = NULL;
-    // 获取key转化的数组下标
-    int i = hashFunc(key, hptr);
-
-    // 循环查找对应的链表
-    tmp = hptr->bucket[i]->next;
-    while (tmp != NULL && (strcmp(tmp->key, key) != 0)) {
-        tmp = tmp->next;
-    }
-
-    return tmp;
+    return findByHash(hptr, key, hashKey(hptr, key));
 }
 
 // 插入键值对
@@ -137,18 +144,21 @@ void insert(Hptr hptr, const char* key, const char* value) {
         errExit("hptr is NULL");
     }
 
-    Nodeptr tmp = find(hptr, key);
+    // 哈希值只算一次，查找和插入都用它
+    uint64_t hash = hashKey(hptr, key);
+    Nodeptr tmp = findByHash(hptr, key, hash);
     if (tmp == NULL) {
         // 如果key不存在，就插入到链表
-        Nodeptr newNode = malloc(sizeof(Node));
+        Nodeptr newNode = slabAlloc(&hptr->nodes);
         if (newNode == NULL) {
             errExit("out of memory");
         }
-        Nodeptr h = hptr->bucket[hashFunc(key, hptr)];
+        Nodeptr h = hptr->bucket[hash % hptr->cap];
         newNode->next = h->next;
         h->next = newNode;
         newNode->key = key;
         newNode->value = value;
+        newNode->hash = hash;
     } else {
         // 如果key已经存在，那么就更新它的值
         tmp->value = value;
@@ -162,14 +172,16 @@ void erase(Hptr hptr, const char* key) {
     // 找得到就删除，反之什么都不做
     // 需要处理
     // 这个查找前一个节点的逻辑可以和find函数合并，这里暂且不处理
-    Nodeptr tmp = hptr->bucket[hashFunc(key, hptr)];
+    uint64_t hash = hashKey(hptr, key);
+    Nodeptr tmp = hptr->bucket[hash % hptr->cap];
     if (tmp == NULL) {
         // 结束，什么都不做
         return;
     } else {
         // 查找前一个结点
 		while (tmp->next != NULL) {
-			if (tmp->next->key != NULL && !strcmp(key, tmp->next->key)) {
+			if (tmp->next->hash == hash && tmp->next->key != NULL &&
+				!strcmp(key, tmp->next->key)) {
 				break;
 			}
 			tmp = tmp->next;
@@ -179,7 +191,7 @@ void erase(Hptr hptr, const char* key) {
             Nodeptr node = tmp->next;
             tmp->next = node->next;
             printf("delete key: %s\n", node->key);
-            free(node);
+            slabFree(&hptr->nodes, node);
         }
     }
 }
@@ -202,18 +214,19 @@ Hptr create(int count) {
     // 初始化容量
     hptr->cap = count;
 
-    // 给指针数组分配空间
-    hptr->bucket = malloc(sizeof(Node) * count);
-    if (hptr == NULL) {
+    // 链表节点从slab中分配，销毁的时候整块释放
+    slabInit(&hptr->nodes, sizeof(Node), 1);
+
+    // 给指针数组和所有头节点一次分配一整块空间
+    hptr->bucket = malloc((sizeof(Nodeptr) + sizeof(Node)) * count);
+    if (hptr->bucket == NULL) {
         errExit("out of memoery");
     }
+    Nodeptr heads = (Nodeptr)(hptr->bucket + count);
 
-    // 为数组的每个元素分配空间，元素是指向链表的指针
+    // 为数组的每个元素分配头节点，元素是指向链表的指针
     for (int i = 0; i < hptr->cap; i++) {
-        hptr->bucket[i] = malloc(sizeof(Node));
-        if (hptr == NULL) {
-            errExit("out of memoery");
-        }
+        hptr->bucket[i] = &heads[i];
         memset(hptr->bucket[i], 0, sizeof(Node));
         // 指针数组的元素是链表的头节点，当前实现只用于定位链表
         // 所以key和value不使用，不过还是把它们都初始化为NULL
@@ -226,6 +239,39 @@ Hptr create(int count) {
     return hptr;
 }
 
+// 销毁hash表
+// 节点都在slab里，头节点和指针数组在同一块内存里，不需要逐个free
+void destroy(Hptr hptr) {
+    if (hptr == NULL) {
+        return;
+    }
+    slabDestroy(&hptr->nodes);
+    free(hptr->bucket);
+    free(hptr);
+}
+
+#ifdef HASHSTATS
+// 统计链长的分布，这个表不扩容，扩容次数和用时总是0
+HashStats hashStats(Hptr hptr) {
+    HashStats st;
+    hashStatsInit(&st, NULL);
+    for (int i = 0; i < hptr->cap; i++) {
+        size_t n = 0;
+        Nodeptr tmp = hptr->bucket[i]->next;
+        while (tmp != NULL) {
+            ++n;
+            tmp = tmp->next;
+        }
+        hashStatsAdd(&st, n);
+        st.len += n;
+    }
+    st.cap = hptr->cap;
+    st.bytes = sizeof(Hash) + (sizeof(Nodeptr) + sizeof(Node)) * hptr->cap +
+               hptr->nodes.bytes;
+    return st;
+}
+#endif
+
 int main(void) {
     Hptr hptr = create(5);
     // 打印指针数组
@@ -237,6 +283,10 @@ int main(void) {
     insert(hptr, key, value);
     printf("the status after insert: \n");
     printArray(hptr);
+#ifdef HASHSTATS
+    HashStats st = hashStats(hptr);
+    hashStatsPrint(&st);
+#endif
     // 查找
     Nodeptr nptr = get(hptr, key);
     if (nptr == NULL) {
@@ -249,6 +299,7 @@ int main(void) {
 	if (eptr == NULL) {
 		printf("key `%s` not exists\n", key);
 	}
+    destroy(hptr);
 
     return 0;
 }
@@ -63,13 +63,19 @@
 
 #include <memory.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "hash/hashstats.h"
+#include "hash/slab.h"
+#include "hash/wyhash.h"
+
 // 链表节点
 typedef struct Node {
     const char* key;
     const char* value;
+    uint64_t hash;  // 键的完整哈希值，查找时先比较它再strcmp
     struct Node* next;
 } Node, *Nodeptr;
 
@@ -82,7 +88,7 @@ typedef struct arrayEl {
 
 // 两个字节，最大65535
 typedef unsigned short u_int16_t;
-// 辅助结构，辅助数组不扩容
+// 辅助结构，辅助数组和桶数组一样大，每个桶对应一个元素
 typedef struct hashHelper {
     u_int16_t* array;  // 指向辅助数组的指针
     u_int16_t hashLen;  // 当前哈希表的长度，可以根据这个来算出负载因子
@@ -95,6 +101,7 @@ typedef struct hash {
     float lfactor;          // 负载因子
     Nodeptr* bucket;        // 指向哈希表的指针
     helperPtr helperArray;  // 辅助数组
+    Slab nodes;             // 链表节点的分配器
 } Hash, *Hptr;
 
 void errExit(const char* errMsg) {
@@ -131,7 +138,7 @@ void printArray(Hptr hptr) {
     }
     printf("\n");
     for (int i = 0; i < hptr->cap; i++) {
-        printf("0x%p\t", hptr[i]);
+        printf("0x%p\t", (void*)hptr->bucket[i]);
     }
     printf(
         "\nnext: "
@@ -147,40 +154,40 @@ void printArray(Hptr hptr) {
 }
 
 // 扩容
-// 需要重新散列并且清空辅助数组数据和重新计算
+// 需要重新散列，辅助数组也要按新容量重新分配并重新计算
 void expanstion() {}
 
+// 计算key的64位哈希值
+// 以前只用了key的长度，长度相同的键全都挤在同一个链表里
+uint64_t hashKey(Hptr hptr, const char* key) {
+    isNull(hptr, key);
+
+    return wyhashStr(key);
+}
+
 // 散列函数
 // 散列函数的作用是把键转化为数组指针的下标
-// 不能直接用strlen函数或sizeof函数计算key的长度，因为参数是一个指针
 int hashFunc(const char* key, Hptr hptr) {
-    unsigned int len = 0;
-
-    isNull(hptr, key);
+    return hashKey(hptr, key) % hptr->cap;
+}
 
-    // 获取key的字符串长度
-    while (*key++ != '\0') {
-        ++len;
+// 根据已经算好的哈希值查找链表节点
+// 哈希值不相等的节点一定不是，只有哈希值相等才需要strcmp
+Nodeptr findByHash(Hptr hptr, const char* key, uint64_t hash) {
+    // 循环查找对应的链表
+    Nodeptr tmp = hptr->bucket[hash % hptr->cap]->next;
+    while (tmp != NULL && (tmp->hash != hash || strcmp(tmp->key, key) != 0)) {
+        tmp = tmp->next;
     }
 
-    return len % hptr->cap;
+    return tmp;
 }
 
 // 查找链表节点
 // 找到值和key相同的节点就返回当前节点的指针，并在插入函数更新它的值
 // 如果找不到就证明不存在，返回NULL，插入函数会在链表的头部插入新的节点
 Nodeptr find(Hptr hptr, const char* key) {
-    Nodeptr tmp = NULL;
-    // 获取key转化的数组下标
-    int i = hashFunc(key, hptr);
-
-    // 循环查找对应的链表
-    tmp = hptr->bucket[i]->next;
-    while (tmp != NULL && (strcmp(tmp->key, key) != 0)) {
-        tmp = tmp->next;
-    }
-
-    return tmp;
+    return findByHash(hptr, key, hashKey(hptr, key));
 }
 
 // 插入键值对
@@ -195,10 +202,12 @@ void insert(Hptr hptr, const char* key, const char* value) {
         errExit("hptr is NULL");
     }
 
-    Nodeptr tmp = find(hptr, key);
+    // 哈希值只算一次，查找和插入都用它
+    uint64_t hash = hashKey(hptr, key);
+    Nodeptr tmp = findByHash(hptr, key, hash);
     if (tmp == NULL) {
         // 获取哈希表数据单元下标
-        size_t i = hashFunc(key, hptr);
+        size_t i = hash % hptr->cap;
 
         // 处理辅助数组逻辑
         if (hptr->helperArray == NULL || hptr->helperArray->array == NULL) {
@@ -214,7 +223,7 @@ void insert(Hptr hptr, const char* key, const char* value) {
         }
 
         // 如果key不存在，就插入到链表
-        Nodeptr newNode = malloc(sizeof(Node));
+        Nodeptr newNode = slabAlloc(&hptr->nodes);
         if (newNode == NULL) {
             errExit("out of memory");
         }
@@ -223,6 +232,7 @@ void insert(Hptr hptr, const char* key, const char* value) {
         h->next = newNode;
         newNode->key = key;
         newNode->value = value;
+        newNode->hash = hash;
     } else {
         // 如果key已经存在，那么就更新它的值
         tmp->value = value;
@@ -236,14 +246,16 @@ void erase(Hptr hptr, const char* key) {
     // 找得到就删除，反之什么都不做
     // 需要处理
     // 这个查找前一个节点的逻辑可以和find函数合并，这里暂且不处理
-    Nodeptr tmp = hptr->bucket[hashFunc(key, hptr)];
+    uint64_t hash = hashKey(hptr, key);
+    Nodeptr tmp = hptr->bucket[hash % hptr->cap];
     if (tmp == NULL) {
         // 结束，什么都不做
         return;
     } else {
         // 查找前一个结点
         while (tmp->next != NULL) {
-            if (tmp->next->key != NULL && !strcmp(key, tmp->next->key)) {
+            if (tmp->next->hash == hash && tmp->next->key != NULL &&
+                !strcmp(key, tmp->next->key)) {
                 break;
             }
             tmp = tmp->next;
@@ -253,7 +265,7 @@ void erase(Hptr hptr, const char* key) {
             Nodeptr node = tmp->next;
             tmp->next = node->next;
             printf("delete key: %s\n", node->key);
-            free(node);
+            slabFree(&hptr->nodes, node);
         }
     }
 }
@@ -283,26 +295,28 @@ Hptr create(int count) {
     if (hptr->helperArray == NULL) {
         errExit("out of memory");
     }
-    // 初始化辅助数组
-    hptr->helperArray->array = malloc(sizeof(u_int16_t) * sizeof(u_int16_t));
-    memset(hptr->helperArray->array, 0, sizeof(u_int16_t) * sizeof(u_int16_t));
-    // 暂时定辅助数组长度为65535
-    hptr->helperArray->cap = sizeof(u_int16_t);
+    // 初始化辅助数组，下标和桶的下标一样，所以长度也是count
+    hptr->helperArray->array = calloc(count, sizeof(u_int16_t));
+    if (hptr->helperArray->array == NULL) {
+        errExit("out of memory");
+    }
+    hptr->helperArray->cap = count;
     // 初始化时哈希表长度为0
     hptr->helperArray->hashLen = 0;
 
-    // 给指针数组分配空间
-    hptr->bucket = malloc(sizeof(Node) * count);
-    if (hptr == NULL) {
+    // 链表节点从slab中分配，销毁的时候整块释放
+    slabInit(&hptr->nodes, sizeof(Node), 1);
+
+    // 给指针数组和所有头节点一次分配一整块空间
+    hptr->bucket = malloc((sizeof(Nodeptr) + sizeof(Node)) * count);
+    if (hptr->bucket == NULL) {
         errExit("out of memoery");
     }
+    Nodeptr heads = (Nodeptr)(hptr->bucket + count);
 
-    // 为数组的每个元素分配空间，元素是指向链表的指针
+    // 为数组的每个元素分配头节点，元素是指向链表的指针
     for (int i = 0; i < hptr->cap; i++) {
-        hptr->bucket[i] = malloc(sizeof(Node));
-        if (hptr == NULL) {
-            errExit("out of memoery");
-        }
+        hptr->bucket[i] = &heads[i];
         memset(hptr->bucket[i], 0, sizeof(Node));
         // 指针数组的元素是链表的头节点，当前实现只用于定位链表
         // 所以key和value不使用，不过还是把它们都初始化为NULL
@@ -315,6 +329,41 @@ Hptr create(int count) {
     return hptr;
 }
 
+// 销毁hash表
+// 节点都在slab里，头节点和指针数组在同一块内存里，不需要逐个free
+void destroy(Hptr hptr) {
+    if (hptr == NULL) {
+        return;
+    }
+    slabDestroy(&hptr->nodes);
+    free(hptr->bucket);
+    free(hptr->helperArray->array);
+    free(hptr->helperArray);
+    free(hptr);
+}
+
+#ifdef HASHSTATS
+// 统计链长的分布，这个表不扩容，扩容次数和用时总是0
+HashStats hashStats(Hptr hptr) {
+    HashStats st;
+    hashStatsInit(&st, NULL);
+    for (int i = 0; i < hptr->cap; i++) {
+        size_t n = 0;
+        Nodeptr tmp = hptr->bucket[i]->next;
+        while (tmp != NULL) {
+            ++n;
+            tmp = tmp->next;
+        }
+        hashStatsAdd(&st, n);
+        st.len += n;
+    }
+    st.cap = hptr->cap;
+    st.bytes = sizeof(Hash) + (sizeof(Nodeptr) + sizeof(Node)) * hptr->cap +
+               hptr->nodes.bytes;
+    return st;
+}
+#endif
+
 int main(void) {
     Hptr hptr = create(5);
     // 打印指针数组
@@ -326,6 +375,10 @@ int main(void) {
     insert(hptr, key, value);
     printf("the status after insert: \n");
     printArray(hptr);
+#ifdef HASHSTATS
+    HashStats st = hashStats(hptr);
+    hashStatsPrint(&st);
+#endif
     // 查找
     Nodeptr nptr = get(hptr, key);
     if (nptr == NULL) {
@@ -338,6 +391,7 @@ int main(void) {
     if (eptr == NULL) {
         printf("key `%s` not exists\n", key);
     }
+    destroy(hptr);
 
     return 0;
 }